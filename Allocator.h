@@ -65,7 +65,8 @@ public:
         while(current) {
             size_t percent = size * 100 / current->size;
 
-            if(percent >= 75 && percent <= 100) break;
+            //percent truncates, a block up to 1% too small would pass the <= 100 test
+            if(percent >= 75 && size <= current->size) break;
 
             previous = current;
             current = current->next;
@@ -98,9 +99,9 @@ public:
             if (oldSize >= newSize)
                 return ptr;
 
-            deallocate(ptr);
             void* newPtr = allocate(newSize);
             memcpy(newPtr, ptr, oldSize);
+            deallocate(ptr);
             return newPtr;
         }
 
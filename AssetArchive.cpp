@@ -0,0 +1,370 @@
+#include "AssetArchive.h"
+#include "ResourceHandle.h"
+#include "Device.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+/*
+ * count elements of elementSize bytes from offset are inside size bytes.
+ */
+static bool isInside(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size) {
+    return elementSize > 0 && offset <= size && count <= (size - offset) / elementSize;
+}
+
+static bool isValidMesh(const uint8_t* blob, uint64_t size) {
+    if (size < sizeof(ArchiveMesh))
+        return false;
+
+    const ArchiveMesh* mesh = (const ArchiveMesh*) blob;
+
+    if (mesh->numberVertices < 0 || mesh->numberIndices < 0 || mesh->numberGroups < 0 || mesh->numberClusters < 0 ||
+        mesh->vertexSize <= 0 || mesh->groupSize <= 0 || mesh->clusterSize <= 0)
+        return false;
+
+    if (mesh->numberIndices > 0 && mesh->indexType != GL_UNSIGNED_SHORT && mesh->indexType != GL_UNSIGNED_INT)
+        return false;
+
+    //the arrays are read in place
+    if ((mesh->verticesOffset | mesh->indicesOffset | mesh->groupsOffset | mesh->clustersOffset) % ARCHIVE_ALIGNMENT != 0)
+        return false;
+
+    uint64_t indexSize = mesh->indexType == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    return mesh->verticesOffset >= sizeof(ArchiveMesh) &&
+           isInside(mesh->verticesOffset, mesh->numberVertices, mesh->vertexSize, size) &&
+           isInside(mesh->indicesOffset, mesh->numberIndices, indexSize, size) &&
+           isInside(mesh->groupsOffset, mesh->numberGroups, mesh->groupSize, size) &&
+           isInside(mesh->clustersOffset, mesh->numberClusters, mesh->clusterSize, size);
+}
+
+static bool isValidTexture(const uint8_t* blob, uint64_t size) {
+    if (size < sizeof(ArchiveTexture))
+        return false;
+
+    const ArchiveTexture* texture = (const ArchiveTexture*) blob;
+
+    if (texture->width <= 0 || texture->height <= 0 || texture->levels <= 0 ||
+        texture->levels > Device::getMipLevels(texture->width, texture->height))
+        return false;
+
+    //the formats the cooker writes, anything else would be uploaded with the wrong size
+    if (texture->type != GL_UNSIGNED_BYTE)
+        return false;
+
+    switch (texture->channels) {
+    case 1:
+        if (texture->internalFormat != GL_R8 || texture->format != GL_RED)
+            return false;
+        break;
+    case 3:
+        if (texture->internalFormat != GL_RGB8 || texture->format != GL_RGB)
+            return false;
+        break;
+    case 4:
+        if (texture->internalFormat != GL_RGBA8 || texture->format != GL_RGBA)
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    uint64_t chainSize = 0;
+
+    for (int i = 0; i < texture->levels; i++) {
+        uint64_t width = std::max(texture->width >> i, 1);
+        uint64_t height = std::max(texture->height >> i, 1);
+
+        chainSize += width * height * texture->channels;
+    }
+
+    return texture->pixelsOffset >= sizeof(ArchiveTexture) && isInside(texture->pixelsOffset, chainSize, 1, size);
+}
+
+/*
+ * Every entry and every array of its blob is inside the file, so nothing read
+ * through find() and getData() goes past the mapping.
+ */
+static bool isValidArchive(const uint8_t* data, uint64_t size) {
+    const ArchiveHeader* header = (const ArchiveHeader*) data;
+
+    if (header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION)
+        return false;
+
+    //the table is aligned, its entries can be read in place
+    if (header->tocOffset < sizeof(ArchiveHeader) || header->tocOffset % ARCHIVE_ALIGNMENT != 0 ||
+        !isInside(header->tocOffset, header->entryCount, sizeof(ArchiveEntry), size))
+        return false;
+
+    uint64_t pathsOffset = header->tocOffset + header->entryCount * sizeof(ArchiveEntry);
+
+    if (!isInside(pathsOffset, header->pathsSize, 1, size))
+        return false;
+
+    const ArchiveEntry* entries = (const ArchiveEntry*) (data + header->tocOffset);
+    const char* paths = (const char*) (data + pathsOffset);
+
+    if (header->entryCount > 0 && (header->pathsSize == 0 || paths[header->pathsSize - 1] != '\0'))
+        return false;
+
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const ArchiveEntry& entry = entries[i];
+
+        //find() searches the table by hash
+        if (i > 0 && entries[i - 1].hash > entry.hash)
+            return false;
+
+        if (entry.pathOffset >= header->pathsSize || entry.offset < sizeof(ArchiveHeader) ||
+            entry.offset % ARCHIVE_ALIGNMENT != 0 || !isInside(entry.offset, entry.size, 1, header->tocOffset))
+            return false;
+
+        const uint8_t* blob = data + entry.offset;
+
+        switch (entry.type) {
+        case ARCHIVE_MESH:
+            if (!isValidMesh(blob, entry.size))
+                return false;
+            break;
+        case ARCHIVE_TEXTURE:
+            if (!isValidTexture(blob, entry.size))
+                return false;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+AssetArchive::AssetArchive() : data(nullptr), size(0), entries(nullptr), paths(nullptr), entryCount(0) {
+}
+
+AssetArchive::~AssetArchive() {
+    close();
+}
+
+bool AssetArchive::open(const char* filename) {
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(ArchiveHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    //the mapping outlives the descriptor
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (mapped == MAP_FAILED)
+        return false;
+
+    const ArchiveHeader* header = (const ArchiveHeader*) mapped;
+
+    if (!isValidArchive((const uint8_t*) mapped, info.st_size)) {
+        munmap(mapped, info.st_size);
+        return false;
+    }
+
+    data = (const uint8_t*) mapped;
+    size = info.st_size;
+    entries = (const ArchiveEntry*) (data + header->tocOffset);
+    paths = (const char*) (entries + header->entryCount);
+    entryCount = header->entryCount;
+
+    return true;
+}
+
+void AssetArchive::close() {
+    if (data != nullptr)
+        munmap((void*) data, size);
+
+    data = nullptr;
+    size = 0;
+    entries = nullptr;
+    paths = nullptr;
+    entryCount = 0;
+}
+
+const ArchiveEntry* AssetArchive::find(const char* path) {
+    uint64_t hash = HandleIndex::hashPath(path);
+
+    const ArchiveEntry* first = std::lower_bound(entries, entries + entryCount, hash,
+                                                 [](const ArchiveEntry& entry, uint64_t hash) {
+                                                     return entry.hash < hash;
+                                                 });
+
+    for (const ArchiveEntry* entry = first; entry < entries + entryCount && entry->hash == hash; entry++) {
+        if (strcmp(paths + entry->pathOffset, path) != 0)
+            continue;
+
+        //an edited file wins over its stale cooked copy
+        struct stat info;
+
+        if (stat(path, &info) == 0 && ((uint64_t) info.st_size != entry->sourceSize || info.st_mtime != entry->sourceTime))
+            return nullptr;
+
+        return entry;
+    }
+
+    return nullptr;
+}
+
+const void* AssetArchive::getData(const ArchiveEntry* entry) {
+    return data + entry->offset;
+}
+
+uint32_t AssetArchive::getEntryCount() {
+    return entryCount;
+}
+
+ArchiveWriter::ArchiveWriter(HeapAllocator& allocator) : allocator(allocator), file(nullptr), offset(0), failed(false) {
+    entryCount = 0;
+    entryAllocated = 64;
+    entries = (ArchiveEntry*) allocator.allocate(entryAllocated * sizeof(ArchiveEntry));
+
+    pathsSize = 0;
+    pathsAllocated = 4096;
+    paths = (char*) allocator.allocate(pathsAllocated);
+}
+
+ArchiveWriter::~ArchiveWriter() {
+    if (file != nullptr)
+        fclose(file);
+
+    allocator.deallocate(entries);
+    allocator.deallocate(paths);
+}
+
+bool ArchiveWriter::open(const char* filename) {
+    assert(file == nullptr);
+
+    file = fopen(filename, "wb");
+
+    if (file == nullptr)
+        return false;
+
+    //rewritten by close() once the table is known
+    failed = false;
+
+    ArchiveHeader header = {};
+    put(&header, sizeof(ArchiveHeader));
+    offset = sizeof(ArchiveHeader);
+
+    entryCount = 0;
+    pathsSize = 0;
+
+    return true;
+}
+
+void ArchiveWriter::beginEntry(const char* path, uint32_t type) {
+    if (entryCount >= entryAllocated) {
+        entryAllocated = entryAllocated * 3 / 2;
+        entries = (ArchiveEntry*) allocator.reallocate(entries, entryAllocated * sizeof(ArchiveEntry));
+    }
+
+    uint32_t length = strlen(path) + 1;
+
+    while (pathsSize + length > pathsAllocated) {
+        pathsAllocated = pathsAllocated * 3 / 2;
+        paths = (char*) allocator.reallocate(paths, pathsAllocated);
+    }
+
+    memcpy(paths + pathsSize, path, length);
+
+    pad();
+
+    struct stat info;
+
+    if (stat(path, &info) != 0) {
+        info.st_size = 0;
+        info.st_mtime = 0;
+    }
+
+    ArchiveEntry& entry = entries[entryCount];
+    entry.hash = HandleIndex::hashPath(path);
+    entry.offset = offset;
+    entry.size = 0;
+    entry.sourceSize = info.st_size;
+    entry.sourceTime = info.st_mtime;
+    entry.pathOffset = pathsSize;
+    entry.type = type;
+
+    pathsSize += length;
+}
+
+uint64_t ArchiveWriter::write(const void* data, uint64_t size) {
+    pad();
+
+    uint64_t start = offset - entries[entryCount].offset;
+
+    put(data, size);
+    offset += size;
+
+    return start;
+}
+
+void ArchiveWriter::endEntry() {
+    ArchiveEntry& entry = entries[entryCount];
+    entry.size = offset - entry.offset;
+
+    entryCount++;
+}
+
+uint64_t ArchiveWriter::close() {
+    std::sort(entries, entries + entryCount, [](const ArchiveEntry& a, const ArchiveEntry& b) {
+        return a.hash < b.hash;
+    });
+
+    pad();
+
+    ArchiveHeader header;
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.entryCount = entryCount;
+    header.pathsSize = pathsSize;
+    header.tocOffset = offset;
+
+    put(entries, entryCount * sizeof(ArchiveEntry));
+    put(paths, pathsSize);
+
+    uint64_t size = offset + entryCount * sizeof(ArchiveEntry) + pathsSize;
+
+    //the header stays zeroed when anything before it failed, open() rejects it
+    if (failed || fseek(file, 0, SEEK_SET) != 0)
+        failed = true;
+    else
+        put(&header, sizeof(ArchiveHeader));
+
+    if (fclose(file) != 0)
+        failed = true;
+
+    file = nullptr;
+
+    return failed ? 0 : size;
+}
+
+void ArchiveWriter::pad() {
+    static const uint8_t zeros[ARCHIVE_ALIGNMENT] = {};
+
+    uint64_t aligned = mnArchiveAlign(offset);
+
+    put(zeros, aligned - offset);
+    offset = aligned;
+}
+
+void ArchiveWriter::put(const void* data, uint64_t size) {
+    if (size > 0 && fwrite(data, 1, size, file) != size)
+        failed = true;
+}
@@ -0,0 +1,162 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Allocator.h"
+
+/*
+ * A cooked archive is the header, the blobs, each one aligned to
+ * ARCHIVE_ALIGNMENT, then the table of contents sorted by path hash followed by
+ * the paths. The blobs are in the layout the device takes, so loading only maps
+ * the file and uploads from the mapped pages.
+ *
+ * Meshes and textures are stored as the structures below followed by their
+ * arrays. The arrays are PackedVertex, MeshRange and MeshCluster as they are in
+ * memory, a mesh cooked with other sizes is not used.
+ *
+ * Each entry keeps the size and modification time of the file it was cooked
+ * from, an entry whose file changed since is not used either and the file is
+ * loaded instead.
+ */
+const uint32_t ARCHIVE_MAGIC = 0x4b41504d; //"MPAK"
+const uint32_t ARCHIVE_VERSION = 2;
+const uint64_t ARCHIVE_ALIGNMENT = 64;
+
+enum ArchiveEntryType {
+    ARCHIVE_MESH = 1,
+    ARCHIVE_TEXTURE = 2
+};
+
+struct ArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t pathsSize;
+    uint64_t tocOffset;
+};
+
+struct ArchiveEntry {
+    uint64_t hash;       //HandleIndex::hashPath of the path
+    uint64_t offset;     //of the blob from the start of the file
+    uint64_t size;
+    uint64_t sourceSize; //of the file it was cooked from
+    int64_t sourceTime;  //modification time of that file, in seconds
+    uint32_t pathOffset; //into the paths after the table
+    uint32_t type;
+};
+
+struct ArchiveMesh {
+    int32_t numberVertices;
+    int32_t numberIndices;  //0 when not indexed
+    int32_t indexType;      //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    int32_t numberGroups;
+    int32_t numberClusters;
+    int32_t vertexSize;  //sizeof(PackedVertex) when cooked
+    int32_t groupSize;   //sizeof(MeshRange)
+    int32_t clusterSize; //sizeof(MeshCluster)
+
+    //from the start of the blob
+    uint64_t verticesOffset;
+    uint64_t indicesOffset;
+    uint64_t groupsOffset;
+    uint64_t clustersOffset;
+};
+
+struct ArchiveTexture {
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t levels;
+    int32_t internalFormat;
+    int32_t format;
+    int32_t type;
+    int32_t padding;
+
+    uint64_t pixelsOffset; //every level down to 1x1, back to back
+};
+
+inline uint64_t mnArchiveAlign(uint64_t offset) {
+    return (offset + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+}
+
+/*
+ * Maps an archive read only, the blobs stay valid until it is closed.
+ */
+class AssetArchive {
+public:
+    AssetArchive();
+
+    ~AssetArchive();
+
+    /*
+     * False when the file is missing, was cooked by another version or any entry
+     * points outside of it.
+     */
+    bool open(const char* filename);
+
+    void close();
+
+    /*
+     * nullptr when nothing was cooked from path or path changed since. Without
+     * the file the cooked entry is used as it is.
+     */
+    const ArchiveEntry* find(const char* path);
+
+    const void* getData(const ArchiveEntry* entry);
+
+    uint32_t getEntryCount();
+private:
+    const uint8_t* data;
+    size_t size;
+    const ArchiveEntry* entries;
+    const char* paths;
+    uint32_t entryCount;
+};
+
+/*
+ * Writes the blobs as they come, the table of contents is written by close().
+ */
+class ArchiveWriter {
+public:
+    ArchiveWriter(HeapAllocator& allocator);
+
+    ~ArchiveWriter();
+
+    bool open(const char* filename);
+
+    void beginEntry(const char* path, uint32_t type);
+
+    /*
+     * Aligned to ARCHIVE_ALIGNMENT, returns the offset from the start of the blob.
+     */
+    uint64_t write(const void* data, uint64_t size);
+
+    void endEntry();
+
+    /*
+     * Returns the size of the archive, 0 if any part of it failed to write.
+     */
+    uint64_t close();
+private:
+    void put(const void* data, uint64_t size);
+
+    void pad();
+
+    HeapAllocator& allocator;
+
+    FILE* file;
+    uint64_t offset;
+    bool failed; //a write came up short, the archive is incomplete
+
+    ArchiveEntry* entries;
+    uint32_t entryCount;
+    uint32_t entryAllocated;
+
+    char* paths;
+    uint32_t pathsSize;
+    uint32_t pathsAllocated;
+};
+
+#endif //ASSET_ARCHIVE_H
@@ -0,0 +1,157 @@
+#include "AssetLoader.h"
+
+#include <chrono>
+
+AssetLoader::AssetLoader(HeapAllocator& allocator, Device& device, int threadCount)
+        : device(device), futures(allocator), queuedHead(0), queuedTail(0), decodedHead(0), decodedTail(0),
+          quit(false) {
+    if (threadCount < 1)
+        threadCount = 1;
+
+    if (threadCount > ASSET_LOADER_MAX_THREADS)
+        threadCount = ASSET_LOADER_MAX_THREADS;
+
+    this->threadCount = threadCount;
+
+    for (int i = 0; i < threadCount; i++)
+        threads[i] = std::thread(&AssetLoader::run, this);
+}
+
+AssetLoader::~AssetLoader() {
+    finish();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+
+    condition.notify_all();
+
+    for (int i = 0; i < threadCount; i++)
+        threads[i].join();
+}
+
+AssetFuture AssetLoader::load(DecodeFunction decode, FinalizeFunction finalize, void* data) {
+    if (getPendingCount() >= ASSET_LOADER_MAX_JOBS)
+        finalizeNext(true);
+
+    //no more than ASSET_LOADER_MAX_JOBS are alive, neither are slots
+    AssetFuture future = futures.create();
+    uint32_t slot = mnHandleSlot(future);
+
+    assert(slot < ASSET_LOADER_MAX_JOBS);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Job& job = jobs[slot];
+        job.decode = decode;
+        job.finalize = finalize;
+        job.data = data;
+        job.future = future;
+
+        queued[queuedTail % ASSET_LOADER_MAX_JOBS] = slot;
+        queuedTail++;
+    }
+
+    condition.notify_one();
+
+    return future;
+}
+
+int AssetLoader::finalize(float budget) {
+    auto start = std::chrono::high_resolution_clock::now();
+    int finalized = 0;
+
+    while (finalizeNext(false)) {
+        finalized++;
+
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        if (elapsed.count() >= budget)
+            break;
+    }
+
+    return finalized;
+}
+
+bool AssetLoader::isDone(AssetFuture future) {
+    return !futures.isValid(future);
+}
+
+void AssetLoader::wait(AssetFuture future) {
+    while (!isDone(future))
+        finalizeNext(true);
+}
+
+void AssetLoader::finish() {
+    while (finalizeNext(true)) {
+    }
+}
+
+int AssetLoader::getPendingCount() {
+    return futures.getCount();
+}
+
+bool AssetLoader::finalizeNext(bool wait) {
+    if (futures.getCount() == 0)
+        return false;
+
+    uint32_t slot;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (wait)
+            finished.wait(lock, [this]() { return decodedHead != decodedTail; });
+        else if (decodedHead == decodedTail)
+            return false;
+
+        slot = decoded[decodedHead % ASSET_LOADER_MAX_JOBS];
+        decodedHead++;
+    }
+
+    //the slot is not reused before the future is destroyed
+    Job& job = jobs[slot];
+
+    job.finalize(device, job.allocator, job.data);
+
+    //the blocks decode freed would stay cached in the slot until it is reused
+    assert(job.allocator.memoryUsed() == 0);
+    job.allocator.clearMemory();
+
+    futures.destroy(job.future);
+
+    return true;
+}
+
+void AssetLoader::run() {
+    while (true) {
+        uint32_t slot;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            condition.wait(lock, [this]() { return quit || queuedHead != queuedTail; });
+
+            if (queuedHead == queuedTail)
+                break;
+
+            slot = queued[queuedHead % ASSET_LOADER_MAX_JOBS];
+            queuedHead++;
+        }
+
+        Job& job = jobs[slot];
+
+        job.decode(job.allocator, job.data);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            decoded[decodedTail % ASSET_LOADER_MAX_JOBS] = slot;
+            decodedTail++;
+        }
+
+        finished.notify_one();
+    }
+}
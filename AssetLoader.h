@@ -0,0 +1,116 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Device.h"
+#include "Allocator.h"
+#include "ResourceHandle.h"
+
+const int ASSET_LOADER_MAX_JOBS = 64;
+const int ASSET_LOADER_MAX_THREADS = 8;
+
+/*
+ * Completes when the job is finalized, handles of finished jobs stop being valid.
+ */
+typedef ResourceHandle AssetFuture;
+
+/*
+ * Runs on one of the workers and must not touch the device. File reads, parsing
+ * and decoding go here.
+ */
+typedef void (*DecodeFunction)(HeapAllocator& allocator, void* data);
+
+/*
+ * Runs on the render thread and creates the device objects. Whatever decode got
+ * from allocator has to be given back here.
+ */
+typedef void (*FinalizeFunction)(Device& device, HeapAllocator& allocator, void* data);
+
+/*
+ * Decodes assets on a pool of worker threads and finalizes them on the render
+ * thread. No context is shared, the workers never see the device, so any number
+ * of them can decode at the same time.
+ *
+ * Every job owns an allocator, handed from the worker to the render thread
+ * together with the job, so decode and finalize can pass memory between them.
+ * Its memory is released once the job is finalized.
+ *
+ * This is how the model and texture managers load asynchronously.
+ */
+class AssetLoader {
+public:
+    AssetLoader(HeapAllocator& allocator, Device& device, int threadCount);
+
+    /*
+     * Finishes every queued job first.
+     */
+    ~AssetLoader();
+
+    /*
+     * Queues a job, while ASSET_LOADER_MAX_JOBS are pending the oldest decoded
+     * one is waited on and finalized.
+     */
+    AssetFuture load(DecodeFunction decode, FinalizeFunction finalize, void* data);
+
+    /*
+     * Finalizes decoded jobs, in the order they were decoded, until budget
+     * milliseconds are spent. At least one is finalized when there is any, so
+     * loading never stalls. Call it once per frame from the render thread, returns
+     * how many were finalized.
+     */
+    int finalize(float budget);
+
+    bool isDone(AssetFuture future);
+
+    /*
+     * Finalizes decoded jobs until this one is done.
+     */
+    void wait(AssetFuture future);
+
+    /*
+     * Waits for and finalizes every queued job.
+     */
+    void finish();
+
+    int getPendingCount();
+private:
+    struct Job {
+        DecodeFunction decode;
+        FinalizeFunction finalize;
+        void* data;
+        AssetFuture future;
+        HeapAllocator allocator;
+    };
+
+    bool finalizeNext(bool wait);
+
+    void run();
+
+    Device& device;
+
+    HandleAllocator futures; //render thread only
+    Job jobs[ASSET_LOADER_MAX_JOBS]; //by future slot
+
+    /*
+     * Slots of the jobs waiting for a worker and of the decoded ones waiting to be
+     * finalized, the counters only grow and wrap around the arrays.
+     */
+    uint32_t queued[ASSET_LOADER_MAX_JOBS];
+    uint32_t queuedHead;
+    uint32_t queuedTail;
+    uint32_t decoded[ASSET_LOADER_MAX_JOBS];
+    uint32_t decodedHead;
+    uint32_t decodedTail;
+
+    int threadCount;
+    std::thread threads[ASSET_LOADER_MAX_THREADS];
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable finished;
+    bool quit;
+};
+
+#endif //ASSET_LOADER_H
@@ -0,0 +1,303 @@
+#include "Cluster.h"
+
+#include <math.h>
+#include <string.h>
+
+//triangles around the cluster waiting to be picked
+const int CLUSTER_MAX_CANDIDATES = 256;
+
+/*
+ * Unit normal, zero for degenerate triangles.
+ */
+static void mnTriangleNormal(const Vector3& v0, const Vector3& v1, const Vector3& v2, Vector3& normal) {
+    Vector3 e0, e1;
+
+    mnVector3Sub(v1.values, v0.values, e0.values);
+    mnVector3Sub(v2.values, v0.values, e1.values);
+    mnVector3Cross(e0.values, e1.values, normal.values);
+
+    float length = mnVector3Length(normal.values);
+
+    if (length > 0)
+        mnVector3MulScalar(normal.values, 1 / length, normal.values);
+}
+
+static void mnFinishCluster(const Vector3* vertices, const uint32_t* indices, const Vector3* normals,
+                            const uint32_t* triangles, const float normalSum[3], MeshCluster& cluster) {
+    BoundingBox box;
+    mnComputeBounds(vertices, indices, cluster.offset, cluster.count, box, cluster.sphere);
+
+    float length = mnVector3Length(normalSum);
+
+    cluster.coneCutoff = 1;
+    cluster.coneAxis[0] = 0;
+    cluster.coneAxis[1] = 0;
+    cluster.coneAxis[2] = 1;
+
+    if (length <= 0)
+        return;
+
+    mnVector3MulScalar(normalSum, 1 / length, cluster.coneAxis);
+
+    float minDot = 1;
+
+    for (int i = 0; i < cluster.count / 3; i++) {
+        const Vector3& normal = normals[triangles[i]];
+
+        if (normal.x == 0 && normal.y == 0 && normal.z == 0)
+            continue;
+
+        float dot = mnVector3Dot(normal.values, cluster.coneAxis);
+        minDot = dot < minDot ? dot : minDot;
+    }
+
+    //wider than about 84 degrees, some triangle always faces the camera
+    cluster.coneCutoff = minDot <= 0.1f ? 1 : sqrtf(1 - minDot * minDot);
+}
+
+int mnBuildClusters(HeapAllocator& allocator, const Vector3* vertices, int numberVertices,
+                    uint32_t* indices, int offset, int count, MeshCluster* clusters) {
+    int triangleCount = count / 3;
+
+    if (triangleCount == 0)
+        return 0;
+
+    uint32_t* original = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    Vector3* centroids = (Vector3*) allocator.allocate(triangleCount * sizeof(Vector3));
+    Vector3* normals = (Vector3*) allocator.allocate(triangleCount * sizeof(Vector3));
+    uint8_t* emitted = (uint8_t*) allocator.allocate(triangleCount);
+    uint32_t* order = (uint32_t*) allocator.allocate(triangleCount * sizeof(uint32_t));
+    uint32_t* stamp = (uint32_t*) allocator.allocate(triangleCount * sizeof(uint32_t));
+    uint32_t* adjacencyOffset = (uint32_t*) allocator.allocate((numberVertices + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    uint32_t* live = (uint32_t*) allocator.allocate(numberVertices * sizeof(uint32_t));
+    uint32_t candidates[CLUSTER_MAX_CANDIDATES];
+
+    memcpy(original, &indices[offset], count * sizeof(uint32_t));
+    memset(emitted, 0, triangleCount);
+    memset(stamp, 0, triangleCount * sizeof(uint32_t));
+
+    for (int i = 0; i < triangleCount; i++) {
+        const Vector3& v0 = vertices[original[i*3 + 0]];
+        const Vector3& v1 = vertices[original[i*3 + 1]];
+        const Vector3& v2 = vertices[original[i*3 + 2]];
+
+        for (int j = 0; j < 3; j++)
+            centroids[i].values[j] = (v0.values[j] + v1.values[j] + v2.values[j]) / 3;
+
+        mnTriangleNormal(v0, v1, v2, normals[i]);
+    }
+
+    //triangles around each vertex
+    memset(adjacencyOffset, 0, (numberVertices + 1) * sizeof(uint32_t));
+
+    for (int i = 0; i < count; i++)
+        adjacencyOffset[original[i] + 1]++;
+
+    for (int i = 0; i < numberVertices; i++)
+        adjacencyOffset[i + 1] += adjacencyOffset[i];
+
+    for (int i = 0; i < count; i++)
+        adjacency[adjacencyOffset[original[i]]++] = (uint32_t) (i / 3);
+
+    for (int i = numberVertices; i > 0; i--)
+        adjacencyOffset[i] = adjacencyOffset[i - 1];
+
+    adjacencyOffset[0] = 0;
+
+    //triangles not emitted yet around each vertex
+    for (int i = 0; i < numberVertices; i++)
+        live[i] = adjacencyOffset[i + 1] - adjacencyOffset[i];
+
+    int clusterCount = 0;
+    int written = 0;
+    int scan = 0;
+    int candidateCount = 0;
+
+    while (written < triangleCount) {
+        //the next cluster starts next to the last one, at the triangle with fewer
+        //neighbours left so no small islands are left behind
+        int seed = -1;
+        uint32_t seedLive = 0;
+
+        for (int j = 0; j < candidateCount; j++) {
+            uint32_t triangle = candidates[j];
+
+            if (emitted[triangle])
+                continue;
+
+            const uint32_t* t = &original[triangle * 3];
+            uint32_t triangleLive = live[t[0]] + live[t[1]] + live[t[2]];
+
+            if (seed < 0 || triangleLive < seedLive) {
+                seed = (int) triangle;
+                seedLive = triangleLive;
+            }
+        }
+
+        if (seed < 0) {
+            while (emitted[scan])
+                scan++;
+
+            seed = scan;
+        }
+
+        MeshCluster& cluster = clusters[clusterCount++];
+        cluster.offset = offset + written * 3;
+
+        float center[3] = {0, 0, 0};
+        float normalSum[3] = {0, 0, 0};
+        int first = written;
+        uint32_t next = (uint32_t) seed;
+
+        candidateCount = 0;
+
+        //grows around the seed, picking the closest triangle that faces the same way
+        while (true) {
+            emitted[next] = 1;
+            order[written] = next;
+
+            for (int j = 0; j < 3; j++)
+                live[original[next * 3 + j]]--;
+
+            memcpy(&indices[offset + written * 3], &original[next * 3], 3 * sizeof(uint32_t));
+            written++;
+
+            int size = written - first;
+
+            for (int j = 0; j < 3; j++) {
+                center[j] += (centroids[next].values[j] - center[j]) / size;
+                normalSum[j] += normals[next].values[j];
+            }
+
+            for (int j = 0; j < 3; j++) {
+                uint32_t vertex = original[next * 3 + j];
+
+                for (uint32_t k = adjacencyOffset[vertex]; k < adjacencyOffset[vertex + 1]; k++) {
+                    uint32_t triangle = adjacency[k];
+
+                    if (emitted[triangle] || stamp[triangle] == (uint32_t) clusterCount ||
+                        candidateCount == CLUSTER_MAX_CANDIDATES)
+                        continue;
+
+                    stamp[triangle] = (uint32_t) clusterCount;
+                    candidates[candidateCount++] = triangle;
+                }
+            }
+
+            if (size == CLUSTER_MAX_TRIANGLES)
+                break;
+
+            float axis[3];
+            float length = mnVector3Length(normalSum);
+
+            if (length > 0)
+                mnVector3MulScalar(normalSum, 1 / length, axis);
+            else
+                axis[0] = axis[1] = axis[2] = 0;
+
+            int best = -1;
+            float bestScore = 0;
+
+            for (int j = 0; j < candidateCount;) {
+                uint32_t triangle = candidates[j];
+
+                if (emitted[triangle]) {
+                    candidates[j] = candidates[--candidateCount];
+                    continue;
+                }
+
+                float d[3];
+                mnVector3Sub(centroids[triangle].values, center, d);
+
+                float score = mnVector3Length(d) * (1 + 2 * (1 - mnVector3Dot(normals[triangle].values, axis)));
+
+                if (best < 0 || score < bestScore) {
+                    best = j;
+                    bestScore = score;
+                }
+
+                j++;
+            }
+
+            if (best < 0)
+                break;
+
+            next = candidates[best];
+            candidates[best] = candidates[--candidateCount];
+        }
+
+        cluster.count = (written - first) * 3;
+
+        mnFinishCluster(vertices, indices, normals, &order[first], normalSum, cluster);
+    }
+
+    allocator.deallocate(original);
+    allocator.deallocate(centroids);
+    allocator.deallocate(normals);
+    allocator.deallocate(emitted);
+    allocator.deallocate(order);
+    allocator.deallocate(stamp);
+    allocator.deallocate(adjacencyOffset);
+    allocator.deallocate(adjacency);
+    allocator.deallocate(live);
+
+    return clusterCount;
+}
+
+int mnCullClusters(const MeshCluster* clusters, int count, const float model[16], const Frustum* frustum,
+                   const float camera[3], int* offsets, int* counts) {
+    const int batchSize = 64;
+
+    BoundingSphere spheres[batchSize];
+    uint8_t visible[batchSize];
+    int rangeCount = 0;
+
+    for (int i = 0; i < count; i += batchSize) {
+        int batch = count - i < batchSize ? count - i : batchSize;
+
+        for (int j = 0; j < batch; j++)
+            mnTransformSphere(clusters[i + j].sphere, model, spheres[j]);
+
+        if (frustum != nullptr)
+            mnCullSpheres(*frustum, spheres, batch, visible);
+        else
+            memset(visible, 1, batch);
+
+        for (int j = 0; j < batch; j++) {
+            const MeshCluster& cluster = clusters[i + j];
+
+            if (!visible[j])
+                continue;
+
+            //every normal is more than 90 degrees away from the direction to the camera
+            if (cluster.coneCutoff < 1) {
+                const float* a = cluster.coneAxis;
+                float axis[3] = {
+                        model[0]*a[0] + model[4]*a[1] + model[8]*a[2],
+                        model[1]*a[0] + model[5]*a[1] + model[9]*a[2],
+                        model[2]*a[0] + model[6]*a[1] + model[10]*a[2],
+                };
+
+                float toCenter[3];
+                mnVector3Sub(spheres[j].center, camera, toCenter);
+
+                float length = mnVector3Length(axis);
+
+                if (length > 0 && mnVector3Dot(toCenter, axis) / length >=
+                                  cluster.coneCutoff * mnVector3Length(toCenter) + spheres[j].radius)
+                    continue;
+            }
+
+            if (rangeCount > 0 && offsets[rangeCount - 1] + counts[rangeCount - 1] == cluster.offset) {
+                counts[rangeCount - 1] += cluster.count;
+            } else {
+                offsets[rangeCount] = cluster.offset;
+                counts[rangeCount] = cluster.count;
+                rangeCount++;
+            }
+        }
+    }
+
+    return rangeCount;
+}
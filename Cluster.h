@@ -0,0 +1,44 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdint.h>
+
+#include "Vector.h"
+#include "Allocator.h"
+#include "Culling.h"
+
+const int CLUSTER_MAX_TRIANGLES = 128;
+
+/*
+ * Ranges with fewer triangles than this are not split, one cluster would cover
+ * most of them anyway.
+ */
+const int CLUSTER_MIN_TRIANGLES = 2 * CLUSTER_MAX_TRIANGLES;
+
+struct MeshCluster {
+    BoundingSphere sphere; //model space
+    float coneAxis[3];     //average normal of the triangles
+    float coneCutoff;      //sine of the widest angle to the axis, 1 never faces away
+    int offset;
+    int count;
+};
+
+/*
+ * Reorders the triangles of indices[offset..offset+count) into clusters of at most
+ * CLUSTER_MAX_TRIANGLES neighbouring triangles facing about the same way, each
+ * one contiguous in indices. Returns how many clusters were written, clusters
+ * must hold count / 3 of them.
+ */
+int mnBuildClusters(HeapAllocator& allocator, const Vector3* vertices, int numberVertices,
+                    uint32_t* indices, int offset, int count, MeshCluster* clusters);
+
+/*
+ * Index ranges of the clusters that touch the frustum and have at least one
+ * triangle facing camera, both in world space, model is the cluster transform
+ * and should not scale unevenly. Ranges next to each other in the index buffer
+ * are merged. frustum may be nullptr, returns how many ranges were written.
+ */
+int mnCullClusters(const MeshCluster* clusters, int count, const float model[16], const Frustum* frustum,
+                   const float camera[3], int* offsets, int* counts);
+
+#endif //CLUSTER_H
@@ -9,6 +9,7 @@ const FnSubmitCommand submitCommand[] = {
         [DRAW_ARRAYS_INSTANCED] = FnSubmitCommand(DrawArraysInstanced::submit),
         [DRAW_TRIANGLES] = FnSubmitCommand(DrawTriangles::submit),
         [DRAW_TRIANGLES_INSTANCED] = FnSubmitCommand(DrawTrianglesInstanced::submit),
+        [MULTI_DRAW_TRIANGLES] = FnSubmitCommand(MultiDrawTriangles::submit),
         [CLEAR_COLOR0] = FnSubmitCommand(ClearColor::submit),
         [CLEAR_COLOR1] = FnSubmitCommand(ClearColor::submit),
         [CLEAR_COLOR2] = FnSubmitCommand(ClearColor::submit),
@@ -18,6 +19,8 @@ const FnSubmitCommand submitCommand[] = {
         [CLEAR_COLOR6] = FnSubmitCommand(ClearColor::submit),
         [CLEAR_COLOR7] = FnSubmitCommand(ClearColor::submit),
         [CLEAR_DEPTH_STENCIL] = FnSubmitCommand(ClearDepthStencil::submit),
+        [PROFILE_BEGIN] = FnSubmitCommand(ProfileBegin::submit),
+        [PROFILE_END] = FnSubmitCommand(ProfileEnd::submit),
         [BIND_FRAMEBUFFER] = FnSubmitCommand(BindFramebuffer::submit),
         [SET_VIEWPORT0] = FnSubmitCommand(SetViewport::submit),
         [SET_VIEWPORT1] = FnSubmitCommand(SetViewport::submit),
@@ -57,6 +60,7 @@ const int sizeCommand[] = {
         [DRAW_ARRAYS_INSTANCED] = sizeof(DrawArraysInstanced),
         [DRAW_TRIANGLES] = sizeof(DrawTriangles),
         [DRAW_TRIANGLES_INSTANCED] = sizeof(DrawTrianglesInstanced),
+        [MULTI_DRAW_TRIANGLES] = sizeof(MultiDrawTriangles),
         [CLEAR_COLOR0] = sizeof(ClearColor),
         [CLEAR_COLOR1] = sizeof(ClearColor),
         [CLEAR_COLOR2] = sizeof(ClearColor),
@@ -66,6 +70,8 @@ const int sizeCommand[] = {
         [CLEAR_COLOR6] = sizeof(ClearColor),
         [CLEAR_COLOR7] = sizeof(ClearColor),
         [CLEAR_DEPTH_STENCIL] = sizeof(ClearDepthStencil),
+        [PROFILE_BEGIN] = sizeof(ProfileBegin),
+        [PROFILE_END] = sizeof(ProfileEnd),
         [BIND_FRAMEBUFFER] = sizeof(BindFramebuffer),
         [SET_VIEWPORT0] = sizeof(SetViewport),
         [SET_VIEWPORT1] = sizeof(SetViewport),
@@ -9,12 +9,14 @@
 
 #include "Allocator.h"
 #include "Device.h"
+#include "Profiler.h"
 
 enum CommandType {
     DRAW_ARRAYS,
     DRAW_ARRAYS_INSTANCED,
     DRAW_TRIANGLES,
     DRAW_TRIANGLES_INSTANCED,
+    MULTI_DRAW_TRIANGLES,
     CLEAR_COLOR0,
     CLEAR_COLOR1,
     CLEAR_COLOR2,
@@ -24,7 +26,9 @@ enum CommandType {
     CLEAR_COLOR6,
     CLEAR_COLOR7,
     CLEAR_DEPTH_STENCIL,
-    DIRECT_COMMANDS_MAX = CLEAR_DEPTH_STENCIL,
+    PROFILE_BEGIN,
+    PROFILE_END,
+    DIRECT_COMMANDS_MAX = PROFILE_END,
     SET_VIEWPORT0,
     SET_VIEWPORT1,
     SET_VIEWPORT2,
@@ -166,7 +170,7 @@ struct ClearColor {
 
     static void submit(Device& device, ClearColor* cmd) {
         int index = cmd->command.id - CLEAR_COLOR0;
-        glClearBufferfv(GL_COLOR, index, cmd->color); CHECK_ERROR;
+        device.clearColor(index, cmd->color);
     }
 };
 
@@ -184,7 +188,43 @@ struct ClearDepthStencil {
     }
 
     static void submit(Device& device, ClearDepthStencil* cmd) {
-        glClearBufferfi(GL_DEPTH_STENCIL, 0, cmd->depth, cmd->stencil); CHECK_ERROR;
+        device.clearDepthStencil(cmd->depth, cmd->stencil);
+    }
+};
+
+/*
+ * Opens a profiler scope around the commands that follow it, ProfileBegin and
+ * ProfileEnd are never skipped so they can bracket passes of the render queue.
+ */
+struct ProfileBegin {
+    Command command;
+    const char* name;
+
+    static const uint32_t TYPE = PROFILE_BEGIN;
+
+    static void create(CommandBuffer* commandBuffer, const char* name) {
+        ProfileBegin* profileBegin = getCommand<ProfileBegin>(commandBuffer);
+        profileBegin->name = name;
+    }
+
+    static void submit(Device& device, ProfileBegin* cmd) {
+        if (active_profiler != nullptr)
+            active_profiler->beginScope(cmd->name);
+    }
+};
+
+struct ProfileEnd {
+    Command command;
+
+    static const uint32_t TYPE = PROFILE_END;
+
+    static void create(CommandBuffer* commandBuffer) {
+        getCommand<ProfileEnd>(commandBuffer);
+    }
+
+    static void submit(Device& device, ProfileEnd* cmd) {
+        if (active_profiler != nullptr)
+            active_profiler->endScope();
     }
 };
 
@@ -202,9 +242,7 @@ struct SetViewport {
 
     static void submit(Device& device, SetViewport* cmd) {
         int index = cmd->command.id - SET_VIEWPORT0;
-        Rect* viewport = cmd->viewport;
-
-        glViewportIndexedf(index, viewport->x, viewport->y, viewport->width, viewport->height);
+        device.setViewport(index, *cmd->viewport);
     }
 };
 
@@ -224,14 +262,7 @@ struct SetScissor {
 
     static void submit(Device& device, SetScissor* cmd) {
         int index = cmd->command.id - SET_SCISSOR0;
-        Rect* viewport = cmd->viewport;
-
-        if(cmd->enable) {
-            glEnable(GL_SCISSOR_TEST);
-            glScissorIndexed(index, viewport->x, viewport->y, viewport->width, viewport->height);
-        } else {
-            glEnable(GL_SCISSOR_TEST);
-        }
+        device.setScissor(index, cmd->enable, *cmd->viewport);
     }
 };
 
@@ -253,12 +284,7 @@ struct SetDepthTest {
     }
 
     static void submit(Device& device, SetDepthTest* cmd) {
-        if(cmd->enable) {
-            glEnable(GL_DEPTH_TEST);
-            glDepthFunc(cmd->function); CHECK_ERROR;
-        } else {
-            glDisable(GL_DEPTH_TEST);
-        }
+        device.setDepthTest(cmd->enable, cmd->function);
     }
 };
 
@@ -282,13 +308,7 @@ struct SetCullFace {
     }
 
     static void submit(Device& device, SetCullFace* cmd) {
-        if(cmd->enable) {
-            glEnable(GL_CULL_FACE);
-            glCullFace(cmd->cullFace); CHECK_ERROR;
-            glFrontFace(cmd->frontFace); CHECK_ERROR;
-        } else {
-            glDisable(GL_CULL_FACE);
-        }
+        device.setCullFace(cmd->enable, cmd->cullFace, cmd->frontFace);
     }
 };
 
@@ -326,13 +346,8 @@ struct SetBlend {
 
     static void submit(Device& device, SetBlend* cmd) {
         int index = cmd->command.id - SET_BLEND0;
-        if(cmd->enable) {
-            glEnablei(GL_BLEND, index);
-            glBlendEquationSeparatei(index, cmd->equationColor, cmd->equationAlpha); CHECK_ERROR;
-            glBlendFuncSeparatei(index, cmd->srcColor, cmd->dstColor, cmd->srcAlpha, cmd->dstAlpha); CHECK_ERROR;
-        } else {
-            glDisablei(GL_BLEND, index);
-        }
+        device.setBlend(index, cmd->enable, cmd->equationColor, cmd->srcColor, cmd->dstColor,
+                        cmd->equationAlpha, cmd->srcAlpha, cmd->dstAlpha);
     }
 };
 
@@ -348,27 +363,7 @@ struct SetDrawBuffers {
     }
 
     static void submit(Device& device, SetDrawBuffers* cmd) {
-        uint32_t mask = cmd->mask;
-
-        //todo find a way to change back to default draw buffer
-        if(mask == 0xffffffff) {
-            glDrawBuffer(GL_BACK_LEFT);
-            return;
-        }
-
-        int count = 0;
-        GLenum buffers[32] = {};
-
-        for (int i = 0; i < 32; i++) {
-            if (mask & (1 << i)) {
-                buffers[count] = GL_COLOR_ATTACHMENT0 + i;
-                count++;
-            }
-        }
-
-        if (count > 0) {
-            glDrawBuffers(count, buffers);
-        }
+        device.setDrawBuffers(cmd->mask);
     }
 };
 
@@ -406,7 +401,7 @@ struct BindConstantBuffer {
     }
 
     static void submit(Device& device, BindConstantBuffer* cmd) {
-        glBindBufferBase(GL_UNIFORM_BUFFER, cmd->bindingPoint, cmd->constantBuffer.id); CHECK_ERROR;
+        device.bindConstantBuffer(cmd->constantBuffer, cmd->bindingPoint);
     }
 };
 
@@ -485,17 +480,19 @@ struct DrawTriangles {
     Command command;
     int offset;
     int count;
+    int indexType;
 
     static const uint32_t TYPE = DRAW_TRIANGLES;
 
-    static void create(CommandBuffer* commandBuffer, int offset, int count) {
+    static void create(CommandBuffer* commandBuffer, int offset, int count, int indexType) {
         DrawTriangles* drawTriangles = getCommand<DrawTriangles>(commandBuffer);
         drawTriangles->offset = offset;
         drawTriangles->count = count;
+        drawTriangles->indexType = indexType;
     }
 
     static void submit(Device& device, DrawTriangles* cmd) {
-        device.drawTriangles(cmd->offset, cmd->count);
+        device.drawTriangles(cmd->offset, cmd->count, cmd->indexType);
     }
 };
 
@@ -503,19 +500,49 @@ struct DrawTrianglesInstanced {
     Command command;
     int offset;
     int count;
+    int indexType;
     int instances;
 
     static const uint32_t TYPE = DRAW_TRIANGLES_INSTANCED;
 
-    static void create(CommandBuffer* commandBuffer, int offset, int count, int instances) {
+    static void create(CommandBuffer* commandBuffer, int offset, int count, int indexType, int instances) {
         DrawTrianglesInstanced* drawTrianglesInstanced = getCommand<DrawTrianglesInstanced>(commandBuffer);
         drawTrianglesInstanced->offset = offset;
         drawTrianglesInstanced->count = count;
+        drawTrianglesInstanced->indexType = indexType;
         drawTrianglesInstanced->instances = instances;
     }
 
     static void submit(Device& device, DrawTrianglesInstanced* cmd) {
-        device.drawTrianglesInstanced(cmd->offset, cmd->count, cmd->instances);
+        device.drawTrianglesInstanced(cmd->offset, cmd->count, cmd->indexType, cmd->instances);
+    }
+};
+
+/*
+ * Index ranges read when the command executes, they must stay valid until the
+ * render queue is sent.
+ */
+struct DrawRanges {
+    int count;
+    int* offsets;
+    int* counts;
+};
+
+struct MultiDrawTriangles {
+    Command command;
+    int indexType;
+    const DrawRanges* ranges;
+
+    static const uint32_t TYPE = MULTI_DRAW_TRIANGLES;
+
+    static void create(CommandBuffer* commandBuffer, const DrawRanges* ranges, int indexType) {
+        MultiDrawTriangles* multiDrawTriangles = getCommand<MultiDrawTriangles>(commandBuffer);
+        multiDrawTriangles->indexType = indexType;
+        multiDrawTriangles->ranges = ranges;
+    }
+
+    static void submit(Device& device, MultiDrawTriangles* cmd) {
+        device.multiDrawTriangles(cmd->ranges->offsets, cmd->ranges->counts, cmd->ranges->count, cmd->indexType);
     }
 };
 
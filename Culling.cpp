@@ -0,0 +1,201 @@
+#include "Culling.h"
+
+#include <math.h>
+#include <float.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CULLING_SSE 1
+#else
+#define CULLING_SSE 0
+#endif
+
+void mnComputeBounds(const Vector3* vertices, const uint32_t* indices, int offset, int count,
+                     BoundingBox& box, BoundingSphere& sphere) {
+    for (int j = 0; j < 3; j++) {
+        box.min[j] = +FLT_MAX;
+        box.max[j] = -FLT_MAX;
+    }
+
+    if (count <= 0) {
+        for (int j = 0; j < 3; j++) {
+            box.min[j] = box.max[j] = 0;
+            sphere.center[j] = 0;
+        }
+
+        sphere.radius = 0;
+        return;
+    }
+
+    for (int i = offset; i < offset + count; i++) {
+        const Vector3& v = vertices[indices != nullptr ? indices[i] : i];
+
+        for (int j = 0; j < 3; j++) {
+            box.min[j] = v.values[j] < box.min[j] ? v.values[j] : box.min[j];
+            box.max[j] = v.values[j] > box.max[j] ? v.values[j] : box.max[j];
+        }
+    }
+
+    for (int j = 0; j < 3; j++)
+        sphere.center[j] = (box.min[j] + box.max[j]) * 0.5f;
+
+    //tighter than half the diagonal, the farthest vertex from the center
+    float radius2 = 0;
+
+    for (int i = offset; i < offset + count; i++) {
+        const Vector3& v = vertices[indices != nullptr ? indices[i] : i];
+
+        float dx = v.x - sphere.center[0];
+        float dy = v.y - sphere.center[1];
+        float dz = v.z - sphere.center[2];
+        float d2 = dx*dx + dy*dy + dz*dz;
+
+        radius2 = d2 > radius2 ? d2 : radius2;
+    }
+
+    sphere.radius = sqrtf(radius2);
+}
+
+void mnMergeBounds(const BoundingBox* boxes, const BoundingSphere* spheres, int count,
+                   BoundingBox& box, BoundingSphere& sphere) {
+    for (int j = 0; j < 3; j++) {
+        box.min[j] = count > 0 ? +FLT_MAX : 0;
+        box.max[j] = count > 0 ? -FLT_MAX : 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < 3; j++) {
+            box.min[j] = boxes[i].min[j] < box.min[j] ? boxes[i].min[j] : box.min[j];
+            box.max[j] = boxes[i].max[j] > box.max[j] ? boxes[i].max[j] : box.max[j];
+        }
+    }
+
+    for (int j = 0; j < 3; j++)
+        sphere.center[j] = (box.min[j] + box.max[j]) * 0.5f;
+
+    sphere.radius = 0;
+
+    for (int i = 0; i < count; i++) {
+        float dx = spheres[i].center[0] - sphere.center[0];
+        float dy = spheres[i].center[1] - sphere.center[1];
+        float dz = spheres[i].center[2] - sphere.center[2];
+        float radius = sqrtf(dx*dx + dy*dy + dz*dz) + spheres[i].radius;
+
+        sphere.radius = radius > sphere.radius ? radius : sphere.radius;
+    }
+}
+
+void mnTransformSphere(const BoundingSphere& sphere, const float matrix[16], BoundingSphere& out) {
+    const float* c = sphere.center;
+
+    float x = matrix[0]*c[0] + matrix[4]*c[1] + matrix[8]*c[2] + matrix[12];
+    float y = matrix[1]*c[0] + matrix[5]*c[1] + matrix[9]*c[2] + matrix[13];
+    float z = matrix[2]*c[0] + matrix[6]*c[1] + matrix[10]*c[2] + matrix[14];
+
+    float sx = matrix[0]*matrix[0] + matrix[1]*matrix[1] + matrix[2]*matrix[2];
+    float sy = matrix[4]*matrix[4] + matrix[5]*matrix[5] + matrix[6]*matrix[6];
+    float sz = matrix[8]*matrix[8] + matrix[9]*matrix[9] + matrix[10]*matrix[10];
+
+    float scale2 = sx > sy ? sx : sy;
+    scale2 = sz > scale2 ? sz : scale2;
+
+    out.center[0] = x;
+    out.center[1] = y;
+    out.center[2] = z;
+    out.radius = sphere.radius * sqrtf(scale2);
+}
+
+void mnExtractFrustum(const float projection[16], const float view[16], Frustum& frustum) {
+    float m[16];
+
+    //column major, m = projection * view
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            m[col*4 + row] = projection[0*4 + row] * view[col*4 + 0] +
+                             projection[1*4 + row] * view[col*4 + 1] +
+                             projection[2*4 + row] * view[col*4 + 2] +
+                             projection[3*4 + row] * view[col*4 + 3];
+        }
+    }
+
+    //-w <= x, y, z <= w, each plane is row 3 plus or minus row 0, 1 or 2
+    for (int i = 0; i < 6; i++) {
+        int row = i / 2;
+        float sign = (i % 2) == 0 ? +1.0f : -1.0f;
+
+        float a = m[3] + sign * m[row];
+        float b = m[7] + sign * m[4 + row];
+        float c = m[11] + sign * m[8 + row];
+        float d = m[15] + sign * m[12 + row];
+
+        float length = sqrtf(a*a + b*b + c*c);
+
+        if (length < 1e-6f) {
+            frustum.a[i] = frustum.b[i] = frustum.c[i] = 0;
+            frustum.d[i] = 1;
+            continue;
+        }
+
+        frustum.a[i] = a / length;
+        frustum.b[i] = b / length;
+        frustum.c[i] = c / length;
+        frustum.d[i] = d / length;
+    }
+}
+
+static bool mnIsSphereVisible(const Frustum& frustum, const BoundingSphere& sphere) {
+    for (int i = 0; i < 6; i++) {
+        float distance = frustum.a[i] * sphere.center[0] +
+                         frustum.b[i] * sphere.center[1] +
+                         frustum.c[i] * sphere.center[2] +
+                         frustum.d[i];
+
+        if (distance < -sphere.radius)
+            return false;
+    }
+
+    return true;
+}
+
+int mnCullSpheres(const Frustum& frustum, const BoundingSphere* spheres, int count, uint8_t* visible) {
+    int visibleCount = 0;
+    int i = 0;
+
+#if CULLING_SSE
+    static_assert(sizeof(BoundingSphere) == 4 * sizeof(float), "BoundingSphere must map to one SSE register");
+
+    for (; i + 4 <= count; i += 4) {
+        //four xyzr rows become x, y, z and r columns
+        __m128 x = _mm_loadu_ps(spheres[i + 0].center);
+        __m128 y = _mm_loadu_ps(spheres[i + 1].center);
+        __m128 z = _mm_loadu_ps(spheres[i + 2].center);
+        __m128 r = _mm_loadu_ps(spheres[i + 3].center);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), r);
+        __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(frustum.a[p])), _mm_mul_ps(y, _mm_set1_ps(frustum.b[p]))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(frustum.c[p])), _mm_set1_ps(frustum.d[p])));
+
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+
+        for (int j = 0; j < 4; j++) {
+            visible[i + j] = (uint8_t) ((mask >> j) & 1);
+            visibleCount += visible[i + j];
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        visible[i] = mnIsSphereVisible(frustum, spheres[i]) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+
+    return visibleCount;
+}
@@ -0,0 +1,62 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <stdint.h>
+
+#include "Vector.h"
+
+struct BoundingSphere {
+    float center[3];
+    float radius;
+};
+
+struct BoundingBox {
+    float min[3];
+    float max[3];
+};
+
+/*
+ * The six planes, left, right, bottom, top, near and far, as a*x + b*y + c*z + d,
+ * positive inside. Components are kept in separate arrays so a plane can be
+ * tested against four spheres at once.
+ */
+struct Frustum {
+    float a[6];
+    float b[6];
+    float c[6];
+    float d[6];
+};
+
+/*
+ * Bounds of the vertices referenced by indices[offset..offset+count), or of
+ * vertices[offset..offset+count) when indices is nullptr. The sphere is centered
+ * on the box.
+ */
+void mnComputeBounds(const Vector3* vertices, const uint32_t* indices, int offset, int count,
+                     BoundingBox& box, BoundingSphere& sphere);
+
+/*
+ * Sphere around every sphere in spheres, centered on the box.
+ */
+void mnMergeBounds(const BoundingBox* boxes, const BoundingSphere* spheres, int count,
+                   BoundingBox& box, BoundingSphere& sphere);
+
+/*
+ * The radius is scaled by the largest axis scale of matrix.
+ */
+void mnTransformSphere(const BoundingSphere& sphere, const float matrix[16], BoundingSphere& out);
+
+/*
+ * Planes of projection * view, for any projection mapping to the OpenGL clip
+ * cube. Degenerate planes (the far plane of an infinite projection) never cull.
+ */
+void mnExtractFrustum(const float projection[16], const float view[16], Frustum& frustum);
+
+/*
+ * visible[i] is set to 1 when spheres[i] is at least partially inside the
+ * frustum and 0 otherwise, returns how many are visible. Spheres are tested four
+ * at a time with SSE when available.
+ */
+int mnCullSpheres(const Frustum& frustum, const BoundingSphere* spheres, int count, uint8_t* visible);
+
+#endif //CULLING_H
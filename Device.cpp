@@ -3,44 +3,88 @@
 //
 
 #include "Device.h"
+#include "Profiler.h"
 
-void check_error(const char* file, int line) {
-    switch (glGetError()) {
-        case GL_NO_ERROR:
-            break;
+#include <string.h>
+#include <sys/stat.h>
+
+static const char* error_name(GLenum error) {
+    switch (error) {
         case GL_INVALID_ENUM:
-            printf("glError(GL_INVALID_ENUM) = %s:%d\n", file, line);
-            exit(EXIT_FAILURE);
-            break;
+            return "GL_INVALID_ENUM";
         case GL_INVALID_VALUE:
-            printf("glError(GL_INVALID_VALUE) = %s:%d\n", file, line);
-            exit(EXIT_FAILURE);
-            break;
+            return "GL_INVALID_VALUE";
         case GL_INVALID_OPERATION:
-            printf("glError(GL_INVALID_OPERATION) = %s:%d\n", file, line);
-            exit(EXIT_FAILURE);
-            break;
+            return "GL_INVALID_OPERATION";
         case GL_INVALID_FRAMEBUFFER_OPERATION:
-            printf("glError(GL_INVALID_FRAMEBUFFER_OPERATION) = %s:%d\n", file, line);
-            exit(EXIT_FAILURE);
-            break;
+            return "GL_INVALID_FRAMEBUFFER_OPERATION";
         case GL_OUT_OF_MEMORY:
-            printf("glError(GL_OUT_OF_MEMORY) = %s:%d\n", file, line);
-            exit(EXIT_FAILURE);
-            break;
+            return "GL_OUT_OF_MEMORY";
         case GL_STACK_UNDERFLOW:
-            printf("glError(GL_STACK_UNDERFLOW) = %s:%d\n", file, line);
-            exit(EXIT_FAILURE);
-            break;
+            return "GL_STACK_UNDERFLOW";
         case GL_STACK_OVERFLOW:
-            printf("glError(GL_STACK_OVERFLOW) = %s:%d\n", file, line);
-            exit(EXIT_FAILURE);
-            break;
+            return "GL_STACK_OVERFLOW";
         default:
-            break;
+            return nullptr;
     }
 }
 
+void check_error(const char* file, int line) {
+    GLenum error = glGetError();
+
+    if (error == GL_NO_ERROR)
+        return;
+
+    const char* name = error_name(error);
+
+    if (name == nullptr)
+        return;
+
+    printf("glError(%s) = %s:%d\n", name, file, line);
+    exit(EXIT_FAILURE);
+}
+
+static void APIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                    GLsizei length, const GLchar* message, const void* userParam) {
+    if (type == GL_DEBUG_TYPE_ERROR) {
+        printf("glDebug(%s) after %s:%d\n", message, error_check_file, error_check_line);
+        exit(EXIT_FAILURE);
+    }
+
+    if (severity == GL_DEBUG_SEVERITY_HIGH || severity == GL_DEBUG_SEVERITY_MEDIUM)
+        printf("glDebug(%s) after %s:%d\n", message, error_check_file, error_check_line);
+}
+
+static bool has_gl_version(int major, int minor) {
+    GLint contextMajor = 0;
+    GLint contextMinor = 0;
+
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+static ErrorCheckMode parse_error_check_mode(const char* value, ErrorCheckMode defaultMode) {
+    if (value == nullptr)
+        return defaultMode;
+
+    if (strcmp(value, "none") == 0)
+        return ERROR_CHECK_NONE;
+
+    if (strcmp(value, "frame") == 0)
+        return ERROR_CHECK_PER_FRAME;
+
+    if (strcmp(value, "call") == 0)
+        return ERROR_CHECK_PER_CALL;
+
+    if (strcmp(value, "debug") == 0)
+        return ERROR_CHECK_DEBUG_OUTPUT;
+
+    printf("Unknown GL_ERROR_CHECK mode '%s'\n", value);
+    return defaultMode;
+}
+
 Device::Device() {
     vertexBufferCount = 0;
     indexBufferCount = 0;
@@ -53,6 +97,34 @@ Device::Device() {
     fragmentProgramCount = 0;
     framebufferCount = 0;
     renderbufferCount = 0;
+    queryCount = 0;
+
+    uniformRing = 0;
+    uniformRingMapping = nullptr;
+    uniformRingAlignment = 0;
+    uniformRingHead = 0;
+    uniformRingRegion = 0;
+    frameCount = 0;
+
+    memset(uniformRingFences, 0, sizeof(uniformRingFences));
+    memset(constantBuffers, 0, sizeof(constantBuffers));
+
+    memset(textureUploads, 0, sizeof(textureUploads));
+    textureUploadNext = 0;
+
+    programCacheDirectory = nullptr;
+    memset(&programCacheStatistics, 0, sizeof(programCacheStatistics));
+
+    for (int i = 0; i < MAX_CONSTANT_BUFFER_BINDINGS; i++)
+        constantBufferBindings[i] = -1;
+
+    trace = nullptr;
+    callCount = 0;
+    nextHandle = 0;
+
+    resetStatistics();
+
+    setErrorCheckMode(parse_error_check_mode(getenv("GL_ERROR_CHECK"), ERROR_CHECK_PER_CALL));
 }
 
 Device::~Device() {
@@ -67,6 +139,7 @@ Device::~Device() {
     assert(fragmentProgramCount == 0);
     assert(framebufferCount == 0);
     assert(renderbufferCount == 0);
+    assert(queryCount == 0);
 }
 
 VertexBuffer Device::createDynamicVertexBuffer(size_t size, const void* data) {
@@ -115,18 +188,65 @@ IndexBuffer Device::createIndexBuffer(size_t size, const void* data) {
 }
 
 ConstantBuffer Device::createConstantBuffer(size_t size) {
-    GLuint cbo;
+    if (uniformRing == 0)
+        createUniformRing();
 
-    glGenBuffers(1, &cbo); CHECK_ERROR;
+    int index = 0;
+    while (index < MAX_CONSTANT_BUFFERS && constantBuffers[index].used)
+        index++;
 
-    glBindBuffer(GL_UNIFORM_BUFFER, cbo); CHECK_ERROR;
-    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW); CHECK_ERROR;
+    assert(index < MAX_CONSTANT_BUFFERS);
 
-    glBindBuffer(GL_UNIFORM_BUFFER, 0); CHECK_ERROR;
+    ConstantBufferSlot& slot = constantBuffers[index];
+
+    slot.used = true;
+    slot.parent = -1;
+    slot.viewOffset = 0;
+    slot.size = size;
+    slot.shadow = (uint8_t*) calloc(1, size);
+
+    uploadConstantBuffer(slot);
+
+    constantBufferCount++;
+
+    return {GLuint(index + 1)};
+}
+
+ConstantBuffer Device::createConstantBufferView(ConstantBuffer parent, size_t offset, size_t size) {
+    int parentIndex = parent.id - 1;
+    ConstantBufferSlot& parentSlot = constantBuffers[parentIndex];
+
+    assert(parentSlot.used && parentSlot.parent == -1);
+    assert(offset % getConstantBufferAlignment() == 0);
+    assert(offset + size <= parentSlot.size);
+
+    int index = 0;
+    while (index < MAX_CONSTANT_BUFFERS && constantBuffers[index].used)
+        index++;
+
+    assert(index < MAX_CONSTANT_BUFFERS);
+
+    ConstantBufferSlot& slot = constantBuffers[index];
+
+    slot.used = true;
+    slot.parent = parentIndex;
+    slot.viewOffset = offset;
+    slot.size = size;
+    slot.shadow = nullptr;
 
     constantBufferCount++;
 
-    return {cbo};
+    return {GLuint(index + 1)};
+}
+
+size_t Device::getConstantBufferAlignment() {
+    if (uniformRingAlignment == 0) {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment); CHECK_ERROR;
+        uniformRingAlignment = alignment > 0 ? alignment : 256;
+    }
+
+    return uniformRingAlignment;
 }
 
 void Device::setConstantBufferBindingPoint(Program program, const char* blockName, int bindingPoint) {
@@ -160,7 +280,7 @@ VertexArray Device::createVertexArray(const VertexDeclaration* vertexDeclaration
 
         if (vertexBuffer.id != 0) {
             glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.id); CHECK_ERROR;
-            glVertexAttribPointer(i, format.size, format.type, GL_FALSE, stride, offset); CHECK_ERROR;
+            glVertexAttribPointer(i, format.size, format.type, format.normalized, stride, offset); CHECK_ERROR;
             glEnableVertexAttribArray(i); CHECK_ERROR;
         } else {
             glDisableVertexAttribArray(i); CHECK_ERROR;
@@ -217,18 +337,53 @@ struct TextureBinder {
     }
 };
 
-Texture2D createTexture(uint32_t& textureCount, int internalFormat, int width, int height, int format, int type, const void* pixels) {
+Texture2D Device::createTexture(const TextureDescriptor& descriptor) {
     TextureBinder binder;
 
+    //immutable storage can't be empty (blank glyphs have no bitmap)
+    bool empty = descriptor.width == 0 || descriptor.height == 0;
+
+    int width = empty ? 1 : descriptor.width;
+    int height = empty ? 1 : descriptor.height;
+    int levels = descriptor.mipLevels > 0 ? descriptor.mipLevels : getMipLevels(width, height);
+
     GLuint texId;
     glGenTextures(1, &texId); CHECK_ERROR;
 
     glBindTexture(GL_TEXTURE_2D, texId); CHECK_ERROR;
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, pixels); CHECK_ERROR;
+
+    if (glTexStorage2D != nullptr && has_gl_version(4, 2)) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, descriptor.internalFormat, width, height); CHECK_ERROR;
+    } else {
+        //same layout as glTexStorage2D, every level is allocated up front
+        for (int i = 0; i < levels; i++) {
+            int w = width >> i > 0 ? width >> i : 1;
+            int h = height >> i > 0 ? height >> i : 1;
+
+            glTexImage2D(GL_TEXTURE_2D, i, descriptor.internalFormat, w, h, 0, descriptor.format, descriptor.type, nullptr); CHECK_ERROR;
+        }
+    }
+
+    if (descriptor.pixels != nullptr && !empty) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, descriptor.format, descriptor.type, descriptor.pixels); CHECK_ERROR;
+
+        if (descriptor.generateMips && levels > 1) {
+            glGenerateMipmap(GL_TEXTURE_2D); CHECK_ERROR;
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1); CHECK_ERROR;
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); CHECK_ERROR;
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); CHECK_ERROR;
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); CHECK_ERROR;
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); CHECK_ERROR;
+
+    if (levels == 1) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); CHECK_ERROR;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); CHECK_ERROR;
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); CHECK_ERROR;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); CHECK_ERROR;
+    }
 
     textureCount++;
 
@@ -284,43 +439,228 @@ TextureCube createTextureCube(uint32_t& textureCount, int internalFormat, int fo
 }
 
 Texture2D Device::createRGB16FTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGB16F, width, height, GL_RGB, GL_FLOAT, pixels);
+    return createTexture({width, height, GL_RGB16F, GL_RGB, GL_FLOAT, 1, false, pixels});
 }
 
 Texture2D Device::createRGBA16FTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGBA16F, width, height, GL_RGBA, GL_FLOAT, pixels);
+    return createTexture({width, height, GL_RGBA16F, GL_RGBA, GL_FLOAT, 1, false, pixels});
 }
 
 Texture2D Device::createRGB32FTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGB32F, width, height, GL_RGB, GL_FLOAT, pixels);
+    return createTexture({width, height, GL_RGB32F, GL_RGB, GL_FLOAT, 1, false, pixels});
 }
 
 Texture2D Device::createRGBA32FTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGBA32F, width, height, GL_RGBA, GL_FLOAT, pixels);
+    return createTexture({width, height, GL_RGBA32F, GL_RGBA, GL_FLOAT, 1, false, pixels});
 }
 
 Texture2D Device::createRGBATexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGBA, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    return createTexture({width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 1, false, pixels});
 }
 
 Texture2D Device::createRGBTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    return createTexture({width, height, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 1, false, pixels});
 }
 
 Texture2D Device::createRGBAFTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGBA, width, height, GL_RGBA, GL_FLOAT, pixels);
+    return createTexture({width, height, GL_RGBA8, GL_RGBA, GL_FLOAT, 1, false, pixels});
 }
 
 Texture2D Device::createRGBFTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RGB, width, height, GL_RGB, GL_FLOAT, pixels);
+    return createTexture({width, height, GL_RGB8, GL_RGB, GL_FLOAT, 1, false, pixels});
 }
 
 Texture2D Device::createRTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RED, width, height, GL_RED, GL_UNSIGNED_BYTE, pixels);
+    return createTexture({width, height, GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, false, pixels});
 }
 
 Texture2D Device::createRG32FTexture(int width, int height, const void* pixels) {
-    return createTexture(textureCount, GL_RG32F, width, height, GL_RGB, GL_FLOAT, pixels);
+    return createTexture({width, height, GL_RG32F, GL_RGB, GL_FLOAT, 1, false, pixels});
+}
+
+static int bytes_per_pixel(int format, int type) {
+    assert(type == GL_UNSIGNED_BYTE);
+
+    switch (format) {
+        case GL_RED:
+            return 1;
+        case GL_RG:
+            return 2;
+        case GL_RGB:
+            return 3;
+        case GL_RGBA:
+            return 4;
+        default:
+            assert(false);
+            return 0;
+    }
+}
+
+void Device::uploadTexture(Texture2D texture, const TextureDescriptor& descriptor) {
+    PROFILE_SCOPE("Device::uploadTexture");
+
+    assert(descriptor.pixels != nullptr);
+
+    int width = descriptor.width;
+    int height = descriptor.height;
+    int levels = descriptor.mipLevels > 0 ? descriptor.mipLevels : getMipLevels(width, height);
+    size_t size = width * height * bytes_per_pixel(descriptor.format, descriptor.type);
+
+    TextureUploadSlot& slot = textureUploads[textureUploadNext];
+    textureUploadNext = (textureUploadNext + 1) % TEXTURE_UPLOAD_SLOTS;
+
+    //every slot is in flight, the oldest has to finish first
+    if (slot.fence != 0)
+        finishTextureUpload(slot, true);
+
+    TextureBinder binder;
+
+    glBindTexture(GL_TEXTURE_2D, texture.id); CHECK_ERROR;
+
+    //the placeholder lives in the last mip until the upload completes
+    const uint8_t placeholder[] = {128, 128, 128, 255};
+
+    glTexSubImage2D(GL_TEXTURE_2D, levels - 1, 0, 0, 1, 1, descriptor.format, descriptor.type, placeholder); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1); CHECK_ERROR;
+
+    if (slot.buffer == 0) {
+        glGenBuffers(1, &slot.buffer); CHECK_ERROR;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer); CHECK_ERROR;
+
+    if (size > slot.capacity) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW); CHECK_ERROR;
+        slot.capacity = size;
+    }
+
+    void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT); CHECK_ERROR;
+    memcpy(ptr, descriptor.pixels, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); CHECK_ERROR;
+
+    //sources from the bound pixel buffer, the driver copies asynchronously
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, descriptor.format, descriptor.type, nullptr); CHECK_ERROR;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); CHECK_ERROR;
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); CHECK_ERROR;
+    slot.texture = texture;
+    slot.levels = levels;
+    slot.generateMips = descriptor.generateMips;
+}
+
+void Device::updateTextureLevel(Texture2D texture, const TextureDescriptor& descriptor, int level, const void* pixels) {
+    TextureBinder binder;
+
+    int width = descriptor.width >> level > 0 ? descriptor.width >> level : 1;
+    int height = descriptor.height >> level > 0 ? descriptor.height >> level : 1;
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment); CHECK_ERROR;
+
+    glBindTexture(GL_TEXTURE_2D, texture.id); CHECK_ERROR;
+
+    //the small levels have rows of any size
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); CHECK_ERROR;
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, descriptor.format, descriptor.type, pixels); CHECK_ERROR;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment); CHECK_ERROR;
+}
+
+Texture2D Device::createStreamingTexture(const TextureDescriptor& descriptor) {
+    TextureBinder binder;
+
+    int levels = descriptor.mipLevels > 0 ? descriptor.mipLevels : getMipLevels(descriptor.width, descriptor.height);
+
+    GLuint texId;
+    glGenTextures(1, &texId); CHECK_ERROR;
+
+    glBindTexture(GL_TEXTURE_2D, texId); CHECK_ERROR;
+
+    //mutable storage, glTexStorage2D would allocate every level for good
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); CHECK_ERROR;
+
+    textureCount++;
+
+    return {texId};
+}
+
+void Device::setTextureLevel(Texture2D texture, const TextureDescriptor& descriptor, int level, const void* pixels) {
+    TextureBinder binder;
+
+    //a released level is respecified empty, which gives its memory back
+    int width = 0;
+    int height = 0;
+
+    if (pixels != nullptr) {
+        width = descriptor.width >> level > 0 ? descriptor.width >> level : 1;
+        height = descriptor.height >> level > 0 ? descriptor.height >> level : 1;
+    }
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment); CHECK_ERROR;
+
+    glBindTexture(GL_TEXTURE_2D, texture.id); CHECK_ERROR;
+
+    //the small levels have rows of any size
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); CHECK_ERROR;
+    glTexImage2D(GL_TEXTURE_2D, level, descriptor.internalFormat, width, height, 0, descriptor.format, descriptor.type, pixels); CHECK_ERROR;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment); CHECK_ERROR;
+}
+
+void Device::setTextureBaseLevel(Texture2D texture, int level) {
+    TextureBinder binder;
+
+    glBindTexture(GL_TEXTURE_2D, texture.id); CHECK_ERROR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level); CHECK_ERROR;
+}
+
+bool Device::finishTextureUpload(TextureUploadSlot& slot, bool wait) {
+    GLenum status;
+
+    do {
+        status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+    } while (wait && status == GL_TIMEOUT_EXPIRED);
+
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    if (slot.texture.id != 0) {
+        TextureBinder binder;
+
+        glBindTexture(GL_TEXTURE_2D, slot.texture.id); CHECK_ERROR;
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0); CHECK_ERROR;
+
+        if (slot.generateMips && slot.levels > 1) {
+            glGenerateMipmap(GL_TEXTURE_2D); CHECK_ERROR;
+        }
+
+        slot.texture.id = 0;
+    }
+
+    return true;
+}
+
+void Device::destroyTextureUploads() {
+    for (int i = 0; i < TEXTURE_UPLOAD_SLOTS; i++) {
+        TextureUploadSlot& slot = textureUploads[i];
+
+        if (slot.fence != 0)
+            glDeleteSync(slot.fence);
+
+        if (slot.buffer != 0)
+            glDeleteBuffers(1, &slot.buffer);
+
+        memset(&slot, 0, sizeof(slot));
+    }
 }
 
 TextureCube Device::createRGBCubeTexture(const ImageCube cube[], int mipLevels) {
@@ -332,12 +672,12 @@ TextureCube Device::createRGBCubeTexture(const ImageCube& cube) {
 }
 
 DepthTexture Device::createDepth32FTexture(int width, int height) {
-    Texture2D texture = createTexture(textureCount, GL_DEPTH_COMPONENT32F, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    Texture2D texture = createTexture({width, height, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 1, false, nullptr});
     return {texture.id};
 }
 
 DepthStencilTexture Device::createDepth24Stencil8Texture(int width, int height) {
-    Texture2D texture = createTexture(textureCount, GL_DEPTH24_STENCIL8, width, height, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+    Texture2D texture = createTexture({width, height, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 1, false, nullptr});
     return {texture.id};
 }
 
@@ -389,7 +729,7 @@ SeparateProgram Device::createFragmentProgram(const char* commonSource, const ch
     return {program};
 }
 
-Program Device::createProgram(const char* commonSource, const char* vertexSource, const char* fragmentSource, const char* geometrySource) {
+static GLuint compile_program(const char* commonSource, const char* vertexSource, const char* fragmentSource, const char* geometrySource, bool retrievable) {
     GLint status;
 
     const char* geometrySource2[] = {
@@ -459,6 +799,9 @@ Program Device::createProgram(const char* commonSource, const char* vertexSource
     if(geometryShader != 0) {
         glAttachShader(program, geometryShader); CHECK_ERROR;
     }
+    if(retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); CHECK_ERROR;
+    }
     glLinkProgram(program); CHECK_ERROR;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
     if (!status) {
@@ -475,11 +818,162 @@ Program Device::createProgram(const char* commonSource, const char* vertexSource
         glDeleteShader(geometryShader);
     }
 
+    return program;
+}
+
+const uint32_t PROGRAM_CACHE_MAGIC = 0x4e494250; //PBIN
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t length;
+};
+
+static uint64_t hash_string(uint64_t hash, const char* str) {
+    //FNV-1a, the terminator is hashed so that the sources can't shift between stages
+    if (str == nullptr)
+        str = "";
+
+    do {
+        hash ^= (uint8_t) *str;
+        hash *= 1099511628211ull;
+    } while (*str++ != 0);
+
+    return hash;
+}
+
+static uint64_t program_cache_key(const char* commonSource, const char* vertexSource, const char* fragmentSource, const char* geometrySource) {
+    uint64_t hash = 14695981039346656037ull;
+
+    hash = hash_string(hash, (const char*) glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char*) glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char*) glGetString(GL_VERSION));
+    hash = hash_string(hash, commonSource);
+    hash = hash_string(hash, vertexSource);
+    hash = hash_string(hash, fragmentSource);
+    hash = hash_string(hash, geometrySource);
+
+    return hash;
+}
+
+static GLuint load_program_binary(const char* filename, uint64_t key) {
+    FILE* file = fopen(filename, "rb");
+
+    if (file == nullptr)
+        return 0;
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    ProgramCacheHeader header;
+    GLuint program = 0;
+
+    //a truncated or corrupted cache must not drive the allocation
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == PROGRAM_CACHE_MAGIC && header.version == PROGRAM_CACHE_VERSION && header.key == key &&
+        header.length > 0 && header.length <= (uint64_t) fileSize - sizeof(header)) {
+        void* binary = malloc(header.length);
+
+        if (fread(binary, header.length, 1, file) == 1) {
+            program = glCreateProgram(); CHECK_ERROR;
+
+            //a driver update may reject the binary with GL_INVALID_ENUM, only that error is consumed
+            glProgramBinary(program, header.binaryFormat, binary, header.length);
+            GLenum error = glGetError();
+
+            GLint status = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &status); CHECK_ERROR;
+
+            if (error != GL_NO_ERROR || !status) {
+                glDeleteProgram(program); CHECK_ERROR;
+                program = 0;
+            }
+        }
+
+        free(binary);
+    }
+
+    fclose(file);
+
+    return program;
+}
+
+static void save_program_binary(const char* filename, uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length); CHECK_ERROR;
+
+    if (length <= 0)
+        return;
+
+    void* binary = malloc(length);
+
+    GLenum binaryFormat;
+    glGetProgramBinary(program, length, nullptr, &binaryFormat, binary); CHECK_ERROR;
+
+    FILE* file = fopen(filename, "wb");
+
+    if (file != nullptr) {
+        ProgramCacheHeader header = {PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, binaryFormat, (uint32_t) length};
+
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(binary, length, 1, file);
+        fclose(file);
+    }
+
+    free(binary);
+}
+
+Program Device::createProgram(const char* commonSource, const char* vertexSource, const char* fragmentSource, const char* geometrySource) {
+    double start = glfwGetTime();
+
+    GLuint program = 0;
+    char filename[1024];
+    uint64_t key = 0;
+
+    if (programCacheDirectory != nullptr) {
+        key = program_cache_key(commonSource, vertexSource, fragmentSource, geometrySource);
+        snprintf(filename, sizeof(filename), "%s/%016llx.bin", programCacheDirectory, (unsigned long long) key);
+
+        program = load_program_binary(filename, key);
+    }
+
+    if (program != 0) {
+        programCacheStatistics.hits++;
+        programCacheStatistics.loadTime += glfwGetTime() - start;
+    } else {
+        program = compile_program(commonSource, vertexSource, fragmentSource, geometrySource, programCacheDirectory != nullptr);
+
+        if (programCacheDirectory != nullptr)
+            save_program_binary(filename, key, program);
+
+        programCacheStatistics.misses++;
+        programCacheStatistics.compileTime += glfwGetTime() - start;
+    }
+
     programCount++;
 
     return {program};
 }
 
+void Device::setProgramCache(const char* directory) {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats); CHECK_ERROR;
+
+    if (directory != nullptr && formats == 0) {
+        printf("Program binaries are not supported by the driver, cache disabled\n");
+        directory = nullptr;
+    }
+
+    if (directory != nullptr)
+        mkdir(directory, 0755);
+
+    programCacheDirectory = directory;
+}
+
 Framebuffer Device::createFramebuffer() {
     GLuint id;
 
@@ -503,14 +997,32 @@ Renderbuffer Device::createRenderbuffer(int width, int height) {
     return {id};
 }
 
+Query Device::createTimestampQuery() {
+    GLuint id;
+
+    glGenQueries(1, &id); CHECK_ERROR;
+
+    queryCount++;
+
+    return {id};
+}
+
 //////////////////////////////////////////////////
 
 void Device::destroyTexture(Texture2D texture) {
     if (texture.id == 0) return;
 
+    for (int i = 0; i < TEXTURE_UPLOAD_SLOTS; i++) {
+        if (textureUploads[i].texture.id == texture.id)
+            textureUploads[i].texture.id = 0;
+    }
+
     glDeleteTextures(1, &texture.id);
 
     textureCount--;
+
+    if (textureCount == 0)
+        destroyTextureUploads();
 }
 
 void Device::destroyTexture(TextureCube texture) {
@@ -556,9 +1068,27 @@ void Device::destroyIndexBuffer(IndexBuffer indexBuffer) {
 void Device::destroyConstantBuffer(ConstantBuffer constantBuffer) {
     if (constantBuffer.id == 0) return;
 
-    glDeleteBuffers(1, &constantBuffer.id);
+    int index = constantBuffer.id - 1;
+    ConstantBufferSlot& slot = constantBuffers[index];
+
+    assert(slot.used);
+
+    free(slot.shadow);
+
+    if (slot.overflow != 0)
+        glDeleteBuffers(1, &slot.overflow);
+
+    memset(&slot, 0, sizeof(slot));
+
+    for (int i = 0; i < MAX_CONSTANT_BUFFER_BINDINGS; i++) {
+        if (constantBufferBindings[i] == index)
+            constantBufferBindings[i] = -1;
+    }
 
     constantBufferCount--;
+
+    if (constantBufferCount == 0)
+        destroyUniformRing();
 }
 
 void Device::destroyVertexArray(VertexArray vertexArray) {
@@ -593,6 +1123,14 @@ void Device::destroyFramebuffer(Framebuffer framebuffer) {
     framebufferCount--;
 }
 
+void Device::destroyQuery(Query query) {
+    if (query.id == 0) return;
+
+    glDeleteQueries(1, &query.id);
+
+    queryCount--;
+}
+
 //////////////////////////////////////////////////
 
 void Device::bindTextureToFramebuffer(Framebuffer framebuffer, Texture2D texture, int index) {
@@ -621,6 +1159,8 @@ void Device::bindRenderbufferToFramebuffer(Framebuffer framebuffer, Renderbuffer
 
 void Device::bindFramebuffer(Framebuffer framebuffer) {
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_FRAMEBUFFER);
 }
 
 void Device::bindReadFramebuffer(Framebuffer framebuffer) {
@@ -629,6 +1169,8 @@ void Device::bindReadFramebuffer(Framebuffer framebuffer) {
 
 void Device::bindDrawFramebuffer(Framebuffer framebuffer) {
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.id); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_FRAMEBUFFER);
 }
 
 void Device::setRenderTarget(Framebuffer framebuffer, int targets[], int count) {
@@ -654,25 +1196,169 @@ bool Device::isFramebufferComplete(Framebuffer framebuffer) {
 
 void Device::bindVertexArray(VertexArray vertexArray) {
     glBindVertexArray(vertexArray.id); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_VERTEX_ARRAY);
 }
 
 void Device::bindProgram(Program program) {
     glUseProgram(program.id); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_PROGRAM);
 }
 
 void Device::copyConstantBuffer(ConstantBuffer constantBuffer, const void* data, size_t size) {
-    glBindBuffer(GL_UNIFORM_BUFFER, constantBuffer.id); CHECK_ERROR;
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data); CHECK_ERROR;
+    ConstantBufferSlot& slot = constantBuffers[constantBuffer.id - 1];
+
+    assert(slot.used && size <= slot.size);
+
+    //a view writes into its parent and uploads the whole parent
+    int storageIndex = slot.parent == -1 ? constantBuffer.id - 1 : slot.parent;
+    ConstantBufferSlot& storage = constantBuffers[storageIndex];
+
+    memcpy(storage.shadow + slot.viewOffset, data, size);
+
+    uploadConstantBuffer(storage);
+
+    //draws recorded after this point must see the new slice
+    for (int i = 0; i < MAX_CONSTANT_BUFFER_BINDINGS; i++) {
+        int bound = constantBufferBindings[i];
+
+        if (bound == -1)
+            continue;
+
+        ConstantBufferSlot& boundSlot = constantBuffers[bound];
+
+        if (bound == storageIndex || boundSlot.parent == storageIndex) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, i, storage.buffer, storage.offset + boundSlot.viewOffset, boundSlot.size); CHECK_ERROR;
+        }
+    }
+}
+
+void Device::bindConstantBuffer(ConstantBuffer constantBuffer, int bindingPoint) {
+    assert(bindingPoint >= 0 && bindingPoint < MAX_CONSTANT_BUFFER_BINDINGS);
+
+    if (constantBuffer.id == 0) {
+        glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, 0); CHECK_ERROR;
+        constantBufferBindings[bindingPoint] = -1;
+    } else {
+        int index = constantBuffer.id - 1;
+        ConstantBufferSlot& slot = constantBuffers[index];
+
+        assert(slot.used);
+
+        ConstantBufferSlot& storage = slot.parent == -1 ? slot : constantBuffers[slot.parent];
+
+        //the region of an earlier frame is overwritten once its fence signals, even
+        //if later frames still read from it, so each frame binds its own slice
+        if (storage.frame != frameCount)
+            uploadConstantBuffer(storage);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, storage.buffer, storage.offset + slot.viewOffset, slot.size); CHECK_ERROR;
+        constantBufferBindings[bindingPoint] = index;
+    }
+
+    countStateChange(STATE_CHANGE_CONSTANT_BUFFER);
+}
+
+void Device::createUniformRing() {
+    getConstantBufferAlignment();
+
+    bool bufferStorage = glBufferStorage != nullptr && has_gl_version(4, 4);
+
+    size_t size = FRAMES_IN_FLIGHT * UNIFORM_RING_FRAME_SIZE;
+
+    glGenBuffers(1, &uniformRing); CHECK_ERROR;
+    glBindBuffer(GL_UNIFORM_BUFFER, uniformRing); CHECK_ERROR;
+
+    if (bufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags); CHECK_ERROR;
+        uniformRingMapping = (uint8_t*) glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags); CHECK_ERROR;
+    } else {
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW); CHECK_ERROR;
+        uniformRingMapping = nullptr;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0); CHECK_ERROR;
+
+    uniformRingHead = 0;
+}
+
+void Device::destroyUniformRing() {
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        if (uniformRingFences[i] != 0) {
+            glDeleteSync(uniformRingFences[i]);
+            uniformRingFences[i] = 0;
+        }
+    }
+
+    if (uniformRingMapping != nullptr) {
+        glBindBuffer(GL_UNIFORM_BUFFER, uniformRing);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        uniformRingMapping = nullptr;
+    }
+
+    glDeleteBuffers(1, &uniformRing);
+    uniformRing = 0;
+}
+
+void Device::uploadConstantBuffer(ConstantBufferSlot& slot) {
+    size_t size = (slot.size + uniformRingAlignment - 1) / uniformRingAlignment * uniformRingAlignment;
+
+    //synchronous from here on, the driver renames the buffer if the GPU still reads it
+    if (uniformRingHead + size > UNIFORM_RING_FRAME_SIZE) {
+        if (slot.overflow == 0) {
+            glGenBuffers(1, &slot.overflow); CHECK_ERROR;
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, slot.overflow); CHECK_ERROR;
+        glBufferData(GL_UNIFORM_BUFFER, slot.size, slot.shadow, GL_STREAM_DRAW); CHECK_ERROR;
+        glBindBuffer(GL_UNIFORM_BUFFER, 0); CHECK_ERROR;
+
+        slot.buffer = slot.overflow;
+        slot.offset = 0;
+        slot.frame = frameCount;
+        return;
+    }
+
+    size_t offset = uniformRingRegion * UNIFORM_RING_FRAME_SIZE + uniformRingHead;
+
+    if (uniformRingMapping != nullptr) {
+        memcpy(uniformRingMapping + offset, slot.shadow, slot.size);
+    } else {
+        //the fences guarantee the GPU is done with this region
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, uniformRing); CHECK_ERROR;
+        void* ptr = glMapBufferRange(GL_UNIFORM_BUFFER, offset, slot.size, access); CHECK_ERROR;
+        memcpy(ptr, slot.shadow, slot.size);
+        glUnmapBuffer(GL_UNIFORM_BUFFER); CHECK_ERROR;
+        glBindBuffer(GL_UNIFORM_BUFFER, 0); CHECK_ERROR;
+    }
+
+    uniformRingHead += size;
+
+    slot.buffer = uniformRing;
+    slot.offset = offset;
+    slot.frame = frameCount;
+
+    statistics.constantBufferBytesUploaded += slot.size;
 }
 
 void Device::bindTexture(Texture2D texture, int unit) {
     glActiveTexture(GL_TEXTURE0 + unit); CHECK_ERROR;
     glBindTexture(GL_TEXTURE_2D, texture.id); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_TEXTURE);
 }
 
 void Device::bindTexture(TextureCube texture, int unit) {
     glActiveTexture(GL_TEXTURE0 + unit); CHECK_ERROR;
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture.id); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_TEXTURE);
 }
 
 //TODO remove this method
@@ -685,30 +1371,259 @@ void Device::setValue(Program program, const char* name, float x, float y, float
 
 void Device::bindSampler(Sampler sampler, int unit) {
     glBindSampler(unit, sampler.id); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_SAMPLER);
 }
 
-void Device::drawTriangles(int offset, int count) {
-    void* _offset = (void*) (offset * sizeof(uint16_t));
+static size_t getIndexSize(int indexType) {
+    assert(indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT);
 
-    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, _offset); CHECK_ERROR;
+    return indexType == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
 }
 
-void Device::drawTrianglesInstanced(int offset, int count, int instance) {
-    void* _offset = (void*) (offset * sizeof(uint16_t));
+void Device::drawTriangles(int offset, int count, int indexType) {
+    void* _offset = (void*) (offset * getIndexSize(indexType));
+
+    glDrawElements(GL_TRIANGLES, count, indexType, _offset); CHECK_ERROR;
 
-    glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, _offset, instance); CHECK_ERROR;
+    countDraw(GL_TRIANGLES, count, 1);
+}
+
+void Device::drawTrianglesInstanced(int offset, int count, int indexType, int instance) {
+    void* _offset = (void*) (offset * getIndexSize(indexType));
+
+    glDrawElementsInstanced(GL_TRIANGLES, count, indexType, _offset, instance); CHECK_ERROR;
+
+    countDraw(GL_TRIANGLES, count, instance);
+}
+
+void Device::multiDrawTriangles(const int* offsets, const int* counts, int drawCount, int indexType) {
+    const int batchSize = 64;
+
+    size_t indexSize = getIndexSize(indexType);
+    int total = 0;
+
+    for (int i = 0; i < drawCount; i += batchSize) {
+        int batch = drawCount - i < batchSize ? drawCount - i : batchSize;
+        GLsizei _counts[batchSize];
+        const void* _offsets[batchSize];
+
+        for (int j = 0; j < batch; j++) {
+            _counts[j] = counts[i + j];
+            _offsets[j] = (const void*) (offsets[i + j] * indexSize);
+            total += counts[i + j];
+        }
+
+        glMultiDrawElements(GL_TRIANGLES, _counts, indexType, _offsets, batch); CHECK_ERROR;
+    }
+
+    countDraw(GL_TRIANGLES, total, 1);
 }
 
 void Device::drawArrays(int type, int first, int count) {
     glDrawArrays(type, first, count); CHECK_ERROR;
+
+    countDraw(type, count, 1);
 }
 
 void Device::drawArraysInstanced(int type, int first, int count, int instance) {
     glDrawArraysInstanced(type, first, count, instance); CHECK_ERROR;
+
+    countDraw(type, count, instance);
 }
 
 void Device::updateVertexBuffer(VertexBuffer vertexBuffer, size_t offset, size_t size, const void* data) {
     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.id); CHECK_ERROR;
     glBufferSubData(GL_ARRAY_BUFFER, offset, size, data); CHECK_ERROR;
     glBindBuffer(GL_ARRAY_BUFFER, 0); CHECK_ERROR;
+
+    statistics.vertexBufferBytesUploaded += size;
+}
+
+void Device::clearColor(int index, const float color[4]) {
+    glClearBufferfv(GL_COLOR, index, color); CHECK_ERROR;
+}
+
+void Device::clearDepthStencil(float depth, int stencil) {
+    glClearBufferfi(GL_DEPTH_STENCIL, 0, depth, stencil); CHECK_ERROR;
+}
+
+void Device::setViewport(int index, const Rect& viewport) {
+    glViewportIndexedf(index, viewport.x, viewport.y, viewport.width, viewport.height); CHECK_ERROR;
+
+    countStateChange(STATE_CHANGE_VIEWPORT);
+}
+
+void Device::setScissor(int index, bool enable, const Rect& viewport) {
+    if (enable) {
+        glEnablei(GL_SCISSOR_TEST, index); CHECK_ERROR;
+        glScissorIndexed(index, viewport.x, viewport.y, viewport.width, viewport.height); CHECK_ERROR;
+    } else {
+        glDisablei(GL_SCISSOR_TEST, index); CHECK_ERROR;
+    }
+
+    countStateChange(STATE_CHANGE_RASTERIZER);
+}
+
+void Device::setDepthTest(bool enable, int function) {
+    if (enable) {
+        glEnable(GL_DEPTH_TEST); CHECK_ERROR;
+        glDepthFunc(function); CHECK_ERROR;
+    } else {
+        glDisable(GL_DEPTH_TEST); CHECK_ERROR;
+    }
+
+    countStateChange(STATE_CHANGE_DEPTH_STENCIL);
+}
+
+void Device::setCullFace(bool enable, int cullFace, int frontFace) {
+    if (enable) {
+        glEnable(GL_CULL_FACE); CHECK_ERROR;
+        glCullFace(cullFace); CHECK_ERROR;
+        glFrontFace(frontFace); CHECK_ERROR;
+    } else {
+        glDisable(GL_CULL_FACE); CHECK_ERROR;
+    }
+
+    countStateChange(STATE_CHANGE_RASTERIZER);
+}
+
+void Device::setBlend(int index, bool enable, int equationColor, int srcColor, int dstColor, int equationAlpha, int srcAlpha, int dstAlpha) {
+    if (enable) {
+        glEnablei(GL_BLEND, index); CHECK_ERROR;
+        glBlendEquationSeparatei(index, equationColor, equationAlpha); CHECK_ERROR;
+        glBlendFuncSeparatei(index, srcColor, dstColor, srcAlpha, dstAlpha); CHECK_ERROR;
+    } else {
+        glDisablei(GL_BLEND, index); CHECK_ERROR;
+    }
+
+    countStateChange(STATE_CHANGE_BLEND);
+}
+
+void Device::setDrawBuffers(uint32_t mask) {
+    countStateChange(STATE_CHANGE_DRAWBUFFERS);
+
+    //todo find a way to change back to default draw buffer
+    if (mask == 0xffffffff) {
+        glDrawBuffer(GL_BACK_LEFT); CHECK_ERROR;
+        return;
+    }
+
+    int count = 0;
+    GLenum buffers[32] = {};
+
+    for (int i = 0; i < 32; i++) {
+        if (mask & (1 << i)) {
+            buffers[count] = GL_COLOR_ATTACHMENT0 + i;
+            count++;
+        }
+    }
+
+    if (count > 0) {
+        glDrawBuffers(count, buffers); CHECK_ERROR;
+    }
+}
+
+void Device::setUnpackAlignment(int alignment) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment); CHECK_ERROR;
+}
+
+void Device::getFramebufferSize(int& width, int& height) {
+    GLFWwindow* window = glfwGetCurrentContext();
+    glfwGetFramebufferSize(window, &width, &height);
+}
+
+void Device::queryTimestamp(Query query) {
+    glQueryCounter(query.id, GL_TIMESTAMP); CHECK_ERROR;
+}
+
+bool Device::getQueryResult(Query query, uint64_t& result) {
+    GLint available = 0;
+
+    glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available); CHECK_ERROR;
+
+    if (!available)
+        return false;
+
+    GLuint64 value = 0;
+    glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &value); CHECK_ERROR;
+
+    result = value;
+    return true;
+}
+
+//////////////////////////////////////////////////
+
+void Device::setErrorCheckMode(ErrorCheckMode mode) {
+    bool debugOutput = false;
+
+    if (mode == ERROR_CHECK_DEBUG_OUTPUT) {
+        GLint flags = 0;
+        glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+
+        debugOutput = glDebugMessageCallback != nullptr && (flags & GL_CONTEXT_FLAG_DEBUG_BIT) != 0;
+
+        if (!debugOutput) {
+            printf("KHR_debug is not available, checking errors once per frame\n");
+            mode = ERROR_CHECK_PER_FRAME;
+        }
+    }
+
+    if (glDebugMessageCallback != nullptr) {
+        if (debugOutput) {
+            glEnable(GL_DEBUG_OUTPUT);
+            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+            glDebugMessageCallback(debug_callback, nullptr);
+            glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+        } else if (error_check_mode == ERROR_CHECK_DEBUG_OUTPUT) {
+            glDisable(GL_DEBUG_OUTPUT);
+            glDebugMessageCallback(nullptr, nullptr);
+        }
+    }
+
+    //drop anything raised before the switch
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    error_check_mode = mode;
+}
+
+void Device::endFrame() {
+    if (error_check_mode == ERROR_CHECK_PER_FRAME) {
+        GLenum error = glGetError();
+        const char* name = error_name(error);
+
+        if (name != nullptr) {
+            printf("glError(%s) in frame after %s:%d\n", name, error_check_file, error_check_line);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    frameCount++;
+
+    for (int i = 0; i < TEXTURE_UPLOAD_SLOTS; i++) {
+        if (textureUploads[i].fence != 0)
+            finishTextureUpload(textureUploads[i], false);
+    }
+
+    if (uniformRing == 0)
+        return;
+
+    uniformRingFences[uniformRingRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); CHECK_ERROR;
+
+    uniformRingRegion = (uniformRingRegion + 1) % FRAMES_IN_FLIGHT;
+    uniformRingHead = 0;
+
+    GLsync fence = uniformRingFences[uniformRingRegion];
+
+    if (fence != 0) {
+        GLenum status;
+
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(fence);
+        uniformRingFences[uniformRingRegion] = 0;
+    }
 }
@@ -12,9 +12,45 @@
 #include <stdlib.h>
 #include <assert.h>
 
+/*
+ * Build with -DGL_ERROR_CHECKING=0 to compile CHECK_ERROR out entirely,
+ * otherwise the strategy is selected at run time with Device::setErrorCheckMode
+ * or the GL_ERROR_CHECK environment variable (none, frame, call or debug).
+ */
+#ifndef GL_ERROR_CHECKING
+#define GL_ERROR_CHECKING 1
+#endif
+
+enum ErrorCheckMode {
+    ERROR_CHECK_NONE,
+    ERROR_CHECK_PER_FRAME,    //glGetError once in Device::endFrame
+    ERROR_CHECK_PER_CALL,     //glGetError after every CHECK_ERROR
+    ERROR_CHECK_DEBUG_OUTPUT, //KHR_debug callback, no polling
+};
+
+extern ErrorCheckMode error_check_mode;
+extern thread_local const char* error_check_file;
+extern thread_local int error_check_line;
+
 void check_error(const char* file, int line);
 
-#define CHECK_ERROR check_error(__FILE__, __LINE__)
+#if GL_ERROR_CHECKING
+/*
+ * Outside of per call mode only the call site is recorded, so errors found later
+ * can be reported as happening after the last checkpoint.
+ */
+#define CHECK_ERROR \
+    do { \
+        if (error_check_mode == ERROR_CHECK_PER_CALL) { \
+            check_error(__FILE__, __LINE__); \
+        } else { \
+            error_check_file = __FILE__; \
+            error_check_line = __LINE__; \
+        } \
+    } while (0)
+#else
+#define CHECK_ERROR do { } while (0)
+#endif
 
 struct Sampler {
     GLuint id;
@@ -70,6 +106,10 @@ struct Renderbuffer {
     GLuint id;
 };
 
+struct Query {
+    GLuint id;
+};
+
 struct Rect {
     float x;
     float y;
@@ -77,15 +117,30 @@ struct Rect {
     float height;
 };
 
+/*
+ * Normalized integer formats reach the shader as floats in [0, 1] (unsigned) or
+ * [-1, 1] (signed), the other formats are converted without scaling.
+ */
 struct VertexFormat {
-    uint32_t size : 16;
+    uint32_t size : 8;
+    uint32_t normalized : 8;
     uint32_t type : 16;
 };
 
-const VertexFormat VertexFloat1 = {1, GL_FLOAT};
-const VertexFormat VertexFloat2 = {2, GL_FLOAT};
-const VertexFormat VertexFloat3 = {3, GL_FLOAT};
-const VertexFormat VertexFloat4 = {4, GL_FLOAT};
+const VertexFormat VertexFloat1 = {1, GL_FALSE, GL_FLOAT};
+const VertexFormat VertexFloat2 = {2, GL_FALSE, GL_FLOAT};
+const VertexFormat VertexFloat3 = {3, GL_FALSE, GL_FLOAT};
+const VertexFormat VertexFloat4 = {4, GL_FALSE, GL_FLOAT};
+const VertexFormat VertexHalf2 = {2, GL_FALSE, GL_HALF_FLOAT};
+const VertexFormat VertexHalf4 = {4, GL_FALSE, GL_HALF_FLOAT};
+const VertexFormat VertexUNorm8x4 = {4, GL_TRUE, GL_UNSIGNED_BYTE};
+const VertexFormat VertexSNorm8x4 = {4, GL_TRUE, GL_BYTE};
+const VertexFormat VertexUNorm16x2 = {2, GL_TRUE, GL_UNSIGNED_SHORT};
+const VertexFormat VertexSNorm16x2 = {2, GL_TRUE, GL_SHORT};
+const VertexFormat VertexSNorm16x4 = {4, GL_TRUE, GL_SHORT};
+
+//xyz in 10 bits each and w in 2 bits, packed in a single uint32_t
+const VertexFormat VertexSNorm1010102 = {4, GL_TRUE, GL_INT_2_10_10_10_REV};
 
 const int POSITIVE_X = 0;
 const int NEGATIVE_X = 1;
@@ -112,6 +167,91 @@ struct ImageCube {
     Image faces[6];
 };
 
+/*
+ * internalFormat must be a sized format (GL_RGBA8, GL_RGBA16F, ...), format and
+ * type describe the pixels passed in. mipLevels = 0 allocates the full chain.
+ */
+struct TextureDescriptor {
+    int width;
+    int height;
+    int internalFormat;
+    int format;
+    int type;
+    int mipLevels;
+    bool generateMips;
+    const void* pixels;
+};
+
+enum StateChangeType {
+    STATE_CHANGE_PROGRAM,
+    STATE_CHANGE_VERTEX_ARRAY,
+    STATE_CHANGE_FRAMEBUFFER,
+    STATE_CHANGE_TEXTURE,
+    STATE_CHANGE_SAMPLER,
+    STATE_CHANGE_CONSTANT_BUFFER,
+    STATE_CHANGE_VIEWPORT,
+    STATE_CHANGE_DEPTH_STENCIL,
+    STATE_CHANGE_RASTERIZER,
+    STATE_CHANGE_BLEND,
+    STATE_CHANGE_DRAWBUFFERS,
+    STATE_CHANGE_MAX
+};
+
+/*
+ * Constant buffers live in a single streaming ring, every copy writes a fresh
+ * slice in the region of the current frame. A region is reused only after the
+ * fence inserted when it was filled has been signaled, so a frame reads only the
+ * slices written in it. When the region of a frame runs out the slices go to a
+ * buffer of their own instead, respecified for every copy.
+ */
+const int FRAMES_IN_FLIGHT = 3;
+const size_t UNIFORM_RING_FRAME_SIZE = 1024 * 1024;
+const int MAX_CONSTANT_BUFFERS = 256;
+const int MAX_CONSTANT_BUFFER_BINDINGS = 16;
+
+struct ConstantBufferSlot {
+    bool used;
+    int parent;        //-1 unless the slot is a view on another constant buffer
+    size_t viewOffset; //offset of the view inside the parent
+    size_t size;
+    size_t offset;   //slice in the ring written by the last copy
+    uint64_t frame;  //frame of the last copy
+    GLuint buffer;   //uniformRing, or overflow when the region of the frame ran out
+    GLuint overflow; //created the first time the region runs out
+    uint8_t* shadow; //last contents, re-uploaded when the slice is recycled
+};
+
+/*
+ * Texture uploads are staged through a small ring of pixel buffer objects, a slot
+ * is reused once the fence placed after its copy has been signaled.
+ */
+const int TEXTURE_UPLOAD_SLOTS = 4;
+
+struct TextureUploadSlot {
+    GLuint buffer;
+    size_t capacity;
+    GLsync fence;
+    Texture2D texture;
+    int levels;
+    bool generateMips;
+};
+
+struct ProgramCacheStatistics {
+    uint32_t hits;
+    uint32_t misses;
+    double loadTime;    //seconds spent in createProgram for hits
+    double compileTime; //seconds spent in createProgram for misses
+};
+
+struct DeviceStatistics {
+    uint32_t drawCalls;
+    uint32_t instancedDrawCalls;
+    uint64_t trianglesSubmitted;
+    uint32_t stateChanges[STATE_CHANGE_MAX];
+    uint64_t constantBufferBytesUploaded;
+    uint64_t vertexBufferBytesUploaded;
+};
+
 class Device {
 public:
     Device();
@@ -126,6 +266,14 @@ public:
 
     ConstantBuffer createConstantBuffer(size_t size);
 
+    /*
+     * A view binds a sub range of its parent, updating the parent uploads every
+     * view at once. The offset must be a multiple of getConstantBufferAlignment().
+     */
+    ConstantBuffer createConstantBufferView(ConstantBuffer parent, size_t offset, size_t size);
+
+    size_t getConstantBufferAlignment();
+
     void setConstantBufferBindingPoint(Program program, const char* blockName, int bindingPoint);
 
     void setTextureBindingPoint(Program program, const char* name, int bindingPoint);
@@ -134,6 +282,41 @@ public:
 
     Sampler createSampler(int minFilter, int magFilter, int mipFilter = GL_NONE);
 
+    Texture2D createTexture(const TextureDescriptor& descriptor);
+
+    static int getMipLevels(int width, int height);
+
+    /*
+     * Copies level 0 through the pixel buffer ring and returns without waiting for
+     * the GPU. Until the copy completes the texture samples a 1x1 grey placeholder
+     * stored in its last mip. The texture must have been created without pixels
+     * and descriptor.pixels can be released as soon as this returns.
+     */
+    void uploadTexture(Texture2D texture, const TextureDescriptor& descriptor);
+
+    /*
+     * Copies the pixels of one level of a texture made by createTexture, right
+     * away and without the pixel buffer ring. Its storage is kept.
+     */
+    void updateTextureLevel(Texture2D texture, const TextureDescriptor& descriptor, int level, const void* pixels);
+
+    /*
+     * Unlike createTexture no level takes memory until it is set, so the finest
+     * levels of a streaming texture can come and go. Nothing is sampled before the
+     * base level is set, descriptor.pixels is ignored.
+     */
+    Texture2D createStreamingTexture(const TextureDescriptor& descriptor);
+
+    /*
+     * Copies the pixels of a level, with nullptr the level is released instead.
+     */
+    void setTextureLevel(Texture2D texture, const TextureDescriptor& descriptor, int level, const void* pixels);
+
+    /*
+     * Sampling starts from this level, every level from it down to 1x1 must be set.
+     */
+    void setTextureBaseLevel(Texture2D texture, int level);
+
     Texture2D createRGB16FTexture(int width, int height, const void* pixels);
 
     Texture2D createRGBA16FTexture(int width, int height, const void* pixels);
@@ -168,10 +351,21 @@ public:
 
     Program createProgram(const char* commonSource, const char* vertexSource, const char* fragmentSource, const char* geometrySource = nullptr);
 
+    /*
+     * Programs created afterwards are stored in directory as driver binaries, keyed
+     * by the sources and the driver strings. Stale or rejected binaries are compiled
+     * again and replaced.
+     */
+    void setProgramCache(const char* directory);
+
+    const ProgramCacheStatistics& getProgramCacheStatistics();
+
     Framebuffer createFramebuffer();
 
     Renderbuffer createRenderbuffer(int width, int height);
 
+    Query createTimestampQuery();
+
     //////////////////////////////////////////////////
 
     void destroyTexture(Texture2D texture);
@@ -196,6 +390,8 @@ public:
 
     void destroyFramebuffer(Framebuffer framebuffer);
 
+    void destroyQuery(Query query);
+
     //////////////////////////////////////////////////
 
     void bindTextureToFramebuffer(Framebuffer framebuffer, Texture2D texture, int index);
@@ -222,6 +418,8 @@ public:
 
     void copyConstantBuffer(ConstantBuffer constantBuffer, const void* data, size_t size);
 
+    void bindConstantBuffer(ConstantBuffer constantBuffer, int bindingPoint);
+
     void bindTexture(Texture2D texture, int unit);
 
     void bindTexture(TextureCube texture, int unit);
@@ -231,16 +429,131 @@ public:
 
     void bindSampler(Sampler sampler, int unit);
 
-    void drawTriangles(int offset, int count);
+    /*
+     * offset and count are in indices, indexType is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+     */
+    void drawTriangles(int offset, int count, int indexType);
+
+    void drawTrianglesInstanced(int offset, int count, int indexType, int instance);
 
-    void drawTrianglesInstanced(int offset, int count, int instance);
+    /*
+     * drawCount index ranges in a single call, counted as one draw.
+     */
+    void multiDrawTriangles(const int* offsets, const int* counts, int drawCount, int indexType);
 
     void drawArrays(int type, int first, int count);
 
     void drawArraysInstanced(int type, int first, int count, int instance);
 
     void updateVertexBuffer(VertexBuffer vertexBuffer, size_t offset, size_t size, const void* data);
+
+    void clearColor(int index, const float color[4]);
+
+    void clearDepthStencil(float depth, int stencil);
+
+    void setViewport(int index, const Rect& viewport);
+
+    void setScissor(int index, bool enable, const Rect& viewport);
+
+    void setDepthTest(bool enable, int function);
+
+    void setCullFace(bool enable, int cullFace, int frontFace);
+
+    void setBlend(int index, bool enable, int equationColor, int srcColor, int dstColor, int equationAlpha, int srcAlpha, int dstAlpha);
+
+    /*
+     * Bit i enables GL_COLOR_ATTACHMENTi, 0xffffffff selects the default back buffer.
+     */
+    void setDrawBuffers(uint32_t mask);
+
+    void setUnpackAlignment(int alignment);
+
+    void getFramebufferSize(int& width, int& height);
+
+    /*
+     * Records the GPU time once every command issued before it has completed.
+     */
+    void queryTimestamp(Query query);
+
+    /*
+     * Never blocks, returns false while the result is not available. Times are
+     * in nanoseconds.
+     */
+    bool getQueryResult(Query query, uint64_t& result);
+
+    //////////////////////////////////////////////////
+
+    /*
+     * ERROR_CHECK_DEBUG_OUTPUT needs a debug context exposing KHR_debug,
+     * it falls back to ERROR_CHECK_PER_FRAME otherwise.
+     */
+    void setErrorCheckMode(ErrorCheckMode mode);
+
+    ErrorCheckMode getErrorCheckMode();
+
+    /*
+     * Must be called once per frame, it fences the uniform ring region written
+     * in this frame and moves to the next one.
+     */
+    void endFrame();
+
+    //////////////////////////////////////////////////
+
+    void countStateChange(StateChangeType type);
+
+    const DeviceStatistics& getStatistics();
+
+    void resetStatistics();
+
+    //////////////////////////////////////////////////
+
+    /*
+     * The null backend (DeviceNull.cpp) writes one line per call to stream, the
+     * OpenGL backend ignores it. Pass nullptr to stop recording.
+     */
+    void setTrace(FILE* stream);
+
+    /*
+     * Calls made on the null backend, always 0 with the OpenGL backend.
+     */
+    uint64_t getCallCount();
 private:
+    void countDraw(int type, int count, int instances);
+
+    void createUniformRing();
+
+    void destroyUniformRing();
+
+    void uploadConstantBuffer(ConstantBufferSlot& slot);
+
+    bool finishTextureUpload(TextureUploadSlot& slot, bool wait);
+
+    void destroyTextureUploads();
+
+    GLuint uniformRing;
+    uint8_t* uniformRingMapping;
+    size_t uniformRingAlignment;
+    size_t uniformRingHead;
+    int uniformRingRegion;
+    GLsync uniformRingFences[FRAMES_IN_FLIGHT];
+    uint64_t frameCount;
+
+    ConstantBufferSlot constantBuffers[MAX_CONSTANT_BUFFERS];
+    int constantBufferBindings[MAX_CONSTANT_BUFFER_BINDINGS];
+
+    TextureUploadSlot textureUploads[TEXTURE_UPLOAD_SLOTS];
+    int textureUploadNext;
+
+    const char* programCacheDirectory;
+    ProgramCacheStatistics programCacheStatistics;
+
+    DeviceStatistics statistics;
+
+    FILE* trace;
+
+    uint64_t callCount;
+    GLuint nextHandle; //null backend only
+
     uint32_t vertexBufferCount;
     uint32_t indexBufferCount;
     uint32_t constantBufferCount;
@@ -252,6 +565,7 @@ private:
     uint32_t fragmentProgramCount;
     uint32_t framebufferCount;
     uint32_t renderbufferCount;
+    uint32_t queryCount;
 };
 
 #endif //DEVICE_H_H
@@ -0,0 +1,76 @@
+#include "Device.h"
+
+#include <string.h>
+
+/*
+ * Members shared by every backend, Device.cpp talks to OpenGL and DeviceNull.cpp
+ * only counts and records calls.
+ */
+
+ErrorCheckMode error_check_mode = ERROR_CHECK_PER_CALL;
+//per thread, so a checkpoint never reports the call site of another thread
+thread_local const char* error_check_file = "";
+thread_local int error_check_line = 0;
+
+int Device::getMipLevels(int width, int height) {
+    int levels = 1;
+
+    while (width > 1 || height > 1) {
+        width /= 2;
+        height /= 2;
+        levels++;
+    }
+
+    return levels;
+}
+
+const ProgramCacheStatistics& Device::getProgramCacheStatistics() {
+    return programCacheStatistics;
+}
+
+ErrorCheckMode Device::getErrorCheckMode() {
+    return error_check_mode;
+}
+
+void Device::countStateChange(StateChangeType type) {
+    statistics.stateChanges[type]++;
+}
+
+const DeviceStatistics& Device::getStatistics() {
+    return statistics;
+}
+
+void Device::resetStatistics() {
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+void Device::countDraw(int type, int count, int instances) {
+    if (instances > 1)
+        statistics.instancedDrawCalls++;
+    else
+        statistics.drawCalls++;
+
+    int triangles = 0;
+
+    switch (type) {
+    case GL_TRIANGLES:
+        triangles = count / 3;
+        break;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+        triangles = count > 2 ? count - 2 : 0;
+        break;
+    default:
+        break;
+    }
+
+    statistics.trianglesSubmitted += (uint64_t) triangles * instances;
+}
+
+void Device::setTrace(FILE* stream) {
+    trace = stream;
+}
+
+uint64_t Device::getCallCount() {
+    return callCount;
+}
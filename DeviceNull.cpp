@@ -0,0 +1,727 @@
+#include "Device.h"
+
+#include <string.h>
+#include <stdarg.h>
+
+/*
+ * Headless backend, link it instead of Device.cpp to measure the submission path
+ * without a driver. Every call is counted and, when a trace stream is set, written
+ * as one line: the call name followed by its arguments. Handles are sequential
+ * and never reused, so a trace can be diffed between runs.
+ */
+
+const size_t NULL_CONSTANT_BUFFER_ALIGNMENT = 256;
+const int NULL_FRAMEBUFFER_WIDTH = 1280;
+const int NULL_FRAMEBUFFER_HEIGHT = 720;
+
+static void record(FILE* trace, uint64_t& callCount, const char* format, ...) {
+    callCount++;
+
+    if (trace == nullptr)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(trace, format, args);
+    va_end(args);
+
+    fputc('\n', trace);
+}
+
+void check_error(const char* file, int line) {
+}
+
+Device::Device() {
+    vertexBufferCount = 0;
+    indexBufferCount = 0;
+    constantBufferCount = 0;
+    vertexArrayCount = 0;
+    textureCount = 0;
+    samplerCount = 0;
+    programCount = 0;
+    vertexProgramCount = 0;
+    fragmentProgramCount = 0;
+    framebufferCount = 0;
+    renderbufferCount = 0;
+    queryCount = 0;
+
+    uniformRing = 0;
+    uniformRingMapping = nullptr;
+    uniformRingAlignment = NULL_CONSTANT_BUFFER_ALIGNMENT;
+    uniformRingHead = 0;
+    uniformRingRegion = 0;
+    frameCount = 0;
+
+    memset(uniformRingFences, 0, sizeof(uniformRingFences));
+    memset(constantBuffers, 0, sizeof(constantBuffers));
+
+    memset(textureUploads, 0, sizeof(textureUploads));
+    textureUploadNext = 0;
+
+    programCacheDirectory = nullptr;
+    memset(&programCacheStatistics, 0, sizeof(programCacheStatistics));
+
+    for (int i = 0; i < MAX_CONSTANT_BUFFER_BINDINGS; i++)
+        constantBufferBindings[i] = -1;
+
+    trace = nullptr;
+    callCount = 0;
+    nextHandle = 0;
+
+    resetStatistics();
+
+    error_check_mode = ERROR_CHECK_NONE;
+}
+
+Device::~Device() {
+    assert(vertexBufferCount == 0);
+    assert(indexBufferCount == 0);
+    assert(constantBufferCount == 0);
+    assert(vertexArrayCount == 0);
+    assert(textureCount == 0);
+    assert(samplerCount == 0);
+    assert(programCount == 0);
+    assert(vertexProgramCount == 0);
+    assert(fragmentProgramCount == 0);
+    assert(framebufferCount == 0);
+    assert(renderbufferCount == 0);
+    assert(queryCount == 0);
+}
+
+VertexBuffer Device::createDynamicVertexBuffer(size_t size, const void* data) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createDynamicVertexBuffer %u %zu", id, size);
+
+    vertexBufferCount++;
+
+    return {id};
+}
+
+VertexBuffer Device::createStaticVertexBuffer(size_t size, const void* data) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createStaticVertexBuffer %u %zu", id, size);
+
+    vertexBufferCount++;
+
+    return {id};
+}
+
+IndexBuffer Device::createIndexBuffer(size_t size, const void* data) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createIndexBuffer %u %zu", id, size);
+
+    indexBufferCount++;
+
+    return {id};
+}
+
+ConstantBuffer Device::createConstantBuffer(size_t size) {
+    int index = 0;
+    while (index < MAX_CONSTANT_BUFFERS && constantBuffers[index].used)
+        index++;
+
+    assert(index < MAX_CONSTANT_BUFFERS);
+
+    ConstantBufferSlot& slot = constantBuffers[index];
+
+    slot.used = true;
+    slot.parent = -1;
+    slot.viewOffset = 0;
+    slot.size = size;
+    slot.shadow = nullptr;
+
+    record(trace, callCount, "createConstantBuffer %d %zu", index + 1, size);
+
+    constantBufferCount++;
+
+    return {GLuint(index + 1)};
+}
+
+ConstantBuffer Device::createConstantBufferView(ConstantBuffer parent, size_t offset, size_t size) {
+    int parentIndex = parent.id - 1;
+    ConstantBufferSlot& parentSlot = constantBuffers[parentIndex];
+
+    assert(parentSlot.used && parentSlot.parent == -1);
+    assert(offset % getConstantBufferAlignment() == 0);
+    assert(offset + size <= parentSlot.size);
+
+    int index = 0;
+    while (index < MAX_CONSTANT_BUFFERS && constantBuffers[index].used)
+        index++;
+
+    assert(index < MAX_CONSTANT_BUFFERS);
+
+    ConstantBufferSlot& slot = constantBuffers[index];
+
+    slot.used = true;
+    slot.parent = parentIndex;
+    slot.viewOffset = offset;
+    slot.size = size;
+    slot.shadow = nullptr;
+
+    record(trace, callCount, "createConstantBufferView %d %u %zu %zu", index + 1, parent.id, offset, size);
+
+    constantBufferCount++;
+
+    return {GLuint(index + 1)};
+}
+
+size_t Device::getConstantBufferAlignment() {
+    return uniformRingAlignment;
+}
+
+void Device::setConstantBufferBindingPoint(Program program, const char* blockName, int bindingPoint) {
+    record(trace, callCount, "setConstantBufferBindingPoint %u %s %d", program.id, blockName, bindingPoint);
+}
+
+void Device::setTextureBindingPoint(Program program, const char* name, int bindingPoint) {
+    record(trace, callCount, "setTextureBindingPoint %u %s %d", program.id, name, bindingPoint);
+}
+
+VertexArray Device::createVertexArray(const VertexDeclaration* vertexDeclarations, int size,
+                                      IndexBuffer indexBuffer) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createVertexArray %u %d %u", id, size, indexBuffer.id);
+
+    vertexArrayCount++;
+
+    return {id};
+}
+
+Sampler Device::createSampler(int minFilter, int magFilter, int mipFilter) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createSampler %u 0x%x 0x%x 0x%x", id, minFilter, magFilter, mipFilter);
+
+    samplerCount++;
+
+    return {id};
+}
+
+Texture2D Device::createTexture(const TextureDescriptor& descriptor) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createTexture %u %d %d 0x%x %d", id, descriptor.width, descriptor.height,
+           descriptor.internalFormat, descriptor.mipLevels);
+
+    textureCount++;
+
+    return {id};
+}
+
+void Device::uploadTexture(Texture2D texture, const TextureDescriptor& descriptor) {
+    record(trace, callCount, "uploadTexture %u %d %d", texture.id, descriptor.width, descriptor.height);
+}
+
+Texture2D Device::createStreamingTexture(const TextureDescriptor& descriptor) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createStreamingTexture %u %d %d 0x%x", id, descriptor.width, descriptor.height,
+           descriptor.internalFormat);
+
+    textureCount++;
+
+    return {id};
+}
+
+void Device::updateTextureLevel(Texture2D texture, const TextureDescriptor& descriptor, int level, const void* pixels) {
+    record(trace, callCount, "updateTextureLevel %u %d", texture.id, level);
+}
+
+void Device::setTextureLevel(Texture2D texture, const TextureDescriptor& descriptor, int level, const void* pixels) {
+    record(trace, callCount, "setTextureLevel %u %d %s", texture.id, level, pixels != nullptr ? "set" : "release");
+}
+
+void Device::setTextureBaseLevel(Texture2D texture, int level) {
+    record(trace, callCount, "setTextureBaseLevel %u %d", texture.id, level);
+}
+
+bool Device::finishTextureUpload(TextureUploadSlot& slot, bool wait) {
+    return true;
+}
+
+void Device::destroyTextureUploads() {
+}
+
+static Texture2D create_texture(Device& device, int width, int height, int internalFormat, const void* pixels) {
+    TextureDescriptor descriptor = {width, height, internalFormat, GL_NONE, GL_NONE, 1, false, pixels};
+
+    return device.createTexture(descriptor);
+}
+
+Texture2D Device::createRGB16FTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGB16F, pixels);
+}
+
+Texture2D Device::createRGBA16FTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGBA16F, pixels);
+}
+
+Texture2D Device::createRGB32FTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGB32F, pixels);
+}
+
+Texture2D Device::createRGBA32FTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGBA32F, pixels);
+}
+
+Texture2D Device::createRGBATexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGBA8, pixels);
+}
+
+Texture2D Device::createRGBTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGB8, pixels);
+}
+
+Texture2D Device::createRGBAFTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGBA32F, pixels);
+}
+
+Texture2D Device::createRGBFTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RGB32F, pixels);
+}
+
+Texture2D Device::createRTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_R8, pixels);
+}
+
+Texture2D Device::createRG32FTexture(int width, int height, const void* pixels) {
+    return create_texture(*this, width, height, GL_RG32F, pixels);
+}
+
+TextureCube Device::createRGBCubeTexture(const ImageCube cube[], int mipLevels) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createRGBCubeTexture %u %d", id, mipLevels);
+
+    textureCount++;
+
+    return {id};
+}
+
+TextureCube Device::createRGBCubeTexture(const ImageCube& cube) {
+    return createRGBCubeTexture(&cube, 1);
+}
+
+DepthTexture Device::createDepth32FTexture(int width, int height) {
+    DepthTexture texture;
+    texture.texture = create_texture(*this, width, height, GL_DEPTH_COMPONENT32F, nullptr);
+    return texture;
+}
+
+DepthStencilTexture Device::createDepth24Stencil8Texture(int width, int height) {
+    DepthStencilTexture texture;
+    texture.texture = create_texture(*this, width, height, GL_DEPTH24_STENCIL8, nullptr);
+    return texture;
+}
+
+SeparateProgram Device::createVertexProgram(const char* commonSource, const char* source) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createVertexProgram %u", id);
+
+    vertexProgramCount++;
+
+    return {id};
+}
+
+SeparateProgram Device::createFragmentProgram(const char* commonSource, const char* source) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createFragmentProgram %u", id);
+
+    fragmentProgramCount++;
+
+    return {id};
+}
+
+Program Device::createProgram(const char* commonSource, const char* vertexSource, const char* fragmentSource, const char* geometrySource) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createProgram %u %d", id, geometrySource != nullptr);
+
+    programCount++;
+
+    return {id};
+}
+
+void Device::setProgramCache(const char* directory) {
+    record(trace, callCount, "setProgramCache %s", directory);
+}
+
+Framebuffer Device::createFramebuffer() {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createFramebuffer %u", id);
+
+    framebufferCount++;
+
+    return {id};
+}
+
+Renderbuffer Device::createRenderbuffer(int width, int height) {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createRenderbuffer %u %d %d", id, width, height);
+
+    renderbufferCount++;
+
+    return {id};
+}
+
+Query Device::createTimestampQuery() {
+    GLuint id = ++nextHandle;
+
+    record(trace, callCount, "createTimestampQuery %u", id);
+
+    queryCount++;
+
+    return {id};
+}
+
+//////////////////////////////////////////////////
+
+void Device::destroyTexture(Texture2D texture) {
+    if (texture.id == 0) return;
+
+    record(trace, callCount, "destroyTexture %u", texture.id);
+
+    textureCount--;
+}
+
+void Device::destroyTexture(TextureCube texture) {
+    if (texture.id == 0) return;
+
+    record(trace, callCount, "destroyTexture %u", texture.id);
+
+    textureCount--;
+}
+
+void Device::destroyTexture(DepthStencilTexture texture) {
+    destroyTexture(texture.texture);
+}
+
+void Device::destroySampler(Sampler sampler) {
+    if (sampler.id == 0) return;
+
+    record(trace, callCount, "destroySampler %u", sampler.id);
+
+    samplerCount--;
+}
+
+void Device::destroyVertexBuffer(VertexBuffer vertexBuffer) {
+    if (vertexBuffer.id == 0) return;
+
+    record(trace, callCount, "destroyVertexBuffer %u", vertexBuffer.id);
+
+    vertexBufferCount--;
+}
+
+void Device::destroyIndexBuffer(IndexBuffer indexBuffer) {
+    if (indexBuffer.id == 0) return;
+
+    record(trace, callCount, "destroyIndexBuffer %u", indexBuffer.id);
+
+    indexBufferCount--;
+}
+
+void Device::destroyConstantBuffer(ConstantBuffer constantBuffer) {
+    if (constantBuffer.id == 0) return;
+
+    int index = constantBuffer.id - 1;
+    ConstantBufferSlot& slot = constantBuffers[index];
+
+    assert(slot.used);
+
+    memset(&slot, 0, sizeof(slot));
+
+    for (int i = 0; i < MAX_CONSTANT_BUFFER_BINDINGS; i++) {
+        if (constantBufferBindings[i] == index)
+            constantBufferBindings[i] = -1;
+    }
+
+    record(trace, callCount, "destroyConstantBuffer %u", constantBuffer.id);
+
+    constantBufferCount--;
+}
+
+void Device::destroyVertexArray(VertexArray vertexArray) {
+    if (vertexArray.id == 0) return;
+
+    record(trace, callCount, "destroyVertexArray %u", vertexArray.id);
+
+    vertexArrayCount--;
+}
+
+void Device::destroyProgram(Program program) {
+    if (program.id == 0) return;
+
+    record(trace, callCount, "destroyProgram %u", program.id);
+
+    programCount--;
+}
+
+void Device::destroyRenderbuffer(Renderbuffer renderbuffer) {
+    if (renderbuffer.id == 0) return;
+
+    record(trace, callCount, "destroyRenderbuffer %u", renderbuffer.id);
+
+    renderbufferCount--;
+}
+
+void Device::destroyFramebuffer(Framebuffer framebuffer) {
+    if (framebuffer.id == 0) return;
+
+    record(trace, callCount, "destroyFramebuffer %u", framebuffer.id);
+
+    framebufferCount--;
+}
+
+void Device::destroyQuery(Query query) {
+    if (query.id == 0) return;
+
+    record(trace, callCount, "destroyQuery %u", query.id);
+
+    queryCount--;
+}
+
+//////////////////////////////////////////////////
+
+void Device::bindTextureToFramebuffer(Framebuffer framebuffer, Texture2D texture, int index) {
+    record(trace, callCount, "bindTextureToFramebuffer %u %u %d", framebuffer.id, texture.id, index);
+}
+
+void Device::bindDepthTextureToFramebuffer(Framebuffer framebuffer, DepthTexture texture) {
+    record(trace, callCount, "bindDepthTextureToFramebuffer %u %u", framebuffer.id, texture.id);
+}
+
+void Device::bindDepthStencilTextureToFramebuffer(Framebuffer framebuffer, DepthStencilTexture texture) {
+    record(trace, callCount, "bindDepthStencilTextureToFramebuffer %u %u", framebuffer.id, texture.id);
+}
+
+void Device::bindRenderbufferToFramebuffer(Framebuffer framebuffer, Renderbuffer renderbuffer) {
+    record(trace, callCount, "bindRenderbufferToFramebuffer %u %u", framebuffer.id, renderbuffer.id);
+}
+
+void Device::bindFramebuffer(Framebuffer framebuffer) {
+    record(trace, callCount, "bindFramebuffer %u", framebuffer.id);
+
+    countStateChange(STATE_CHANGE_FRAMEBUFFER);
+}
+
+void Device::bindReadFramebuffer(Framebuffer framebuffer) {
+    record(trace, callCount, "bindReadFramebuffer %u", framebuffer.id);
+}
+
+void Device::bindDrawFramebuffer(Framebuffer framebuffer) {
+    record(trace, callCount, "bindDrawFramebuffer %u", framebuffer.id);
+
+    countStateChange(STATE_CHANGE_FRAMEBUFFER);
+}
+
+void Device::setRenderTarget(Framebuffer framebuffer, int targets[], int count) {
+    record(trace, callCount, "setRenderTarget %u %d", framebuffer.id, count);
+}
+
+bool Device::isFramebufferComplete(Framebuffer framebuffer) {
+    record(trace, callCount, "isFramebufferComplete %u", framebuffer.id);
+
+    return true;
+}
+
+void Device::bindVertexArray(VertexArray vertexArray) {
+    record(trace, callCount, "bindVertexArray %u", vertexArray.id);
+
+    countStateChange(STATE_CHANGE_VERTEX_ARRAY);
+}
+
+void Device::bindProgram(Program program) {
+    record(trace, callCount, "bindProgram %u", program.id);
+
+    countStateChange(STATE_CHANGE_PROGRAM);
+}
+
+void Device::copyConstantBuffer(ConstantBuffer constantBuffer, const void* data, size_t size) {
+    ConstantBufferSlot& slot = constantBuffers[constantBuffer.id - 1];
+
+    assert(slot.used && size <= slot.size);
+
+    record(trace, callCount, "copyConstantBuffer %u %zu", constantBuffer.id, size);
+
+    //the OpenGL backend always uploads the whole parent
+    ConstantBufferSlot& storage = slot.parent == -1 ? slot : constantBuffers[slot.parent];
+
+    statistics.constantBufferBytesUploaded += storage.size;
+}
+
+void Device::bindConstantBuffer(ConstantBuffer constantBuffer, int bindingPoint) {
+    assert(bindingPoint >= 0 && bindingPoint < MAX_CONSTANT_BUFFER_BINDINGS);
+
+    record(trace, callCount, "bindConstantBuffer %u %d", constantBuffer.id, bindingPoint);
+
+    constantBufferBindings[bindingPoint] = constantBuffer.id - 1;
+
+    countStateChange(STATE_CHANGE_CONSTANT_BUFFER);
+}
+
+void Device::createUniformRing() {
+}
+
+void Device::destroyUniformRing() {
+}
+
+void Device::uploadConstantBuffer(ConstantBufferSlot& slot) {
+}
+
+void Device::bindTexture(Texture2D texture, int unit) {
+    record(trace, callCount, "bindTexture %u %d", texture.id, unit);
+
+    countStateChange(STATE_CHANGE_TEXTURE);
+}
+
+void Device::bindTexture(TextureCube texture, int unit) {
+    record(trace, callCount, "bindTexture %u %d", texture.id, unit);
+
+    countStateChange(STATE_CHANGE_TEXTURE);
+}
+
+//TODO remove this method
+void Device::setValue(Program program, const char* name, float x, float y, float z) {
+    record(trace, callCount, "setValue %u %s %g %g %g", program.id, name, x, y, z);
+}
+
+void Device::bindSampler(Sampler sampler, int unit) {
+    record(trace, callCount, "bindSampler %u %d", sampler.id, unit);
+
+    countStateChange(STATE_CHANGE_SAMPLER);
+}
+
+void Device::drawTriangles(int offset, int count, int indexType) {
+    assert(indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT);
+
+    record(trace, callCount, "drawTriangles %d %d %s", offset, count, indexType == GL_UNSIGNED_INT ? "u32" : "u16");
+
+    countDraw(GL_TRIANGLES, count, 1);
+}
+
+void Device::drawTrianglesInstanced(int offset, int count, int indexType, int instance) {
+    assert(indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT);
+
+    record(trace, callCount, "drawTrianglesInstanced %d %d %s %d", offset, count,
+           indexType == GL_UNSIGNED_INT ? "u32" : "u16", instance);
+
+    countDraw(GL_TRIANGLES, count, instance);
+}
+
+void Device::multiDrawTriangles(const int* offsets, const int* counts, int drawCount, int indexType) {
+    assert(indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT);
+
+    int total = 0;
+
+    for (int i = 0; i < drawCount; i++)
+        total += counts[i];
+
+    record(trace, callCount, "multiDrawTriangles %d %d %s", drawCount, total,
+           indexType == GL_UNSIGNED_INT ? "u32" : "u16");
+
+    countDraw(GL_TRIANGLES, total, 1);
+}
+
+void Device::drawArrays(int type, int first, int count) {
+    record(trace, callCount, "drawArrays 0x%x %d %d", type, first, count);
+
+    countDraw(type, count, 1);
+}
+
+void Device::drawArraysInstanced(int type, int first, int count, int instance) {
+    record(trace, callCount, "drawArraysInstanced 0x%x %d %d %d", type, first, count, instance);
+
+    countDraw(type, count, instance);
+}
+
+void Device::updateVertexBuffer(VertexBuffer vertexBuffer, size_t offset, size_t size, const void* data) {
+    record(trace, callCount, "updateVertexBuffer %u %zu %zu", vertexBuffer.id, offset, size);
+
+    statistics.vertexBufferBytesUploaded += size;
+}
+
+void Device::clearColor(int index, const float color[4]) {
+    record(trace, callCount, "clearColor %d %g %g %g %g", index, color[0], color[1], color[2], color[3]);
+}
+
+void Device::clearDepthStencil(float depth, int stencil) {
+    record(trace, callCount, "clearDepthStencil %g %d", depth, stencil);
+}
+
+void Device::setViewport(int index, const Rect& viewport) {
+    record(trace, callCount, "setViewport %d %g %g %g %g", index, viewport.x, viewport.y, viewport.width, viewport.height);
+
+    countStateChange(STATE_CHANGE_VIEWPORT);
+}
+
+void Device::setScissor(int index, bool enable, const Rect& viewport) {
+    record(trace, callCount, "setScissor %d %d %g %g %g %g", index, enable, viewport.x, viewport.y, viewport.width, viewport.height);
+
+    countStateChange(STATE_CHANGE_RASTERIZER);
+}
+
+void Device::setDepthTest(bool enable, int function) {
+    record(trace, callCount, "setDepthTest %d 0x%x", enable, function);
+
+    countStateChange(STATE_CHANGE_DEPTH_STENCIL);
+}
+
+void Device::setCullFace(bool enable, int cullFace, int frontFace) {
+    record(trace, callCount, "setCullFace %d 0x%x 0x%x", enable, cullFace, frontFace);
+
+    countStateChange(STATE_CHANGE_RASTERIZER);
+}
+
+void Device::setBlend(int index, bool enable, int equationColor, int srcColor, int dstColor, int equationAlpha, int srcAlpha, int dstAlpha) {
+    record(trace, callCount, "setBlend %d %d 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x", index, enable,
+           equationColor, srcColor, dstColor, equationAlpha, srcAlpha, dstAlpha);
+
+    countStateChange(STATE_CHANGE_BLEND);
+}
+
+void Device::setDrawBuffers(uint32_t mask) {
+    record(trace, callCount, "setDrawBuffers 0x%x", mask);
+
+    countStateChange(STATE_CHANGE_DRAWBUFFERS);
+}
+
+void Device::setUnpackAlignment(int alignment) {
+    record(trace, callCount, "setUnpackAlignment %d", alignment);
+}
+
+void Device::getFramebufferSize(int& width, int& height) {
+    width = NULL_FRAMEBUFFER_WIDTH;
+    height = NULL_FRAMEBUFFER_HEIGHT;
+}
+
+void Device::queryTimestamp(Query query) {
+    record(trace, callCount, "queryTimestamp %u", query.id);
+}
+
+bool Device::getQueryResult(Query query, uint64_t& result) {
+    //there is no GPU work, every query completes immediately
+    result = 0;
+    return true;
+}
+
+//////////////////////////////////////////////////
+
+void Device::setErrorCheckMode(ErrorCheckMode mode) {
+    //there is nothing to check without a driver
+    error_check_mode = ERROR_CHECK_NONE;
+}
+
+void Device::endFrame() {
+    record(trace, callCount, "endFrame %llu", (unsigned long long) frameCount);
+
+    frameCount++;
+}
@@ -0,0 +1,388 @@
+#include "IndexOptimizer.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+struct OverdrawPatch {
+    float center[3];
+    float normal[3];
+    float key; //how much the patch faces out of the mesh
+    int first;
+    int count;
+};
+
+/*
+ * Numbers the distinct vertices of indices from 0, local[i] is the number of
+ * indices[i]. Ranges usually touch a small part of the vertex buffer, so nothing
+ * here is sized by it. Returns how many vertices there are.
+ */
+static int mnCompactVertices(HeapAllocator& allocator, const uint32_t* indices, int count, uint32_t* local) {
+    uint32_t* sorted = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+
+    memcpy(sorted, indices, count * sizeof(uint32_t));
+    std::sort(sorted, sorted + count);
+
+    int vertexCount = (int) (std::unique(sorted, sorted + count) - sorted);
+
+    for (int i = 0; i < count; i++)
+        local[i] = (uint32_t) (std::lower_bound(sorted, sorted + vertexCount, indices[i]) - sorted);
+
+    allocator.deallocate(sorted);
+
+    return vertexCount;
+}
+
+/*
+ * FIFO cache, a vertex is still there while fewer than cacheSize vertices were
+ * transformed after it. Adding cacheSize + 1 to time empties it.
+ */
+static int mnCacheMisses(const uint32_t* triangle, uint32_t* timestamps, uint32_t& time, int cacheSize) {
+    int misses = 0;
+
+    for (int i = 0; i < 3; i++) {
+        uint32_t vertex = triangle[i];
+
+        if (time - timestamps[vertex] > (uint32_t) cacheSize) {
+            timestamps[vertex] = time++;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+void mnAnalyzeVertexCache(HeapAllocator& allocator, const uint32_t* indices, int count, int cacheSize,
+                          VertexCacheStatistics& statistics) {
+    statistics.triangles = count / 3;
+    statistics.vertices = 0;
+    statistics.transformed = 0;
+    statistics.acmr = 0;
+    statistics.atvr = 0;
+
+    if (statistics.triangles == 0)
+        return;
+
+    uint32_t* local = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    statistics.vertices = mnCompactVertices(allocator, indices, count, local);
+
+    uint32_t* timestamps = (uint32_t*) allocator.allocate(statistics.vertices * sizeof(uint32_t));
+    memset(timestamps, 0, statistics.vertices * sizeof(uint32_t));
+
+    uint32_t time = (uint32_t) cacheSize + 1;
+
+    for (int i = 0; i < statistics.triangles; i++)
+        statistics.transformed += mnCacheMisses(&local[i * 3], timestamps, time, cacheSize);
+
+    statistics.acmr = (float) statistics.transformed / statistics.triangles;
+    statistics.atvr = (float) statistics.transformed / statistics.vertices;
+
+    allocator.deallocate(local);
+    allocator.deallocate(timestamps);
+}
+
+void mnOptimizeVertexCache(HeapAllocator& allocator, uint32_t* indices, int count, int cacheSize) {
+    int triangleCount = count / 3;
+
+    if (triangleCount == 0)
+        return;
+
+    uint32_t* local = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    int vertexCount = mnCompactVertices(allocator, indices, count, local);
+
+    uint32_t* original = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    uint32_t* adjacencyOffset = (uint32_t*) allocator.allocate((vertexCount + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    uint32_t* live = (uint32_t*) allocator.allocate(vertexCount * sizeof(uint32_t));
+    uint32_t* timestamps = (uint32_t*) allocator.allocate(vertexCount * sizeof(uint32_t));
+    uint32_t* deadEnd = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    uint32_t* candidates = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    uint8_t* emitted = (uint8_t*) allocator.allocate(triangleCount);
+
+    memcpy(original, indices, count * sizeof(uint32_t));
+    memset(timestamps, 0, vertexCount * sizeof(uint32_t));
+    memset(emitted, 0, triangleCount);
+
+    //triangles around each vertex
+    memset(adjacencyOffset, 0, (vertexCount + 1) * sizeof(uint32_t));
+
+    for (int i = 0; i < count; i++)
+        adjacencyOffset[local[i] + 1]++;
+
+    for (int i = 0; i < vertexCount; i++)
+        adjacencyOffset[i + 1] += adjacencyOffset[i];
+
+    for (int i = 0; i < count; i++)
+        adjacency[adjacencyOffset[local[i]]++] = (uint32_t) (i / 3);
+
+    for (int i = vertexCount; i > 0; i--)
+        adjacencyOffset[i] = adjacencyOffset[i - 1];
+
+    adjacencyOffset[0] = 0;
+
+    for (int i = 0; i < vertexCount; i++)
+        live[i] = adjacencyOffset[i + 1] - adjacencyOffset[i];
+
+    uint32_t time = (uint32_t) cacheSize + 1;
+    int deadEndCount = 0;
+    int cursor = 0;
+    int written = 0;
+    int fan = 0;
+
+    while (fan >= 0) {
+        int candidateCount = 0;
+
+        //emits every triangle left around the fanning vertex
+        for (uint32_t k = adjacencyOffset[fan]; k < adjacencyOffset[fan + 1]; k++) {
+            uint32_t triangle = adjacency[k];
+
+            if (emitted[triangle])
+                continue;
+
+            emitted[triangle] = 1;
+
+            for (int j = 0; j < 3; j++) {
+                uint32_t vertex = local[triangle * 3 + j];
+
+                deadEnd[deadEndCount++] = vertex;
+                candidates[candidateCount++] = vertex;
+                live[vertex]--;
+
+                if (time - timestamps[vertex] > (uint32_t) cacheSize)
+                    timestamps[vertex] = time++;
+            }
+
+            memcpy(&indices[written * 3], &original[triangle * 3], 3 * sizeof(uint32_t));
+            written++;
+        }
+
+        //the oldest vertex that stays in the cache while its triangles are emitted
+        int next = -1;
+        int bestPriority = -1;
+
+        for (int j = 0; j < candidateCount; j++) {
+            uint32_t vertex = candidates[j];
+
+            if (live[vertex] == 0)
+                continue;
+
+            int age = (int) (time - timestamps[vertex]);
+            int priority = age + 2 * (int) live[vertex] <= cacheSize ? age : 0;
+
+            if (priority > bestPriority) {
+                next = (int) vertex;
+                bestPriority = priority;
+            }
+        }
+
+        //dead end, back to a recent vertex with triangles left or the next one in order
+        while (next < 0 && deadEndCount > 0) {
+            uint32_t vertex = deadEnd[--deadEndCount];
+
+            if (live[vertex] > 0)
+                next = (int) vertex;
+        }
+
+        while (next < 0 && cursor < vertexCount) {
+            if (live[cursor] > 0)
+                next = cursor;
+
+            cursor++;
+        }
+
+        fan = next;
+    }
+
+    allocator.deallocate(local);
+    allocator.deallocate(original);
+    allocator.deallocate(adjacencyOffset);
+    allocator.deallocate(adjacency);
+    allocator.deallocate(live);
+    allocator.deallocate(timestamps);
+    allocator.deallocate(deadEnd);
+    allocator.deallocate(candidates);
+    allocator.deallocate(emitted);
+}
+
+void mnOptimizeOverdraw(HeapAllocator& allocator, const Vector3* vertices, uint32_t* indices, int count,
+                        int cacheSize, float threshold) {
+    int triangleCount = count / 3;
+
+    if (triangleCount < 2)
+        return;
+
+    uint32_t* local = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    int vertexCount = mnCompactVertices(allocator, indices, count, local);
+
+    uint32_t* timestamps = (uint32_t*) allocator.allocate(vertexCount * sizeof(uint32_t));
+    int* hard = (int*) allocator.allocate((triangleCount + 1) * sizeof(int));
+    OverdrawPatch* patches = (OverdrawPatch*) allocator.allocate(triangleCount * sizeof(OverdrawPatch));
+
+    memset(timestamps, 0, vertexCount * sizeof(uint32_t));
+
+    uint32_t time = (uint32_t) cacheSize + 1;
+
+    //the cache was flushed where all the vertices of a triangle miss
+    int hardCount = 1;
+    hard[0] = 0;
+
+    mnCacheMisses(&local[0], timestamps, time, cacheSize);
+
+    for (int i = 1; i < triangleCount; i++) {
+        if (mnCacheMisses(&local[i * 3], timestamps, time, cacheSize) == 3)
+            hard[hardCount++] = i;
+    }
+
+    hard[hardCount] = triangleCount;
+
+    //smaller patches wherever their ACMR is already close to the whole run
+    int patchCount = 0;
+
+    for (int h = 0; h < hardCount; h++) {
+        int start = hard[h];
+        int end = hard[h + 1];
+        int misses = 0;
+
+        time += cacheSize + 1;
+
+        for (int i = start; i < end; i++)
+            misses += mnCacheMisses(&local[i * 3], timestamps, time, cacheSize);
+
+        float target = threshold * misses / (end - start);
+        int runningMisses = 0;
+
+        time += cacheSize + 1;
+        patches[patchCount].first = start;
+
+        for (int i = start; i < end; i++) {
+            runningMisses += mnCacheMisses(&local[i * 3], timestamps, time, cacheSize);
+
+            int runningCount = i + 1 - patches[patchCount].first;
+
+            if (i + 1 < end && (float) runningMisses / runningCount <= target) {
+                patches[patchCount].count = runningCount;
+                patchCount++;
+                patches[patchCount].first = i + 1;
+
+                runningMisses = 0;
+                time += cacheSize + 1;
+            }
+        }
+
+        patches[patchCount].count = end - patches[patchCount].first;
+        patchCount++;
+    }
+
+    if (patchCount > 1) {
+        //area weighted centroid and normal of every patch and of the whole run
+        float meshCenter[3] = {0, 0, 0};
+        float meshArea = 0;
+
+        for (int p = 0; p < patchCount; p++) {
+            OverdrawPatch& patch = patches[p];
+
+            float area = 0;
+
+            for (int j = 0; j < 3; j++)
+                patch.center[j] = patch.normal[j] = 0;
+
+            for (int i = patch.first; i < patch.first + patch.count; i++) {
+                const Vector3& v0 = vertices[indices[i*3 + 0]];
+                const Vector3& v1 = vertices[indices[i*3 + 1]];
+                const Vector3& v2 = vertices[indices[i*3 + 2]];
+
+                float e0[3], e1[3], cross[3];
+                mnVector3Sub(v1.values, v0.values, e0);
+                mnVector3Sub(v2.values, v0.values, e1);
+                mnVector3Cross(e0, e1, cross);
+
+                float triangleArea = mnVector3Length(cross);
+
+                for (int j = 0; j < 3; j++) {
+                    patch.center[j] += (v0.values[j] + v1.values[j] + v2.values[j]) / 3 * triangleArea;
+                    patch.normal[j] += cross[j];
+                }
+
+                area += triangleArea;
+            }
+
+            for (int j = 0; j < 3; j++)
+                meshCenter[j] += patch.center[j];
+
+            meshArea += area;
+
+            float length = mnVector3Length(patch.normal);
+
+            if (area > 0 && length > 0) {
+                mnVector3MulScalar(patch.center, 1 / area, patch.center);
+                mnVector3MulScalar(patch.normal, 1 / length, patch.normal);
+            }
+        }
+
+        if (meshArea > 0)
+            mnVector3MulScalar(meshCenter, 1 / meshArea, meshCenter);
+
+        for (int p = 0; p < patchCount; p++) {
+            float d[3];
+            mnVector3Sub(patches[p].center, meshCenter, d);
+
+            patches[p].key = mnVector3Dot(d, patches[p].normal);
+        }
+
+        std::stable_sort(patches, patches + patchCount, [](const OverdrawPatch& a, const OverdrawPatch& b) {
+            return a.key > b.key;
+        });
+
+        uint32_t* original = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+        memcpy(original, indices, count * sizeof(uint32_t));
+
+        int written = 0;
+
+        for (int p = 0; p < patchCount; p++) {
+            memcpy(&indices[written], &original[patches[p].first * 3], patches[p].count * 3 * sizeof(uint32_t));
+            written += patches[p].count * 3;
+        }
+
+        allocator.deallocate(original);
+    }
+
+    allocator.deallocate(local);
+    allocator.deallocate(timestamps);
+    allocator.deallocate(hard);
+    allocator.deallocate(patches);
+}
+
+void mnOptimizeVertexFetch(uint32_t* indices, int count, int numberVertices, uint32_t* remap) {
+    const uint32_t unused = 0xffffffff;
+
+    for (int i = 0; i < numberVertices; i++)
+        remap[i] = unused;
+
+    uint32_t next = 0;
+
+    for (int i = 0; i < count; i++) {
+        uint32_t& vertex = remap[indices[i]];
+
+        if (vertex == unused)
+            vertex = next++;
+
+        indices[i] = vertex;
+    }
+
+    for (int i = 0; i < numberVertices; i++) {
+        if (remap[i] == unused)
+            remap[i] = next++;
+    }
+}
+
+void mnRemapVertices(HeapAllocator& allocator, void* data, int size, int numberVertices, const uint32_t* remap) {
+    uint8_t* bytes = (uint8_t*) data;
+    uint8_t* copy = (uint8_t*) allocator.allocate(numberVertices * size);
+
+    for (int i = 0; i < numberVertices; i++)
+        memcpy(&copy[remap[i] * size], &bytes[i * size], size);
+
+    memcpy(bytes, copy, numberVertices * size);
+
+    allocator.deallocate(copy);
+}
@@ -0,0 +1,58 @@
+#ifndef INDEX_OPTIMIZER_H
+#define INDEX_OPTIMIZER_H
+
+#include <stdint.h>
+
+#include "Vector.h"
+#include "Allocator.h"
+
+//post-transform cache of the GPUs we care about, a FIFO of about this many vertices
+const int VERTEX_CACHE_SIZE = 16;
+
+//how much worse than the best vertex cache order a mesh may get for less overdraw
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+struct VertexCacheStatistics {
+    int triangles;
+    int vertices;    //distinct vertices referenced
+    int transformed; //vertex shader invocations
+    float acmr;      //transformed per triangle, 0.5 is the best a large grid can do
+    float atvr;      //transformed per vertex, 1 is the best
+};
+
+/*
+ * Runs the triangles through a FIFO post-transform cache of cacheSize vertices.
+ */
+void mnAnalyzeVertexCache(HeapAllocator& allocator, const uint32_t* indices, int count, int cacheSize,
+                          VertexCacheStatistics& statistics);
+
+/*
+ * Reorders the triangles in place for the post-transform cache with Tipsify
+ * (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+ * Reduced Overdraw"). Only the order of the triangles changes, never their
+ * winding.
+ */
+void mnOptimizeVertexCache(HeapAllocator& allocator, uint32_t* indices, int count, int cacheSize);
+
+/*
+ * Splits triangles already ordered by mnOptimizeVertexCache into patches where
+ * the cache is flushed or where the ACMR is at most threshold times the one of
+ * the whole run, then draws the patches facing out of the mesh first so they
+ * occlude the rest. Triangles inside a patch keep their order.
+ */
+void mnOptimizeOverdraw(HeapAllocator& allocator, const Vector3* vertices, uint32_t* indices, int count,
+                        int cacheSize, float threshold);
+
+/*
+ * Renumbers the vertices in the order the indices first reference them so the
+ * vertex fetch walks the vertex buffer forward. indices is rewritten and
+ * remap[old] = new, vertices never referenced go to the end in their old order.
+ */
+void mnOptimizeVertexFetch(uint32_t* indices, int count, int numberVertices, uint32_t* remap);
+
+/*
+ * Moves every element of size bytes of data to its slot in remap.
+ */
+void mnRemapVertices(HeapAllocator& allocator, void* data, int size, int numberVertices, const uint32_t* remap);
+
+#endif //INDEX_OPTIMIZER_H
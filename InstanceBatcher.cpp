@@ -0,0 +1,281 @@
+#include "InstanceBatcher.h"
+#include "Profiler.h"
+
+InstanceBatcher::InstanceBatcher(Device& device, HeapAllocator& allocator, size_t instanceSize, int instancesPerDraw,
+                                 int maxDraws, int bindingPoint)
+        : device(device), allocator(allocator), instanceSize(instanceSize), instancesPerDraw(instancesPerDraw),
+          maxDraws(maxDraws), bindingPoint(bindingPoint), drawCount(0), droppedCount(0), itemsCount(0),
+          itemsAllocated(INSTANCE_BATCHER_INITIAL_ITEMS), instanceLodsAllocated(256), instanceBoundsAllocated(256) {
+    size_t alignment = device.getConstantBufferAlignment();
+    drawSize = (instancesPerDraw * instanceSize + alignment - 1) / alignment * alignment;
+
+    buffer = device.createConstantBuffer(maxDraws * drawSize);
+    data = (uint8_t*) allocator.allocate(maxDraws * drawSize);
+    memset(data, 0, maxDraws * drawSize);
+
+    views = (ConstantBuffer*) allocator.allocate(maxDraws * sizeof(ConstantBuffer));
+    draws = (CommandBuffer**) allocator.allocate(maxDraws * sizeof(CommandBuffer*));
+
+    for (int i = 0; i < maxDraws; i++) {
+        views[i] = device.createConstantBufferView(buffer, i * drawSize, instancesPerDraw * instanceSize);
+        draws[i] = CommandBuffer::create(allocator, 2);
+    }
+
+    items = (BatchItem*) allocator.allocate(itemsAllocated * sizeof(BatchItem));
+    instanceLods = (uint8_t*) allocator.allocate(instanceLodsAllocated);
+    instanceBounds = (BoundingSphere*) allocator.allocate(instanceBoundsAllocated * sizeof(BoundingSphere));
+    instanceVisible = (uint8_t*) allocator.allocate(instanceBoundsAllocated);
+}
+
+InstanceBatcher::~InstanceBatcher() {
+    for (int i = 0; i < maxDraws; i++) {
+        device.destroyConstantBuffer(views[i]);
+        CommandBuffer::destroy(allocator, draws[i]);
+    }
+
+    device.destroyConstantBuffer(buffer);
+
+    allocator.deallocate(views);
+    allocator.deallocate(draws);
+    allocator.deallocate(data);
+    allocator.deallocate(items);
+    allocator.deallocate(instanceLods);
+    allocator.deallocate(instanceBounds);
+    allocator.deallocate(instanceVisible);
+}
+
+void InstanceBatcher::draw(ModelInstance* modelInstance, const void* data, uint64_t key, CommandBuffer* globalState) {
+    Model* model = modelInstance->model;
+
+    if (itemsCount + model->meshCount > itemsAllocated) {
+        itemsAllocated = (itemsCount + model->meshCount) * 3 / 2;
+        items = (BatchItem*) allocator.reallocate(items, itemsAllocated * sizeof(BatchItem));
+    }
+
+    for (int i = 0; i < model->meshCount; i++) {
+        assert(modelInstance->perMesh[i].material != nullptr);
+
+        BatchItem& item = items[itemsCount++];
+        item.key = key;
+        item.globalState = globalState;
+        item.modelInstance = modelInstance;
+        item.material = modelInstance->perMesh[i].material;
+        item.mesh = i;
+        item.data = (const uint8_t*) data;
+    }
+}
+
+/*
+ * Translucent items are never merged, one draw with the depth of its farthest
+ * instance would break the back-to-front order with the other translucent draws.
+ * They are drawn as ModelInstance::draw would.
+ */
+static bool isSameBatch(const BatchItem& a, const BatchItem& b) {
+    return !a.material->translucent &&
+           a.key == b.key &&
+           a.globalState == b.globalState &&
+           a.modelInstance->model == b.modelInstance->model &&
+           a.mesh == b.mesh &&
+           a.material == b.material;
+}
+
+static bool compareBatch(const BatchItem& a, const BatchItem& b) {
+    if (a.key != b.key)
+        return a.key < b.key;
+
+    if (a.globalState != b.globalState)
+        return a.globalState < b.globalState;
+
+    if (a.modelInstance->model != b.modelInstance->model)
+        return a.modelInstance->model < b.modelInstance->model;
+
+    if (a.mesh != b.mesh)
+        return a.mesh < b.mesh;
+
+    return a.material < b.material;
+}
+
+/*
+ * Same distances as ModelInstance::getViewDepth, per sphere.
+ */
+static float getViewDepth(const BoundingSphere& bounds, const float* view, bool translucent) {
+    float z = view[2]*bounds.center[0] + view[6]*bounds.center[1] + view[10]*bounds.center[2] + view[14];
+#if RIGHT_HANDED
+    float depth = -z;
+#else
+    float depth = z;
+#endif
+
+    return translucent ? depth : depth - bounds.radius;
+}
+
+static const uint8_t LOD_CULLED = 0xff;
+
+void InstanceBatcher::submit(RenderQueue& renderQueue) {
+    const Frustum* frustum = renderQueue.getFrustum();
+    OcclusionBuffer* occlusionBuffer = renderQueue.getOcclusionBuffer();
+    const float* view = renderQueue.getViewMatrix();
+
+    //submission order is kept inside a batch, it becomes the gl_InstanceID order
+    std::stable_sort(items, items + itemsCount, compareBatch);
+
+    int boundsCount = 0;
+
+    for (int i = 0; i < itemsCount; i++)
+        boundsCount += items[i].modelInstance->instanceCount;
+
+    if (boundsCount > instanceBoundsAllocated) {
+        instanceBoundsAllocated = boundsCount;
+        instanceBounds = (BoundingSphere*) allocator.reallocate(instanceBounds, instanceBoundsAllocated * sizeof(BoundingSphere));
+        instanceVisible = (uint8_t*) allocator.reallocate(instanceVisible, instanceBoundsAllocated);
+    }
+
+    //cull every instance at once, the occlusion tests are spread over its threads
+    for (int i = 0, n = 0; i < itemsCount; i++) {
+        const BatchItem& item = items[i];
+        int count = item.modelInstance->instanceCount;
+
+        memcpy(&instanceBounds[n], &item.modelInstance->meshBounds[item.mesh * count], count * sizeof(BoundingSphere));
+        n += count;
+    }
+
+    if (frustum != nullptr)
+        mnCullSpheres(*frustum, instanceBounds, boundsCount, instanceVisible);
+    else
+        memset(instanceVisible, 1, boundsCount);
+
+    if (occlusionBuffer != nullptr)
+        occlusionBuffer->cull(instanceBounds, boundsCount, instanceVisible);
+
+    drawCount = 0;
+    droppedCount = 0;
+
+    for (int begin = 0, end, first = 0; begin < itemsCount; begin = end) {
+        end = begin + 1;
+
+        while (end < itemsCount && isSameBatch(items[begin], items[end]))
+            end++;
+
+        bool translucent = items[begin].material->translucent;
+        Mesh* mesh = &items[begin].modelInstance->model->meshes[items[begin].mesh];
+        int totalCount = 0;
+
+        for (int i = begin; i < end; i++)
+            totalCount += items[i].modelInstance->instanceCount;
+
+        if (totalCount > instanceLodsAllocated) {
+            instanceLodsAllocated = totalCount;
+            instanceLods = (uint8_t*) allocator.reallocate(instanceLods, instanceLodsAllocated);
+        }
+
+        //pick the LOD of every visible instance once
+        for (int i = begin, n = 0; i < end; i++) {
+            const BatchItem& item = items[i];
+            int count = item.modelInstance->instanceCount;
+            int visibleCount = 0;
+
+            for (int j = 0; j < count; j++, first++) {
+                if (instanceVisible[first]) {
+                    float screenSize = renderQueue.getScreenSize(instanceBounds[first]);
+
+                    instanceLods[n++] = (uint8_t) Mesh::selectLod(mesh, screenSize);
+                    visibleCount++;
+                } else {
+                    instanceLods[n++] = LOD_CULLED;
+                }
+            }
+
+            if (visibleCount == 0)
+                renderQueue.countCulled(item.material->passCount);
+        }
+
+        for (int lod = 0; lod < mesh->lodCount; lod++) {
+            int instanceCount = 0;
+            float viewDepth = 0;
+
+            for (int i = begin, n = 0; i < end; i++) {
+                const BatchItem& item = items[i];
+                int count = item.modelInstance->instanceCount;
+                const BoundingSphere* spheres = &item.modelInstance->meshBounds[item.mesh * count];
+
+                for (int j = 0; j < count; j++) {
+                    if (instanceLods[n++] != lod)
+                        continue;
+
+                    if (instanceCount == instancesPerDraw) {
+                        emit(renderQueue, items[begin], lod, instanceCount, viewDepth);
+                        instanceCount = 0;
+                    }
+
+                    //every draw block is taken, nothing is written past them
+                    if (drawCount == maxDraws) {
+                        droppedCount++;
+                        continue;
+                    }
+
+                    float depth = getViewDepth(spheres[j], view, translucent);
+
+                    if (instanceCount == 0 || (translucent ? depth > viewDepth : depth < viewDepth))
+                        viewDepth = depth;
+
+                    memcpy(&data[drawCount * drawSize + instanceCount * instanceSize],
+                           &item.data[j * instanceSize], instanceSize);
+
+                    instanceCount++;
+                }
+            }
+
+            if (instanceCount > 0)
+                emit(renderQueue, items[begin], lod, instanceCount, viewDepth);
+        }
+    }
+
+    if (drawCount > 0) {
+        PROFILE_SCOPE("InstanceBatcher::upload");
+
+        device.copyConstantBuffer(buffer, data, drawCount * drawSize);
+    }
+
+    itemsCount = 0;
+}
+
+int InstanceBatcher::getDrawCount() {
+    return drawCount;
+}
+
+int InstanceBatcher::getDroppedCount() {
+    return droppedCount;
+}
+
+void InstanceBatcher::emit(RenderQueue& renderQueue, const BatchItem& item, int lod, int instanceCount, float viewDepth) {
+    assert(drawCount < maxDraws);
+
+    Model* model = item.modelInstance->model;
+    MeshLod* mesh = &model->meshes[item.mesh].lods[lod];
+    Material* material = item.material;
+
+    CommandBuffer* draw = draws[drawCount];
+    draw->commandCount = 0;
+
+    BindConstantBuffer::create(draw, views[drawCount], bindingPoint);
+
+    if (model->hasIndices)
+        DrawTrianglesInstanced::create(draw, mesh->offset, mesh->count, model->indexType, instanceCount);
+    else
+        DrawArraysInstanced::create(draw, GL_TRIANGLES, mesh->offset, mesh->count, instanceCount);
+
+    uint32_t depth = RenderQueue::quantizeDepth(viewDepth, material->translucent, material->id);
+
+    for (int i = 0; i < material->passCount; i++) {
+        CommandBuffer* commandBuffers[] = {
+                item.globalState,
+                model->state,
+                material->state[i],
+                draw,
+        };
+
+        renderQueue.submit(item.key, depth, commandBuffers, 4);
+    }
+
+    drawCount++;
+}
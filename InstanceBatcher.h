@@ -0,0 +1,99 @@
+#ifndef INSTANCE_BATCHER_H
+#define INSTANCE_BATCHER_H
+
+#include "Allocator.h"
+#include "Device.h"
+#include "Commands.h"
+#include "RenderQueue.h"
+#include "Material.h"
+#include "Model.h"
+#include "ModelInstance.h"
+
+const int INSTANCE_BATCHER_INITIAL_ITEMS = 1024;
+
+struct BatchItem {
+    uint64_t key;
+    CommandBuffer* globalState;
+    ModelInstance* modelInstance;
+    Material* material;
+    int mesh;
+    const uint8_t* data;
+};
+
+/*
+ * Merges the draws of ModelInstances sharing the same model, mesh and material
+ * into instanced draws. The per instance data of every visible instance is copied
+ * into a shared constant buffer, so the instance count of each draw follows the
+ * culling results of the frame. Instances pick their own LOD, a group becomes one
+ * draw per LOD in use. Translucent materials are not merged, every ModelInstance
+ * keeps its own draw and depth. With an occlusion buffer set on the render queue every
+ * instance of the frame is tested against it in one go, on its worker threads.
+ *
+ * The shaders see the same array they would with a ModelInstance of their own,
+ * indexed by gl_InstanceID.
+ */
+class InstanceBatcher {
+public:
+    /*
+     * instanceSize is the size of one element of the shader instance array and
+     * instancesPerDraw its length, at most maxDraws draws are emitted per frame.
+     * Visible instances that don't fit in them are dropped, see getDroppedCount().
+     */
+    InstanceBatcher(Device& device, HeapAllocator& allocator, size_t instanceSize, int instancesPerDraw,
+                    int maxDraws, int bindingPoint);
+
+    ~InstanceBatcher();
+
+    /*
+     * Same as ModelInstance::draw, data points to the modelInstance->instanceCount
+     * elements its own constant buffer would hold and must live until submit().
+     */
+    void draw(ModelInstance* modelInstance, const void* data, uint64_t key, CommandBuffer* globalState);
+
+    /*
+     * Culls, packs and submits everything drawn since the last call. Call it once
+     * per frame after the view and projection of the render queue are set.
+     */
+    void submit(RenderQueue& renderQueue);
+
+    /*
+     * Instanced draws emitted by the last submit().
+     */
+    int getDrawCount();
+
+    /*
+     * Visible instances the last submit() had no draw left for.
+     */
+    int getDroppedCount();
+private:
+    void emit(RenderQueue& renderQueue, const BatchItem& item, int lod, int instanceCount, float viewDepth);
+
+    Device& device;
+    HeapAllocator& allocator;
+
+    size_t instanceSize;
+    size_t drawSize; //aligned size of each draw block
+    int instancesPerDraw;
+    int maxDraws;
+    int bindingPoint;
+
+    ConstantBuffer buffer;
+    uint8_t* data;
+    ConstantBuffer* views;
+    CommandBuffer** draws;
+    int drawCount;
+    int droppedCount;
+
+    BatchItem* items;
+    int itemsCount;
+    int itemsAllocated;
+
+    uint8_t* instanceLods; //LOD of every instance of the current group
+    int instanceLodsAllocated;
+
+    BoundingSphere* instanceBounds; //every instance of the frame, in item order
+    uint8_t* instanceVisible;
+    int instanceBoundsAllocated;
+};
+
+#endif //INSTANCE_BATCHER_H
@@ -5,6 +5,8 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include "Vector.h"
+
 struct MaterialBumpedDiffuse {
     Program program;
     int mainUnit;
@@ -27,13 +29,17 @@ struct MaterialTransparency {
 };
 
 struct Material {
+    uint32_t id; //0 unless created by MaterialManager
     int passCount;
+    bool translucent;
     CommandBuffer* state[4];
 
     static Material* create(HeapAllocator& allocator, MaterialBumpedDiffuse* diffuse) {
         Material* material = (Material*) allocator.allocate(sizeof(Material));
 
+        material->id = 0;
         material->passCount = 1;
+        material->translucent = false;
         material->state[0] = CommandBuffer::create(allocator, 10);
         BindProgram::create(material->state[0], diffuse->program);
 #if RIGHT_HANDED
@@ -59,7 +65,9 @@ struct Material {
     static Material* create(HeapAllocator& allocator, MaterialTransparency* transparency) {
         Material* material = (Material*) allocator.allocate(sizeof(Material));
 
+        material->id = 0;
         material->passCount = 2;
+        material->translucent = true;
 
         material->state[0] = CommandBuffer::create(allocator, 10);
         BindProgram::create(material->state[0], transparency->program);
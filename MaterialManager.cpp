@@ -0,0 +1,177 @@
+#include "MaterialManager.h"
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    //FNV-1a
+    const uint8_t* bytes = (const uint8_t*) data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static uint64_t hash_description(int type, const void* description, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+
+    hash = hash_bytes(hash, &type, sizeof(type));
+    hash = hash_bytes(hash, description, size);
+
+    return hash;
+}
+
+MaterialManager::MaterialManager(HeapAllocator& allocator) : allocator(allocator) {
+    materialCount = 0;
+    materialAllocated = 16;
+    materials = (Resource*) allocator.allocate(materialAllocated * sizeof(Resource));
+
+    memset(usedIds, 0, sizeof(usedIds));
+}
+
+MaterialManager::~MaterialManager() {
+    assert(materialCount == 0);
+
+    allocator.deallocate(materials);
+}
+
+Material* MaterialManager::createMaterial(const MaterialBumpedDiffuse& diffuse) {
+    //unused units don't make two materials different
+    MaterialBumpedDiffuse description;
+    memset(&description, 0, sizeof(description));
+
+    description.program = diffuse.program;
+    description.mainUnit = diffuse.mainUnit;
+    description.bumpUnit = diffuse.bumpUnit;
+
+    if (diffuse.mainUnit != -1) {
+        description.mainTex = diffuse.mainTex;
+        description.mainSampler = diffuse.mainSampler;
+    }
+
+    if (diffuse.bumpUnit != -1) {
+        description.bumpMap = diffuse.bumpMap;
+        description.bumpSampler = diffuse.bumpSampler;
+    }
+
+    uint64_t hash = hash_description(MATERIAL_BUMPED_DIFFUSE, &description, sizeof(description));
+
+    Material* material = findMaterial(hash, MATERIAL_BUMPED_DIFFUSE, &description, sizeof(description));
+
+    if (material != nullptr)
+        return material;
+
+    Resource* resource = addMaterial(hash, MATERIAL_BUMPED_DIFFUSE);
+    resource->diffuse = description;
+    resource->material = Material::create(allocator, &resource->diffuse);
+    resource->material->id = allocateId();
+
+    return resource->material;
+}
+
+Material* MaterialManager::createMaterial(const MaterialTransparency& transparency) {
+    MaterialTransparency description;
+    memset(&description, 0, sizeof(description));
+
+    description.program = transparency.program;
+    description.mainUnit = transparency.mainUnit;
+    description.bumpUnit = transparency.bumpUnit;
+    description.alpha = transparency.alpha;
+
+    if (transparency.mainUnit != -1) {
+        description.mainTex = transparency.mainTex;
+        description.mainSampler = transparency.mainSampler;
+    }
+
+    if (transparency.bumpUnit != -1) {
+        description.bumpMap = transparency.bumpMap;
+        description.bumpSampler = transparency.bumpSampler;
+    }
+
+    uint64_t hash = hash_description(MATERIAL_TRANSPARENCY, &description, sizeof(description));
+
+    Material* material = findMaterial(hash, MATERIAL_TRANSPARENCY, &description, sizeof(description));
+
+    if (material != nullptr)
+        return material;
+
+    Resource* resource = addMaterial(hash, MATERIAL_TRANSPARENCY);
+    resource->transparency = description;
+    resource->material = Material::create(allocator, &resource->transparency);
+    resource->material->id = allocateId();
+
+    return resource->material;
+}
+
+void MaterialManager::destroyMaterial(Material* material) {
+    for (uint32_t i = 0; i < materialCount; i++) {
+        if (materials[i].material != material)
+            continue;
+
+        materials[i].refs--;
+
+        if (materials[i].refs == 0) {
+            usedIds[material->id] = false;
+            Material::destroy(allocator, material);
+
+            materialCount--;
+            std::swap(materials[i], materials[materialCount]);
+        }
+
+        return;
+    }
+}
+
+int MaterialManager::getMaterialCount() {
+    return materialCount;
+}
+
+Material* MaterialManager::findMaterial(uint64_t hash, MaterialType type, const void* description, size_t size) {
+    for (uint32_t i = 0; i < materialCount; i++) {
+        Resource& resource = materials[i];
+
+        if (resource.hash != hash || resource.type != type)
+            continue;
+
+        const void* other = type == MATERIAL_BUMPED_DIFFUSE ? (const void*) &resource.diffuse
+                                                            : (const void*) &resource.transparency;
+
+        if (memcmp(other, description, size) == 0) {
+            resource.refs++;
+            return resource.material;
+        }
+    }
+
+    return nullptr;
+}
+
+MaterialManager::Resource* MaterialManager::addMaterial(uint64_t hash, MaterialType type) {
+    Resource* resource = &materials[getSlot()];
+
+    resource->hash = hash;
+    resource->type = type;
+    resource->refs = 1;
+
+    return resource;
+}
+
+uint32_t MaterialManager::getSlot() {
+    if (materialCount >= materialAllocated) {
+        materialAllocated = materialAllocated * 3 / 2;
+        materials = (Resource*) allocator.reallocate(materials, materialAllocated * sizeof(Resource));
+    }
+
+    return materialCount++;
+}
+
+uint32_t MaterialManager::allocateId() {
+    for (uint32_t id = 1; id <= MAX_MATERIAL_ID; id++) {
+        if (!usedIds[id]) {
+            usedIds[id] = true;
+            return id;
+        }
+    }
+
+    //every id is taken, the rest share 0 and only lose sort key precision
+    return 0;
+}
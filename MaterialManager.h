@@ -0,0 +1,71 @@
+#ifndef MATERIAL_MANAGER_H
+#define MATERIAL_MANAGER_H
+
+#include "Allocator.h"
+#include "Device.h"
+#include "Commands.h"
+#include "RenderQueue.h"
+#include "Material.h"
+
+//ids go in the state bits of the sort key, 0 is left for unmanaged materials
+const uint32_t MAX_MATERIAL_ID = (1 << SORT_KEY_STATE_BITS) - 1;
+
+/*
+ * Identical descriptions share a single Material and its state buffers. Every
+ * unique material gets a small id that stays the same while it is alive, so the
+ * render queue can group items by it and the state can be compared as an integer.
+ */
+class MaterialManager {
+public:
+    MaterialManager(HeapAllocator& allocator);
+
+    ~MaterialManager();
+
+    Material* createMaterial(const MaterialBumpedDiffuse& diffuse);
+
+    Material* createMaterial(const MaterialTransparency& transparency);
+
+    /*
+     * The material is destroyed when the last reference goes away.
+     */
+    void destroyMaterial(Material* material);
+
+    int getMaterialCount();
+private:
+    enum MaterialType {
+        MATERIAL_BUMPED_DIFFUSE,
+        MATERIAL_TRANSPARENCY,
+    };
+
+    struct Resource {
+        uint64_t hash;
+        MaterialType type;
+        union {
+            MaterialBumpedDiffuse diffuse;
+            MaterialTransparency transparency;
+        };
+        Material* material;
+        uint32_t refs;
+    };
+
+    Material* findMaterial(uint64_t hash, MaterialType type, const void* description, size_t size);
+
+    Resource* addMaterial(uint64_t hash, MaterialType type);
+
+    uint32_t getSlot();
+
+    /*
+     * Returns 0 once every id is taken. Materials with id 0 share a sort key
+     * state, they still draw correctly but are no longer grouped together.
+     */
+    uint32_t allocateId();
+
+    HeapAllocator& allocator;
+
+    Resource* materials;
+    uint32_t materialCount;
+    uint32_t materialAllocated;
+    bool usedIds[MAX_MATERIAL_ID + 1];
+};
+
+#endif //MATERIAL_MANAGER_H
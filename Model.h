@@ -5,45 +5,151 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "Culling.h"
+#include "Cluster.h"
+
+const int MAX_MESH_LODS = 4;
+
+/*
+ * Fraction of the viewport height covered by the mesh bounds below which the
+ * second LOD is used, the threshold halves for each following one.
+ */
+const float MESH_LOD_SCREEN_SIZE = 0.25f;
+
+struct MeshLod {
+    CommandBuffer* draw;
+    int offset;
+    int count;
+};
+
 struct Mesh {
     CommandBuffer* draw;
     int offset;
     int count;
+    BoundingBox box;       //model space
+    BoundingSphere sphere; //model space
+    int lodCount;
+    MeshLod lods[MAX_MESH_LODS]; //lods[0] is the full mesh, each next one coarser
+    int clusterCount;
+    MeshCluster* clusters;       //split of lods[0], nullptr when not clustered
 
-    static void create(HeapAllocator& allocator, Mesh* mesh, int offset, int count, bool useIndex = true) {
+    static void create(HeapAllocator& allocator, Mesh* mesh, int offset, int count, bool useIndex = true,
+                       int indexType = GL_UNSIGNED_SHORT) {
         mesh->offset = offset;
         mesh->count = count;
         mesh->draw = CommandBuffer::create(allocator, 1);
         if (useIndex)
-            DrawTriangles::create(mesh->draw, offset, count);
+            DrawTriangles::create(mesh->draw, offset, count, indexType);
         else
             DrawArrays::create(mesh->draw, GL_TRIANGLES, offset, count);
+
+        mesh->lodCount = 1;
+        mesh->lods[0].draw = mesh->draw;
+        mesh->lods[0].offset = offset;
+        mesh->lods[0].count = count;
+
+        mesh->clusterCount = 0;
+        mesh->clusters = nullptr;
+    }
+
+    static void setClusters(HeapAllocator& allocator, Mesh* mesh, const MeshCluster* clusters, int count) {
+        assert(mesh->clusters == nullptr);
+
+        mesh->clusterCount = count;
+        mesh->clusters = (MeshCluster*) allocator.allocate(count * sizeof(MeshCluster));
+        memcpy(mesh->clusters, clusters, count * sizeof(MeshCluster));
+    }
+
+    /*
+     * The LOD indexes the same vertices, only the index range changes.
+     */
+    static void addLod(HeapAllocator& allocator, Mesh* mesh, int offset, int count, int indexType) {
+        assert(mesh->lodCount < MAX_MESH_LODS);
+
+        MeshLod* lod = &mesh->lods[mesh->lodCount++];
+        lod->offset = offset;
+        lod->count = count;
+        lod->draw = CommandBuffer::create(allocator, 1);
+        DrawTriangles::create(lod->draw, offset, count, indexType);
+    }
+
+    static int selectLod(const Mesh* mesh, float screenSize) {
+        int lod = 0;
+        float threshold = MESH_LOD_SCREEN_SIZE;
+
+        while (lod + 1 < mesh->lodCount && screenSize < threshold) {
+            lod++;
+            threshold *= 0.5f;
+        }
+
+        return lod;
     }
 
     static void destroy(HeapAllocator& allocator, Mesh* mesh) {
+        for (int i = 1; i < mesh->lodCount; i++)
+            CommandBuffer::destroy(allocator, mesh->lods[i].draw);
         CommandBuffer::destroy(allocator, mesh->draw);
+        if (mesh->clusters != nullptr)
+            allocator.deallocate(mesh->clusters);
     }
 };
 
 struct Model {
     CommandBuffer* state;
     bool hasIndices;
+    int indexType; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, shared by all meshes
+    BoundingBox box;       //every mesh added so far
+    BoundingSphere sphere;
     int meshCount;
     Mesh meshes[];
 
-    static Model* create(HeapAllocator& allocator, VertexArray vertexArray, int meshCount, bool hasIndices = true) {
+    static Model* create(HeapAllocator& allocator, VertexArray vertexArray, int meshCount, bool hasIndices = true,
+                         int indexType = GL_UNSIGNED_SHORT) {
         Model* model = (Model*) allocator.allocate(sizeof(Model) + meshCount * sizeof(Mesh));
 
         model->state = CommandBuffer::create(allocator, 1);
         BindVertexArray::create(model->state, vertexArray);
         model->hasIndices = hasIndices;
+        model->indexType = indexType;
         model->meshCount = meshCount;
 
+        mnMergeBounds(nullptr, nullptr, 0, model->box, model->sphere);
+
         return model;
     }
 
-    static void addMesh(HeapAllocator& allocator, Model* model, int index, int offset, int count) {
-        Mesh::create(allocator, &model->meshes[index], offset, count, model->hasIndices);
+    /*
+     * Meshes are added in order, the model bounds grow with each one.
+     */
+    static void addMesh(HeapAllocator& allocator, Model* model, int index, int offset, int count,
+                        const BoundingBox& box, const BoundingSphere& sphere) {
+        Mesh* mesh = &model->meshes[index];
+
+        Mesh::create(allocator, mesh, offset, count, model->hasIndices, model->indexType);
+        mesh->box = box;
+        mesh->sphere = sphere;
+
+        if (index == 0) {
+            model->box = box;
+            model->sphere = sphere;
+        } else {
+            BoundingBox boxes[2] = {model->box, box};
+            BoundingSphere spheres[2] = {model->sphere, sphere};
+
+            mnMergeBounds(boxes, spheres, 2, model->box, model->sphere);
+        }
+    }
+
+    static void addLod(HeapAllocator& allocator, Model* model, int index, int offset, int count) {
+        assert(model->hasIndices);
+
+        Mesh::addLod(allocator, &model->meshes[index], offset, count, model->indexType);
+    }
+
+    static void setClusters(HeapAllocator& allocator, Model* model, int index, const MeshCluster* clusters, int count) {
+        assert(model->hasIndices);
+
+        Mesh::setClusters(allocator, &model->meshes[index], clusters, count);
     }
 
     static void destroy(HeapAllocator& allocator, Model* model) {
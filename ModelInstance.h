@@ -5,23 +5,178 @@
 #ifndef MODEL_INSTANCE_H
 #define MODEL_INSTANCE_H
 
+const int CULLING_BATCH = 64;
+
 struct ModelInstance {
     struct PerMesh {
-        CommandBuffer* draw;
+        CommandBuffer* draw[MAX_MESH_LODS];
         Material* material;
+        CommandBuffer* clusterDraw; //visible clusters of a single instance, nullptr without clusters
+        DrawRanges clusterRanges; //rewritten by every selectDraw, read by clusterDraw
     };
 
     int instanceCount;
     CommandBuffer* state;
     Model* model;
+    BoundingSphere* bounds;     //world space, one per instance
+    BoundingSphere* meshBounds; //world space, instanceCount per mesh
+    float* matrices;            //one per instance, valid after setTransform
+    bool hasTransform;
     PerMesh perMesh[];
 
+    static bool isVisible(const Frustum& frustum, const BoundingSphere* spheres, int count) {
+        uint8_t visible[CULLING_BATCH];
+
+        for (int i = 0; i < count; i += CULLING_BATCH) {
+            int batch = count - i < CULLING_BATCH ? count - i : CULLING_BATCH;
+
+            if (mnCullSpheres(frustum, &spheres[i], batch, visible) > 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    /*
+     * Visible when any instance is in front of the occluders.
+     */
+    static bool isUnoccluded(OcclusionBuffer& occlusionBuffer, const BoundingSphere* spheres, int count) {
+        for (int i = 0; i < count; i++) {
+            if (occlusionBuffer.isVisible(spheres[i]))
+                return true;
+        }
+
+        return false;
+    }
+
+    /*
+     * Visible when any instance of the mesh touches the frustum, a single mesh has
+     * the bounds of the whole model and needs no second test.
+     */
+    static bool isMeshVisible(ModelInstance* modelInstance, const Frustum& frustum, int mesh) {
+        if (modelInstance->model->meshCount == 1)
+            return true;
+
+        int instanceCount = modelInstance->instanceCount;
+
+        return isVisible(frustum, &modelInstance->meshBounds[mesh * instanceCount], instanceCount);
+    }
+
+    /*
+     * All instances are drawn with the finest LOD any of them needs.
+     */
+    static int selectLod(ModelInstance* modelInstance, RenderQueue& renderQueue, int mesh) {
+        Mesh* meshes = &modelInstance->model->meshes[mesh];
+
+        if (meshes->lodCount == 1)
+            return 0;
+
+        int instanceCount = modelInstance->instanceCount;
+        float screenSize = 0;
+
+        for (int i = 0; i < instanceCount; i++) {
+            float size = renderQueue.getScreenSize(modelInstance->meshBounds[mesh * instanceCount + i]);
+
+            screenSize = size > screenSize ? size : screenSize;
+        }
+
+        return Mesh::selectLod(meshes, screenSize);
+    }
+
+    /*
+     * The draw of the LOD the mesh needs. Clustered meshes of single instances
+     * placed with setTransform only draw the clusters inside the frustum that
+     * face the camera, nullptr when none of them does.
+     *
+     * The visible clusters are written in place to perMesh->clusterRanges and the
+     * returned draw reads them when the queue is sent, not when it is submitted.
+     * Cull each instance once per frame: drawing it into a second queue before the
+     * first is sent, a shadow pass for example, makes both draw the last cull.
+     */
+    static CommandBuffer* selectDraw(ModelInstance* modelInstance, RenderQueue& renderQueue, int mesh) {
+        PerMesh* perMesh = &modelInstance->perMesh[mesh];
+        int lod = selectLod(modelInstance, renderQueue, mesh);
+
+        if (lod > 0 || perMesh->clusterDraw == nullptr || !modelInstance->hasTransform)
+            return perMesh->draw[lod];
+
+        Mesh* meshes = &modelInstance->model->meshes[mesh];
+
+        perMesh->clusterRanges.count = mnCullClusters(meshes->clusters, meshes->clusterCount,
+                                                      modelInstance->matrices, renderQueue.getFrustum(),
+                                                      renderQueue.getCameraPosition(),
+                                                      perMesh->clusterRanges.offsets, perMesh->clusterRanges.counts);
+
+        return perMesh->clusterRanges.count > 0 ? perMesh->clusterDraw : nullptr;
+    }
+
+    /*
+     * Distance along the view direction used to sort the instance: the nearest
+     * point of the closest instance for opaque materials and the center of the
+     * farthest instance for translucent ones.
+     */
+    static float getViewDepth(ModelInstance* modelInstance, const float* view, bool translucent) {
+        float result = 0;
+
+        for (int i = 0; i < modelInstance->instanceCount; i++) {
+            BoundingSphere* bounds = &modelInstance->bounds[i];
+
+            float z = view[2]*bounds->center[0] + view[6]*bounds->center[1] + view[10]*bounds->center[2] + view[14];
+#if RIGHT_HANDED
+            float depth = -z;
+#else
+            float depth = z;
+#endif
+
+            if (translucent) {
+                if (i == 0 || depth > result)
+                    result = depth;
+            } else {
+                depth -= bounds->radius;
+
+                if (i == 0 || depth < result)
+                    result = depth;
+            }
+        }
+
+        return result;
+    }
+
+    /*
+     * Items submitted with the same key are drawn front-to-back for opaque materials
+     * and back-to-front for translucent ones after RenderQueue::sort(). Instances and
+     * meshes outside of the render queue frustum are not submitted, neither are
+     * instances hidden behind the occluders of its occlusion buffer.
+     */
     static void draw(ModelInstance* modelInstance, uint64_t key, RenderQueue& renderQueue, CommandBuffer* globalState) {
         Model* model = modelInstance->model;
+        const Frustum* frustum = renderQueue.getFrustum();
+        OcclusionBuffer* occlusionBuffer = renderQueue.getOcclusionBuffer();
+
+        if ((frustum != nullptr && !isVisible(*frustum, modelInstance->bounds, modelInstance->instanceCount)) ||
+            (occlusionBuffer != nullptr && !isUnoccluded(*occlusionBuffer, modelInstance->bounds, modelInstance->instanceCount))) {
+            for (int i = 0; i < model->meshCount; i++)
+                renderQueue.countCulled(modelInstance->perMesh[i].material->passCount);
+            return;
+        }
 
         for (int i = 0; i < model->meshCount; i++) {
             Material* material = modelInstance->perMesh[i].material;
-            CommandBuffer* draw = modelInstance->perMesh[i].draw;
+
+            if (frustum != nullptr && !isMeshVisible(modelInstance, *frustum, i)) {
+                renderQueue.countCulled(material->passCount);
+                continue;
+            }
+
+            CommandBuffer* draw = selectDraw(modelInstance, renderQueue, i);
+
+            if (draw == nullptr) {
+                renderQueue.countCulled(material->passCount);
+                continue;
+            }
+
+            float viewDepth = getViewDepth(modelInstance, renderQueue.getViewMatrix(), material->translucent);
+            uint32_t depth = RenderQueue::quantizeDepth(viewDepth, material->translucent, material->id);
 
             for (int j = 0; j < material->passCount; j++) {
                 CommandBuffer* commandBuffers[] = {
@@ -32,16 +187,37 @@ struct ModelInstance {
                         draw,
                 };
 
-                renderQueue.submit(key, commandBuffers, 5);
+                renderQueue.submit(key, depth, commandBuffers, 5);
             }
         }
     }
 
+    /*
+     * Keeps the submission order, multi pass techniques rely on it.
+     */
     static void drawNoMaterial(ModelInstance* modelInstance, uint64_t key, RenderQueue& renderQueue, CommandBuffer* globalState) {
         Model* model = modelInstance->model;
+        const Frustum* frustum = renderQueue.getFrustum();
+        OcclusionBuffer* occlusionBuffer = renderQueue.getOcclusionBuffer();
+
+        if ((frustum != nullptr && !isVisible(*frustum, modelInstance->bounds, modelInstance->instanceCount)) ||
+            (occlusionBuffer != nullptr && !isUnoccluded(*occlusionBuffer, modelInstance->bounds, modelInstance->instanceCount))) {
+            renderQueue.countCulled(model->meshCount);
+            return;
+        }
 
         for (int i = 0; i < model->meshCount; i++) {
-            CommandBuffer* draw = modelInstance->perMesh[i].draw;
+            if (frustum != nullptr && !isMeshVisible(modelInstance, *frustum, i)) {
+                renderQueue.countCulled(1);
+                continue;
+            }
+
+            CommandBuffer* draw = selectDraw(modelInstance, renderQueue, i);
+
+            if (draw == nullptr) {
+                renderQueue.countCulled(1);
+                continue;
+            }
 
             CommandBuffer* commandBuffers[] = {
                     globalState,
@@ -59,10 +235,25 @@ struct ModelInstance {
     }
 
     static ModelInstance* createInstanced(HeapAllocator& allocator, Model* model, int instanceCount, ConstantBuffer constantBuffer, int bindingPoint) {
-        size_t nbytes = sizeof(ModelInstance) + model->meshCount * sizeof(PerMesh);
+        int boundsCount = instanceCount * (model->meshCount + 1);
+        size_t nbytes = sizeof(ModelInstance) + model->meshCount * sizeof(PerMesh) + boundsCount * sizeof(BoundingSphere) +
+                        instanceCount * 16 * sizeof(float);
 
         ModelInstance* modelInstance = (ModelInstance*) allocator.allocate(nbytes);
 
+        modelInstance->bounds = (BoundingSphere*) &modelInstance->perMesh[model->meshCount];
+        modelInstance->meshBounds = &modelInstance->bounds[instanceCount];
+        modelInstance->matrices = (float*) &modelInstance->meshBounds[instanceCount * model->meshCount];
+        modelInstance->hasTransform = false;
+
+        //never culled until setBounds or setTransform
+        for (int i = 0; i < boundsCount; i++) {
+            modelInstance->bounds[i].center[0] = 0;
+            modelInstance->bounds[i].center[1] = 0;
+            modelInstance->bounds[i].center[2] = 0;
+            modelInstance->bounds[i].radius = INFINITY;
+        }
+
         modelInstance->state = CommandBuffer::create(allocator, 2);
         BindConstantBuffer::create(modelInstance->state, constantBuffer, bindingPoint);
         modelInstance->model = model;
@@ -70,17 +261,34 @@ struct ModelInstance {
 
         for (int i = 0; i < model->meshCount; i++) {
             modelInstance->perMesh[i].material = nullptr;
+            modelInstance->perMesh[i].clusterDraw = nullptr;
 
             Mesh* mesh = &model->meshes[i];
 
-            if(instanceCount > 1) {
-                modelInstance->perMesh[i].draw = CommandBuffer::create(allocator, 1);
-                if (model->hasIndices)
-                    DrawTrianglesInstanced::create(modelInstance->perMesh[i].draw, mesh->offset, mesh->count, instanceCount);
-                else
-                    DrawArraysInstanced::create(modelInstance->perMesh[i].draw, GL_TRIANGLES, mesh->offset, mesh->count, instanceCount);
-            } else {
-                modelInstance->perMesh[i].draw = mesh->draw;
+            //instanced draws can't skip clusters per instance
+            if (instanceCount == 1 && mesh->clusterCount > 0) {
+                DrawRanges* ranges = &modelInstance->perMesh[i].clusterRanges;
+                ranges->count = 0;
+                ranges->offsets = (int*) allocator.allocate(mesh->clusterCount * sizeof(int));
+                ranges->counts = (int*) allocator.allocate(mesh->clusterCount * sizeof(int));
+
+                modelInstance->perMesh[i].clusterDraw = CommandBuffer::create(allocator, 1);
+                MultiDrawTriangles::create(modelInstance->perMesh[i].clusterDraw, ranges, model->indexType);
+            }
+
+            for (int j = 0; j < mesh->lodCount; j++) {
+                MeshLod* lod = &mesh->lods[j];
+
+                if(instanceCount > 1) {
+                    modelInstance->perMesh[i].draw[j] = CommandBuffer::create(allocator, 1);
+                    if (model->hasIndices)
+                        DrawTrianglesInstanced::create(modelInstance->perMesh[i].draw[j], lod->offset, lod->count,
+                                                       model->indexType, instanceCount);
+                    else
+                        DrawArraysInstanced::create(modelInstance->perMesh[i].draw[j], GL_TRIANGLES, lod->offset, lod->count, instanceCount);
+                } else {
+                    modelInstance->perMesh[i].draw[j] = lod->draw;
+                }
             }
         }
 
@@ -89,9 +297,20 @@ struct ModelInstance {
 
     static void destroy(HeapAllocator& allocator, ModelInstance* modelInstance) {
         allocator.deallocate(modelInstance->state);
+        for(int i = 0; i < modelInstance->model->meshCount; i++) {
+            PerMesh* perMesh = &modelInstance->perMesh[i];
+
+            if(perMesh->clusterDraw != nullptr) {
+                CommandBuffer::destroy(allocator, perMesh->clusterDraw);
+                allocator.deallocate(perMesh->clusterRanges.offsets);
+                allocator.deallocate(perMesh->clusterRanges.counts);
+            }
+        }
         if(modelInstance->instanceCount > 1) {
-            for(int i = 0; i < modelInstance->model->meshCount; i++)
-                CommandBuffer::destroy(allocator, modelInstance->perMesh[i].draw);
+            for(int i = 0; i < modelInstance->model->meshCount; i++) {
+                for(int j = 0; j < modelInstance->model->meshes[i].lodCount; j++)
+                    CommandBuffer::destroy(allocator, modelInstance->perMesh[i].draw[j]);
+            }
         }
         allocator.deallocate(modelInstance);
     }
@@ -99,6 +318,40 @@ struct ModelInstance {
     static void setMaterial(ModelInstance* modelInstance, int index, Material* material) {
         modelInstance->perMesh[index].material = material;
     }
+
+    /*
+     * World bounds of the whole instance, every mesh gets the same sphere.
+     */
+    static void setBounds(ModelInstance* modelInstance, int instance, const float center[3], float radius) {
+        BoundingSphere* bounds = &modelInstance->bounds[instance];
+
+        bounds->center[0] = center[0];
+        bounds->center[1] = center[1];
+        bounds->center[2] = center[2];
+        bounds->radius = radius;
+
+        for (int i = 0; i < modelInstance->model->meshCount; i++)
+            modelInstance->meshBounds[i * modelInstance->instanceCount + instance] = *bounds;
+    }
+
+    /*
+     * World bounds derived from the model and mesh bounds, matrix is the one the
+     * instance is drawn with. The matrix is kept to cull the mesh clusters.
+     */
+    static void setTransform(ModelInstance* modelInstance, int instance, const float matrix[16]) {
+        Model* model = modelInstance->model;
+
+        memcpy(&modelInstance->matrices[instance * 16], matrix, 16 * sizeof(float));
+        modelInstance->hasTransform = true;
+
+        mnTransformSphere(model->sphere, matrix, modelInstance->bounds[instance]);
+
+        for (int i = 0; i < model->meshCount; i++) {
+            BoundingSphere& meshBounds = modelInstance->meshBounds[i * modelInstance->instanceCount + instance];
+
+            mnTransformSphere(model->meshes[i].sphere, matrix, meshBounds);
+        }
+    }
 };
 
 #endif //MODEL_INSTANCE_H
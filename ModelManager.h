@@ -10,152 +10,251 @@
 #include "Material.h"
 #include "ModelInstance.h"
 #include "Wavefront.h"
+#include "VertexPacking.h"
+#include "AssetLoader.h"
+#include "Simplify.h"
+#include "Cluster.h"
+#include "IndexOptimizer.h"
+#include "ResourceHandle.h"
+#include "AssetArchive.h"
+
+/*
+ * Post-transform cache behaviour of the full resolution indices, as generated or
+ * read from the file and as uploaded.
+ */
+struct IndexStatistics {
+    VertexCacheStatistics loaded;
+    VertexCacheStatistics optimized;
+};
 
-const int MAX_MODEL_NAME = 8;
-
+/*
+ * Models are named, procedural ones by the caller and Wavefront files by their
+ * path, and live in slots addressed by generational handles. Lookups by name,
+ * by handle and by Model* don't depend on how many models there are.
+ */
 class ModelManager {
 public:
-    ModelManager(HeapAllocator& allocator, Device& device) : allocator(allocator), device(device) {
-        modelCount = 0;
-        modelAllocated = 16;
+    ModelManager(HeapAllocator& allocator, Device& device)
+            : allocator(allocator), device(device), handles(allocator), nameIndex(allocator), modelIndex(allocator),
+              archive(nullptr) {
+        modelAllocated = handles.getCapacity();
         models = (Resource*) allocator.allocate(modelAllocated * sizeof(Resource));
     }
 
     ~ModelManager() {
-        assert(modelCount == 0);
+        assert(handles.getCount() == 0);
 
         allocator.deallocate(models);
     }
 
+    /*
+     * A model still being decoded is waited on.
+     */
     Model* findModel(const char* name) {
-        for(uint32_t i = 0; i < modelCount; i++) {
-            if(strncmp(models[i].name, name, MAX_MODEL_NAME) == 0) {
-                models[i].refs++;
-                return models[i].model;
-            }
-        }
-        return nullptr;
+        ResourceHandle handle = nameIndex.find(HandleIndex::hashPath(name), name);
+
+        if (handle == INVALID_HANDLE)
+            return nullptr;
+
+        uint32_t index = mnHandleSlot(handle);
+
+        if (models[index].loader != nullptr)
+            models[index].loader->wait(models[index].future);
+
+        models[index].refs++;
+        return models[index].model;
     }
 
-    Model* createSphere(const char* name, float size, int numberSlices) {
-        assert(strlen(name) <= MAX_MODEL_NAME);
+    /*
+     * INVALID_HANDLE when the model was not created here.
+     */
+    ResourceHandle getHandle(Model* model) {
+        return modelIndex.find((uintptr_t) model);
+    }
+
+    /*
+     * nullptr once the model is destroyed.
+     */
+    Model* getModel(ResourceHandle handle) {
+        if (!handles.isValid(handle))
+            return nullptr;
+
+        return models[mnHandleSlot(handle)].model;
+    }
 
-        uint32_t index = getSlot();
+    Model* createSphere(const char* name, float size, int numberSlices, IndexStatistics* statistics = nullptr) {
+        uint32_t index = getSlot(name);
 
         Shape shape;
 
         mnCreateSphere(size, numberSlices, shape);
 
-        VertexBuffer vertexBuffer = device.createStaticVertexBuffer(shape.numberVertices*sizeof(Vector3), shape.vertices);
-        VertexBuffer normalBuffer = device.createStaticVertexBuffer(shape.numberVertices*sizeof(Vector3), shape.normals);
-        VertexBuffer tangentBuffer = device.createStaticVertexBuffer(shape.numberVertices*sizeof(Vector3), shape.tangent);
-        VertexBuffer textureBuffer = device.createStaticVertexBuffer(shape.numberVertices*sizeof(Vector2), shape.texture);
-        IndexBuffer indexBuffer = device.createIndexBuffer(shape.numberIndices*sizeof(uint16_t), shape.indices);
+        MeshRange range;
+        range.clusterOffset = 0;
+        range.clusterCount = 0;
+        range.lodCount = 1;
+        range.offsets[0] = 0;
+        range.counts[0] = shape.numberIndices;
+        mnComputeBounds(shape.vertices, nullptr, 0, shape.numberVertices, range.box, range.sphere);
 
-        VertexDeclaration vertexDeclaration[4];
-        vertexDeclaration[0].buffer = vertexBuffer;
-        vertexDeclaration[0].format = VertexFloat3;
-        vertexDeclaration[0].offset = 0;
-        vertexDeclaration[0].stride = 0;
-
-        vertexDeclaration[1].buffer = textureBuffer;
-        vertexDeclaration[1].format = VertexFloat2;
-        vertexDeclaration[1].offset = 0;
-        vertexDeclaration[1].stride = 0;
-
-        vertexDeclaration[2].buffer = normalBuffer;
-        vertexDeclaration[2].format = VertexFloat3;
-        vertexDeclaration[2].offset = 0;
-        vertexDeclaration[2].stride = 0;
-
-        vertexDeclaration[3].buffer = tangentBuffer;
-        vertexDeclaration[3].format = VertexFloat3;
-        vertexDeclaration[3].offset = 0;
-        vertexDeclaration[3].stride = 0;
-
-        models[index].vertexBuffer[0] = vertexBuffer;
-        models[index].vertexBuffer[1] = textureBuffer;
-        models[index].vertexBuffer[2] = normalBuffer;
-        models[index].vertexBuffer[3] = tangentBuffer;
-        models[index].indexBuffer = indexBuffer;
-        models[index].vertexArray = device.createVertexArray(vertexDeclaration, 4, indexBuffer);
-        models[index].model = Model::create(allocator, models[index].vertexArray, 1);
-        strncpy(models[index].name, name, MAX_MODEL_NAME);
-        models[index].refs = 1;
+        if (statistics != nullptr)
+            mnAnalyzeVertexCache(allocator, shape.indices, shape.numberIndices, VERTEX_CACHE_SIZE, statistics->loaded);
+
+        int numberIndices = shape.numberIndices;
+        uint32_t* indices = createLods(allocator, shape.vertices, shape.numberVertices, shape.indices,
+                                       numberIndices, &range, 1);
+
+        optimizeIndices(allocator, shape.vertices, indices, &range, 1, nullptr);
+        optimizeVertexFetch(allocator, indices, numberIndices, shape.numberVertices, shape.vertices, shape.texture,
+                            shape.normals, shape.tangent, shape.bitangent);
+
+        if (statistics != nullptr)
+            mnAnalyzeVertexCache(allocator, indices, shape.numberIndices, VERTEX_CACHE_SIZE, statistics->optimized);
+
+        int indexType;
+        IndexBuffer indexBuffer = createIndexBuffer(device, allocator, shape.numberVertices, numberIndices, indices,
+                                                    indexType);
+        VertexBuffer vertexBuffer = createVertexBuffer(device, allocator, shape.numberVertices, shape.vertices,
+                                                       shape.texture, shape.normals, shape.tangent);
+
+        allocator.deallocate(indices);
+
+        createVertexArray(index, vertexBuffer, indexBuffer);
+
+        addModel(index, Model::create(allocator, models[index].vertexArray, 1, true, indexType));
 
-        Model::addMesh(allocator, models[index].model, 0, 0, shape.numberIndices);
+        addMeshes(allocator, models[index].model, &range, 1, nullptr);
 
         mnDestroyShape(shape);
 
         return models[index].model;
     }
 
-    Model* loadWavefront(const char* filename, bool forceNotIndexed = false) {
-        uint32_t index = getSlot();
+    /*
+     * Files cooked into the archive are loaded from it instead, the archive is
+     * only read while loading. nullptr goes back to the loose files.
+     */
+    void setArchive(AssetArchive* archive) {
+        this->archive = archive;
+    }
 
-        Wavefront obj;
+    /*
+     * A file already loaded is shared, statistics is only filled when the file is
+     * read. A cooked file is taken as it was cooked, forceNotIndexed included.
+     */
+    Model* loadWavefront(const char* filename, bool forceNotIndexed = false, IndexStatistics* statistics = nullptr) {
+        Model* model = findModel(filename);
 
-        mnLoadWavefront(allocator, filename, obj, forceNotIndexed);
+        if (model != nullptr)
+            return model;
 
-        WavefrontObject* currentObj = obj.objects;
+        const ArchiveEntry* entry = findCooked(filename);
 
-        VertexBuffer vertexBuffer = device.createStaticVertexBuffer(currentObj->numberVertices*sizeof(Vector3), currentObj->vertices);
-        VertexBuffer normalBuffer = device.createStaticVertexBuffer(currentObj->numberVertices*sizeof(Vector3), currentObj->normals);
-        VertexBuffer tangentBuffer = device.createStaticVertexBuffer(currentObj->numberVertices*sizeof(Vector3), currentObj->tangent);
-        VertexBuffer textureBuffer = device.createStaticVertexBuffer(currentObj->numberVertices*sizeof(Vector2), currentObj->texture);
-        IndexBuffer indexBuffer = {0};
+        if (entry != nullptr) {
+            uint32_t index = getSlot(filename);
+            addCooked(index, entry);
 
-        if (currentObj->numberIndices > 0) {
-            indexBuffer = device.createIndexBuffer(currentObj->numberIndices*sizeof(uint16_t), currentObj->indices);
+            return models[index].model;
         }
 
-        VertexDeclaration vertexDeclaration[4];
-        vertexDeclaration[0].buffer = vertexBuffer;
-        vertexDeclaration[0].format = VertexFloat3;
-        vertexDeclaration[0].offset = 0;
-        vertexDeclaration[0].stride = 0;
-
-        vertexDeclaration[1].buffer = textureBuffer;
-        vertexDeclaration[1].format = VertexFloat2;
-        vertexDeclaration[1].offset = 0;
-        vertexDeclaration[1].stride = 0;
-
-        vertexDeclaration[2].buffer = normalBuffer;
-        vertexDeclaration[2].format = VertexFloat3;
-        vertexDeclaration[2].offset = 0;
-        vertexDeclaration[2].stride = 0;
-
-        vertexDeclaration[3].buffer = tangentBuffer;
-        vertexDeclaration[3].format = VertexFloat3;
-        vertexDeclaration[3].offset = 0;
-        vertexDeclaration[3].stride = 0;
-
-        models[index].vertexBuffer[0] = vertexBuffer;
-        models[index].vertexBuffer[1] = textureBuffer;
-        models[index].vertexBuffer[2] = normalBuffer;
-        models[index].vertexBuffer[3] = tangentBuffer;
-        models[index].indexBuffer = indexBuffer;
-        models[index].vertexArray = device.createVertexArray(vertexDeclaration, 4, indexBuffer);
+        DecodedWavefront decoded;
+        decodeWavefront(allocator, filename, forceNotIndexed, decoded, statistics);
 
-        models[index].model = Model::create(allocator, models[index].vertexArray, currentObj->numberGroups, currentObj->numberIndices > 0);
-        strncpy(models[index].name, "venus", MAX_MODEL_NAME);
-        models[index].refs = 1;
+        VertexBuffer vertexBuffer;
+        IndexBuffer indexBuffer;
+        createBuffers(device, allocator, decoded, vertexBuffer, indexBuffer);
 
-        for(int i = 0; i < currentObj->numberGroups; i++) {
-            WavefrontGroup* currentGroup = &currentObj->groups[i];
+        uint32_t index = getSlot(filename);
+        addWavefront(index, vertexBuffer, indexBuffer, decoded);
 
-            Model::addMesh(allocator, models[index].model, i, currentGroup->startIndices, currentGroup->numberIndices);
+        return models[index].model;
+    }
+
+    /*
+     * Returns at once, the file is parsed and optimized on the loader workers and
+     * the model created when the loader finalizes it. getModel() is nullptr and
+     * the model can't be destroyed until then, future completes with it.
+     */
+    ResourceHandle loadWavefront(const char* filename, AssetLoader& loader, AssetFuture* future = nullptr,
+                                 bool forceNotIndexed = false) {
+        ResourceHandle handle = nameIndex.find(HandleIndex::hashPath(filename), filename);
+
+        if (handle != INVALID_HANDLE) {
+            models[mnHandleSlot(handle)].refs++;
+        } else if (findCooked(filename) != nullptr) {
+            //the future stays INVALID_HANDLE, which is done
+            handle = getHandle(loadWavefront(filename, forceNotIndexed));
+        } else {
+            uint32_t index = getSlot(filename);
+            handle = models[index].handle;
+
+            WavefrontRequest* request = (WavefrontRequest*) allocator.allocate(sizeof(WavefrontRequest));
+            request->manager = this;
+            request->filename = models[index].name;
+            request->forceNotIndexed = forceNotIndexed;
+            request->handle = handle;
+
+            models[index].loader = &loader;
+            models[index].future = loader.load(decodeWavefrontJob, finalizeWavefrontJob, request);
         }
 
-        mnDestroyWavefront(allocator, obj);
+        if (future != nullptr)
+            *future = models[mnHandleSlot(handle)].future;
 
-        return models[index].model;
+        return handle;
     }
 
-    Model* createQuad(const char* name) {
-        assert(strlen(name) <= MAX_MODEL_NAME);
+    /*
+     * Decodes the file like loadWavefront does and writes it to the archive.
+     */
+    static void cookWavefront(HeapAllocator& allocator, const char* filename, ArchiveWriter& writer) {
+        DecodedWavefront decoded;
+        decodeWavefront(allocator, filename, false, decoded, nullptr);
+
+        int numberClusters = 0;
+
+        for (int i = 0; i < decoded.numberGroups; i++)
+            numberClusters = std::max(numberClusters, decoded.groups[i].clusterOffset + decoded.groups[i].clusterCount);
+
+        size_t indexSize = decoded.indexType == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+        uint64_t verticesSize = decoded.numberVertices * sizeof(PackedVertex);
+        uint64_t indicesSize = decoded.numberIndices * indexSize;
+        uint64_t groupsSize = decoded.numberGroups * sizeof(MeshRange);
+        uint64_t clustersSize = numberClusters * sizeof(MeshCluster);
+
+        ArchiveMesh mesh = {};
+        mesh.numberVertices = decoded.numberVertices;
+        mesh.numberIndices = decoded.numberIndices;
+        mesh.indexType = decoded.indexType;
+        mesh.numberGroups = decoded.numberGroups;
+        mesh.numberClusters = numberClusters;
+        mesh.vertexSize = sizeof(PackedVertex);
+        mesh.groupSize = sizeof(MeshRange);
+        mesh.clusterSize = sizeof(MeshCluster);
+        mesh.verticesOffset = mnArchiveAlign(sizeof(ArchiveMesh));
+        mesh.indicesOffset = mnArchiveAlign(mesh.verticesOffset + verticesSize);
+        mesh.groupsOffset = mnArchiveAlign(mesh.indicesOffset + indicesSize);
+        mesh.clustersOffset = mnArchiveAlign(mesh.groupsOffset + groupsSize);
+
+        writer.beginEntry(filename, ARCHIVE_MESH);
+        writer.write(&mesh, sizeof(ArchiveMesh));
+        writer.write(decoded.vertices, verticesSize);
+        writer.write(decoded.indices, indicesSize);
+        writer.write(decoded.groups, groupsSize);
+        writer.write(decoded.clusters, clustersSize);
+        writer.endEntry();
+
+        allocator.deallocate(decoded.vertices);
+
+        if (decoded.indices != nullptr)
+            allocator.deallocate(decoded.indices);
+
+        free(decoded.groups);
+        free(decoded.clusters);
+    }
 
-        uint32_t index = getSlot();
+    Model* createQuad(const char* name) {
+        uint32_t index = getSlot(name);
 
         Vector3 vertex[] = {
                 -1.0, -1.0, 0.0,
@@ -183,61 +282,34 @@ public:
         };
         uint16_t indices[] = {0, 1, 3, 3, 1, 2};
 
-        VertexBuffer vertexBuffer = device.createStaticVertexBuffer(sizeof(vertex), vertex);
-        VertexBuffer textureBuffer = device.createStaticVertexBuffer(sizeof(texture), texture);
-        VertexBuffer normalBuffer = device.createStaticVertexBuffer(sizeof(normal), normal);
-        VertexBuffer tangentBuffer = device.createStaticVertexBuffer(sizeof(tangent), tangent);
         IndexBuffer indexBuffer = device.createIndexBuffer(sizeof(indices), indices);
+        VertexBuffer vertexBuffer = createVertexBuffer(device, allocator, 4, vertex, texture, normal, tangent);
 
-        VertexDeclaration vertexDeclaration[4] = {};
-        vertexDeclaration[0].buffer = vertexBuffer;
-        vertexDeclaration[0].format = VertexFloat3;
-        vertexDeclaration[0].offset = 0;
-        vertexDeclaration[0].stride = 0;
-
-        vertexDeclaration[1].buffer = textureBuffer;
-        vertexDeclaration[1].format = VertexFloat2;
-        vertexDeclaration[1].offset = 0;
-        vertexDeclaration[1].stride = 0;
-
-        vertexDeclaration[2].buffer = normalBuffer;
-        vertexDeclaration[2].format = VertexFloat3;
-        vertexDeclaration[2].offset = 0;
-        vertexDeclaration[2].stride = 0;
-
-        vertexDeclaration[3].buffer = tangentBuffer;
-        vertexDeclaration[3].format = VertexFloat3;
-        vertexDeclaration[3].offset = 0;
-        vertexDeclaration[3].stride = 0;
+        createVertexArray(index, vertexBuffer, indexBuffer);
 
+        addModel(index, Model::create(allocator, models[index].vertexArray, 1));
 
-        models[index].vertexBuffer[0] = vertexBuffer;
-        models[index].vertexBuffer[1] = textureBuffer;
-        models[index].vertexBuffer[2] = normalBuffer;
-        models[index].vertexBuffer[3] = tangentBuffer;
-        models[index].indexBuffer = indexBuffer;
-        models[index].vertexArray = device.createVertexArray(vertexDeclaration, 4, indexBuffer);
-        models[index].model = Model::create(allocator, models[index].vertexArray, 1);
-        strncpy(models[index].name, name, MAX_MODEL_NAME);
-        models[index].refs = 1;
+        BoundingBox box;
+        BoundingSphere sphere;
+        mnComputeBounds(vertex, nullptr, 0, 4, box, sphere);
 
-        Model::addMesh(allocator, models[index].model, 0, 0, 6);
+        Model::addMesh(allocator, models[index].model, 0, 0, 6, box, sphere);
 
         return models[index].model;
     }
 
     void destroyModel(Model* model) {
-        uint32_t index;
+        ResourceHandle handle = getHandle(model);
 
-        if (findModel(model, index))
-            destroy(index);
+        if (handle != INVALID_HANDLE)
+            destroy(handle);
     }
 
     ModelInstance* createModelInstance(Model* model, int instanceCount, ConstantBuffer constantBuffer, int bindingPoint) {
-        uint32_t index;
+        ResourceHandle handle = getHandle(model);
 
-        if (findModel(model, index)) {
-            models[index].refs++;
+        if (handle != INVALID_HANDLE) {
+            models[mnHandleSlot(handle)].refs++;
 
             if (instanceCount > 1)
                 return ModelInstance::createInstanced(allocator, model, instanceCount, constantBuffer, bindingPoint);
@@ -249,69 +321,551 @@ public:
     }
 
     void destroyModelInstance(ModelInstance* modelInstance) {
-        uint32_t index;
+        ResourceHandle handle = getHandle(modelInstance->model);
 
-        if (findModel(modelInstance->model, index)) {
-            destroy(index);
+        if (handle != INVALID_HANDLE) {
+            destroy(handle);
 
             ModelInstance::destroy(allocator, modelInstance);
         }
     }
 private:
     struct Resource {
-        char name[MAX_MODEL_NAME+1];
-        VertexBuffer vertexBuffer[4];
+        char* name; //allocated, the name index points to it
+        ResourceHandle handle;
+        VertexBuffer vertexBuffer;
         IndexBuffer indexBuffer;
         VertexArray vertexArray;
         Model* model;
         uint32_t refs;
+
+        //set while an AssetLoader is decoding the model
+        AssetLoader* loader;
+        AssetFuture future;
     };
 
-    void destroy(uint32_t index) {
-        models[index].refs--;
+    /*
+     * Indices are loaded as 32 bits and narrowed to 16 bits whenever every vertex
+     * can be addressed, so only meshes over 65536 vertices pay for the wider ones.
+     * Returns the indices to upload, allocated from allocator.
+     */
+    static void* packIndices(HeapAllocator& allocator, int numberVertices, int numberIndices,
+                             const uint32_t* indices, int& indexType) {
+        if (numberVertices > 65536) {
+            uint32_t* wide = (uint32_t*) allocator.allocate(numberIndices * sizeof(uint32_t));
+            memcpy(wide, indices, numberIndices * sizeof(uint32_t));
+
+            indexType = GL_UNSIGNED_INT;
+            return wide;
+        }
+
+        uint16_t* narrow = (uint16_t*) allocator.allocate(numberIndices * sizeof(uint16_t));
+
+        for (int i = 0; i < numberIndices; i++)
+            narrow[i] = (uint16_t) indices[i];
+
+        indexType = GL_UNSIGNED_SHORT;
+        return narrow;
+    }
+
+    static IndexBuffer createIndexBuffer(Device& device, HeapAllocator& allocator, int numberVertices, int numberIndices,
+                                         const uint32_t* indices, int& indexType) {
+        void* packed = packIndices(allocator, numberVertices, numberIndices, indices, indexType);
+        size_t indexSize = indexType == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+
+        IndexBuffer indexBuffer = device.createIndexBuffer(numberIndices * indexSize, packed);
+
+        allocator.deallocate(packed);
+
+        return indexBuffer;
+    }
+
+    /*
+     * Interleaves and quantizes the vertex attributes in a single buffer, see
+     * PackedVertex. Returns the vertices to upload, allocated from allocator.
+     */
+    static PackedVertex* packVertices(HeapAllocator& allocator, int numberVertices, const Vector3* vertices,
+                                      const Vector2* texture, const Vector3* normals, const Vector3* tangent) {
+        PackedVertex* packed = (PackedVertex*) allocator.allocate(numberVertices * sizeof(PackedVertex));
+
+        for (int i = 0; i < numberVertices; i++)
+            mnPackVertex(vertices[i].values, texture[i].values, normals[i].values, tangent[i].values, packed[i]);
+
+        return packed;
+    }
+
+    static VertexBuffer createVertexBuffer(Device& device, HeapAllocator& allocator, int numberVertices,
+                                           const Vector3* vertices, const Vector2* texture, const Vector3* normals,
+                                           const Vector3* tangent) {
+        PackedVertex* packed = packVertices(allocator, numberVertices, vertices, texture, normals, tangent);
+
+        VertexBuffer vertexBuffer = device.createStaticVertexBuffer(numberVertices * sizeof(PackedVertex), packed);
+
+        allocator.deallocate(packed);
+
+        return vertexBuffer;
+    }
+
+    /*
+     * The attribute locations stay 0 position, 1 texture, 2 normal and 3 tangent.
+     */
+    void createVertexArray(uint32_t index, VertexBuffer vertexBuffer, IndexBuffer indexBuffer) {
+        VertexDeclaration vertexDeclaration[4];
+        vertexDeclaration[0].buffer = vertexBuffer;
+        vertexDeclaration[0].format = VertexFloat3;
+        vertexDeclaration[0].offset = (void*) offsetof(PackedVertex, position);
+        vertexDeclaration[0].stride = sizeof(PackedVertex);
 
-        if (models[index].refs == 0) {
-            destroy(&models[index]);
+        vertexDeclaration[1].buffer = vertexBuffer;
+        vertexDeclaration[1].format = VertexHalf2;
+        vertexDeclaration[1].offset = (void*) offsetof(PackedVertex, texture);
+        vertexDeclaration[1].stride = sizeof(PackedVertex);
 
-            modelCount--;
-            std::swap(models[index], models[modelCount]);
+        vertexDeclaration[2].buffer = vertexBuffer;
+        vertexDeclaration[2].format = VertexSNorm1010102;
+        vertexDeclaration[2].offset = (void*) offsetof(PackedVertex, normal);
+        vertexDeclaration[2].stride = sizeof(PackedVertex);
+
+        vertexDeclaration[3].buffer = vertexBuffer;
+        vertexDeclaration[3].format = VertexSNorm1010102;
+        vertexDeclaration[3].offset = (void*) offsetof(PackedVertex, tangent);
+        vertexDeclaration[3].stride = sizeof(PackedVertex);
+
+        models[index].vertexBuffer = vertexBuffer;
+        models[index].indexBuffer = indexBuffer;
+        models[index].vertexArray = device.createVertexArray(vertexDeclaration, 4, indexBuffer);
+    }
+
+    struct MeshRange {
+        int clusterOffset; //into the array returned by createClusters
+        int clusterCount;
+        int lodCount;
+        int offsets[MAX_MESH_LODS];
+        int counts[MAX_MESH_LODS];
+        BoundingBox box;
+        BoundingSphere sphere;
+    };
+
+    /*
+     * One range per group with its full resolution indices and bounds. Without an
+     * index buffer the groups address the vertices directly.
+     */
+    static void getMeshRanges(WavefrontObject* object, MeshRange* ranges) {
+        for(int i = 0; i < object->numberGroups; i++) {
+            MeshRange& range = ranges[i];
+
+            range.clusterOffset = 0;
+            range.clusterCount = 0;
+            range.lodCount = 1;
+            range.offsets[0] = object->groups[i].startIndices;
+            range.counts[0] = object->groups[i].numberIndices;
+
+            mnComputeBounds(object->vertices, object->indices, range.offsets[0], range.counts[0],
+                            range.box, range.sphere);
+        }
+    }
+
+    /*
+     * Splits the full resolution range of every group of at least
+     * CLUSTER_MIN_TRIANGLES triangles into clusters, reordering its indices in
+     * place. Returns the clusters of every range, malloc'ed because it may change
+     * thread, or nullptr when no range was split.
+     */
+    static MeshCluster* createClusters(HeapAllocator& allocator, const Vector3* vertices, int numberVertices,
+                                       uint32_t* indices, MeshRange* ranges, int rangeCount) {
+        int maxClusters = 0;
+
+        for (int i = 0; i < rangeCount; i++) {
+            if (ranges[i].counts[0] / 3 >= CLUSTER_MIN_TRIANGLES)
+                maxClusters += ranges[i].counts[0] / 3;
+        }
+
+        if (maxClusters == 0)
+            return nullptr;
+
+        MeshCluster* clusters = (MeshCluster*) malloc(maxClusters * sizeof(MeshCluster));
+        int clusterCount = 0;
+
+        for (int i = 0; i < rangeCount; i++) {
+            MeshRange& range = ranges[i];
+
+            if (range.counts[0] / 3 < CLUSTER_MIN_TRIANGLES)
+                continue;
+
+            range.clusterOffset = clusterCount;
+            range.clusterCount = mnBuildClusters(allocator, vertices, numberVertices, indices, range.offsets[0],
+                                                 range.counts[0], &clusters[clusterCount]);
+
+            clusterCount += range.clusterCount;
+        }
+
+        return (MeshCluster*) realloc(clusters, clusterCount * sizeof(MeshCluster));
+    }
+
+    /*
+     * Returns a copy of indices followed by the LOD chain of every range, each level
+     * simplified from the previous one down to about half of its triangles. The
+     * chain stops when a level can't get below 3/4 of the previous one, usually
+     * because the rest of the vertices are on seams. numberIndices is updated to the
+     * size of the returned array.
+     */
+    static uint32_t* createLods(HeapAllocator& allocator, const Vector3* vertices, int numberVertices,
+                                const uint32_t* indices, int& numberIndices, MeshRange* ranges, int rangeCount) {
+        //every level is at most 3/4 of the previous one
+        int capacity = numberIndices * 4;
+        uint32_t* chain = (uint32_t*) allocator.allocate(capacity * sizeof(uint32_t));
+
+        memcpy(chain, indices, numberIndices * sizeof(uint32_t));
+
+        for (int i = 0; i < rangeCount; i++) {
+            MeshRange& range = ranges[i];
+
+            while (range.lodCount < MAX_MESH_LODS) {
+                const uint32_t* previous = &chain[range.offsets[range.lodCount - 1]];
+                int previousCount = range.counts[range.lodCount - 1];
+
+                //whole triangles only
+                int target = previousCount / 6 * 3;
+                int count = mnSimplifyMesh(allocator, vertices, numberVertices, previous, previousCount, target,
+                                           &chain[numberIndices]);
+
+                if (count == 0 || count > previousCount * 3 / 4)
+                    break;
+
+                range.offsets[range.lodCount] = numberIndices;
+                range.counts[range.lodCount] = count;
+                range.lodCount++;
+
+                numberIndices += count;
+            }
+        }
+
+        return chain;
+    }
+
+    /*
+     * Orders the triangles of every level of every range for the post-transform
+     * cache and then for overdraw. Clusters keep their place in the index buffer
+     * and only the triangles inside each one are ordered.
+     */
+    static void optimizeIndices(HeapAllocator& allocator, const Vector3* vertices, uint32_t* indices,
+                                const MeshRange* ranges, int rangeCount, const MeshCluster* clusters) {
+        for (int i = 0; i < rangeCount; i++) {
+            const MeshRange& range = ranges[i];
+
+            for (int j = 0; j < range.clusterCount; j++) {
+                const MeshCluster& cluster = clusters[range.clusterOffset + j];
+
+                mnOptimizeVertexCache(allocator, &indices[cluster.offset], cluster.count, VERTEX_CACHE_SIZE);
+            }
+
+            for (int j = range.clusterCount > 0 ? 1 : 0; j < range.lodCount; j++) {
+                uint32_t* level = &indices[range.offsets[j]];
+
+                mnOptimizeVertexCache(allocator, level, range.counts[j], VERTEX_CACHE_SIZE);
+                mnOptimizeOverdraw(allocator, vertices, level, range.counts[j], VERTEX_CACHE_SIZE,
+                                   OVERDRAW_THRESHOLD);
+            }
+        }
+    }
+
+    /*
+     * Renumbers the vertices in the order the indices use them and moves the
+     * attributes along, bitangent may be nullptr.
+     */
+    static void optimizeVertexFetch(HeapAllocator& allocator, uint32_t* indices, int numberIndices,
+                                    int numberVertices, Vector3* vertices, Vector2* texture, Vector3* normals,
+                                    Vector3* tangent, Vector3* bitangent) {
+        uint32_t* remap = (uint32_t*) allocator.allocate(numberVertices * sizeof(uint32_t));
+
+        mnOptimizeVertexFetch(indices, numberIndices, numberVertices, remap);
+
+        mnRemapVertices(allocator, vertices, sizeof(Vector3), numberVertices, remap);
+        mnRemapVertices(allocator, texture, sizeof(Vector2), numberVertices, remap);
+        mnRemapVertices(allocator, normals, sizeof(Vector3), numberVertices, remap);
+        mnRemapVertices(allocator, tangent, sizeof(Vector3), numberVertices, remap);
+
+        if (bitangent != nullptr)
+            mnRemapVertices(allocator, bitangent, sizeof(Vector3), numberVertices, remap);
+
+        allocator.deallocate(remap);
+    }
+
+    static void addMeshes(HeapAllocator& allocator, Model* model, const MeshRange* ranges, int rangeCount,
+                          const MeshCluster* clusters) {
+        for(int i = 0; i < rangeCount; i++) {
+            const MeshRange& range = ranges[i];
+
+            Model::addMesh(allocator, model, i, range.offsets[0], range.counts[0], range.box, range.sphere);
+
+            for (int j = 1; j < range.lodCount; j++)
+                Model::addLod(allocator, model, i, range.offsets[j], range.counts[j]);
+
+            if (range.clusterCount > 0)
+                Model::setClusters(allocator, model, i, &clusters[range.clusterOffset], range.clusterCount);
+        }
+    }
+
+    /*
+     * Everything a Wavefront model needs before the device is involved.
+     */
+    struct DecodedWavefront {
+        int numberVertices;
+        PackedVertex* vertices; //from the allocator given to decodeWavefront
+        int numberIndices;
+        void* indices;          //from that allocator too, nullptr without indices
+        int indexType;
+        int numberGroups;
+        MeshRange* groups;      //malloc'ed because it may change thread
+        MeshCluster* clusters;
+    };
+
+    /*
+     * Parses the file, then clusters, simplifies, orders and packs it. Runs on any
+     * thread.
+     */
+    static void decodeWavefront(HeapAllocator& allocator, const char* filename, bool forceNotIndexed,
+                                DecodedWavefront& decoded, IndexStatistics* statistics) {
+        Wavefront obj;
+
+        mnLoadWavefront(allocator, filename, obj, forceNotIndexed);
+
+        WavefrontObject* currentObj = obj.objects;
+
+        decoded.numberGroups = currentObj->numberGroups;
+        decoded.groups = (MeshRange*) malloc(currentObj->numberGroups * sizeof(MeshRange));
+        getMeshRanges(currentObj, decoded.groups);
+
+        decoded.numberIndices = 0;
+        decoded.indices = nullptr;
+        decoded.indexType = GL_UNSIGNED_SHORT;
+        decoded.clusters = nullptr;
+
+        if (currentObj->numberIndices > 0) {
+            if (statistics != nullptr)
+                mnAnalyzeVertexCache(allocator, currentObj->indices, currentObj->numberIndices, VERTEX_CACHE_SIZE,
+                                     statistics->loaded);
+
+            decoded.clusters = createClusters(allocator, currentObj->vertices, currentObj->numberVertices,
+                                              currentObj->indices, decoded.groups, currentObj->numberGroups);
+
+            int numberIndices = currentObj->numberIndices;
+            uint32_t* indices = createLods(allocator, currentObj->vertices, currentObj->numberVertices,
+                                           currentObj->indices, numberIndices, decoded.groups,
+                                           currentObj->numberGroups);
+
+            optimizeIndices(allocator, currentObj->vertices, indices, decoded.groups, currentObj->numberGroups,
+                            decoded.clusters);
+            optimizeVertexFetch(allocator, indices, numberIndices, currentObj->numberVertices, currentObj->vertices,
+                                currentObj->texture, currentObj->normals, currentObj->tangent,
+                                currentObj->bitangent);
+
+            if (statistics != nullptr)
+                mnAnalyzeVertexCache(allocator, indices, currentObj->numberIndices, VERTEX_CACHE_SIZE,
+                                     statistics->optimized);
+
+            decoded.numberIndices = numberIndices;
+            decoded.indices = packIndices(allocator, currentObj->numberVertices, numberIndices, indices,
+                                          decoded.indexType);
+
+            allocator.deallocate(indices);
+        }
+
+        decoded.numberVertices = currentObj->numberVertices;
+        decoded.vertices = packVertices(allocator, currentObj->numberVertices, currentObj->vertices,
+                                        currentObj->texture, currentObj->normals, currentObj->tangent);
+
+        mnDestroyWavefront(allocator, obj);
+    }
+
+    /*
+     * Uploads the vertices and indices of decoded and gives them back to allocator.
+     */
+    static void createBuffers(Device& device, HeapAllocator& allocator, DecodedWavefront& decoded,
+                              VertexBuffer& vertexBuffer, IndexBuffer& indexBuffer) {
+        indexBuffer = {0};
+
+        if (decoded.indices != nullptr) {
+            size_t indexSize = decoded.indexType == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+
+            indexBuffer = device.createIndexBuffer(decoded.numberIndices * indexSize, decoded.indices);
+
+            allocator.deallocate(decoded.indices);
+            decoded.indices = nullptr;
+        }
+
+        vertexBuffer = device.createStaticVertexBuffer(decoded.numberVertices * sizeof(PackedVertex),
+                                                       decoded.vertices);
+
+        allocator.deallocate(decoded.vertices);
+        decoded.vertices = nullptr;
+    }
+
+    /*
+     * Creates the vertex array and the model of slot index on the render thread.
+     */
+    void addWavefront(uint32_t index, VertexBuffer vertexBuffer, IndexBuffer indexBuffer,
+                      DecodedWavefront& decoded) {
+        createVertexArray(index, vertexBuffer, indexBuffer);
+
+        addModel(index, Model::create(allocator, models[index].vertexArray, decoded.numberGroups,
+                                      decoded.numberIndices > 0, decoded.indexType));
+
+        addMeshes(allocator, models[index].model, decoded.groups, decoded.numberGroups, decoded.clusters);
+
+        free(decoded.groups);
+        free(decoded.clusters);
+    }
+
+    const ArchiveEntry* findCooked(const char* filename) {
+        if (archive == nullptr)
+            return nullptr;
+
+        const ArchiveEntry* entry = archive->find(filename);
+
+        if (entry == nullptr || entry->type != ARCHIVE_MESH)
+            return nullptr;
+
+        //cooked by a build whose arrays don't match these
+        const ArchiveMesh* mesh = (const ArchiveMesh*) archive->getData(entry);
+
+        if (mesh->vertexSize != sizeof(PackedVertex) || mesh->groupSize != sizeof(MeshRange) ||
+            mesh->clusterSize != sizeof(MeshCluster))
+            return nullptr;
+
+        return entry;
+    }
+
+    /*
+     * The buffers are created straight from the mapped pages.
+     */
+    void addCooked(uint32_t index, const ArchiveEntry* entry) {
+        const uint8_t* blob = (const uint8_t*) archive->getData(entry);
+        const ArchiveMesh* mesh = (const ArchiveMesh*) blob;
+
+        IndexBuffer indexBuffer = {0};
+
+        if (mesh->numberIndices > 0) {
+            size_t indexSize = mesh->indexType == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+
+            indexBuffer = device.createIndexBuffer(mesh->numberIndices * indexSize, blob + mesh->indicesOffset);
+        }
+
+        VertexBuffer vertexBuffer = device.createStaticVertexBuffer(mesh->numberVertices * sizeof(PackedVertex),
+                                                                    blob + mesh->verticesOffset);
+
+        createVertexArray(index, vertexBuffer, indexBuffer);
+
+        addModel(index, Model::create(allocator, models[index].vertexArray, mesh->numberGroups,
+                                      mesh->numberIndices > 0, mesh->indexType));
+
+        const MeshCluster* clusters = nullptr;
+
+        if (mesh->numberClusters > 0)
+            clusters = (const MeshCluster*) (blob + mesh->clustersOffset);
+
+        addMeshes(allocator, models[index].model, (const MeshRange*) (blob + mesh->groupsOffset), mesh->numberGroups,
+                  clusters);
+    }
+
+    struct WavefrontRequest {
+        ModelManager* manager;
+        const char* filename;
+        bool forceNotIndexed;
+        ResourceHandle handle;
+
+        //filled on a worker
+        DecodedWavefront decoded;
+        VertexBuffer vertexBuffer;
+        IndexBuffer indexBuffer;
+    };
+
+    static void decodeWavefrontJob(HeapAllocator& allocator, void* data) {
+        WavefrontRequest* request = (WavefrontRequest*) data;
+
+        decodeWavefront(allocator, request->filename, request->forceNotIndexed, request->decoded, nullptr);
+    }
+
+    static void finalizeWavefrontJob(Device& device, HeapAllocator& allocator, void* data) {
+        WavefrontRequest* request = (WavefrontRequest*) data;
+        ModelManager* manager = request->manager;
+
+        createBuffers(device, allocator, request->decoded, request->vertexBuffer, request->indexBuffer);
+
+        uint32_t index = mnHandleSlot(request->handle);
+        manager->addWavefront(index, request->vertexBuffer, request->indexBuffer, request->decoded);
+        manager->models[index].loader = nullptr;
+
+        manager->allocator.deallocate(request);
+    }
+
+    void destroy(ResourceHandle handle) {
+        Resource& resource = models[mnHandleSlot(handle)];
+
+        resource.refs--;
+
+        if (resource.refs == 0) {
+            nameIndex.remove(HandleIndex::hashPath(resource.name), handle);
+            modelIndex.remove((uintptr_t) resource.model, handle);
+
+            destroy(&resource);
+            allocator.deallocate(resource.name);
+
+            handles.destroy(handle);
         }
     }
 
     void destroy(Resource* resource) {
         device.destroyVertexArray(resource->vertexArray);
-        device.destroyVertexBuffer(resource->vertexBuffer[0]);
-        device.destroyVertexBuffer(resource->vertexBuffer[1]);
-        device.destroyVertexBuffer(resource->vertexBuffer[2]);
-        device.destroyVertexBuffer(resource->vertexBuffer[3]);
+        device.destroyVertexBuffer(resource->vertexBuffer);
         device.destroyIndexBuffer(resource->indexBuffer);
         Model::destroy(allocator, resource->model);
     }
 
-    uint32_t getSlot() {
-        if(modelCount >= modelAllocated) {
-            modelAllocated = modelAllocated * 3 / 2;
+    /*
+     * New slot known by name, the model is added once it is created.
+     */
+    uint32_t getSlot(const char* name) {
+        ResourceHandle handle = handles.create();
+
+        if (handles.getCapacity() > modelAllocated) {
+            modelAllocated = handles.getCapacity();
             models = (Resource*) allocator.reallocate(models, modelAllocated * sizeof(Resource));
         }
-        return modelCount++;
+
+        uint32_t index = mnHandleSlot(handle);
+        size_t length = strlen(name);
+
+        models[index].name = (char*) allocator.allocate(length + 1);
+        memcpy(models[index].name, name, length + 1);
+        models[index].handle = handle;
+        models[index].model = nullptr;
+        models[index].refs = 1;
+        models[index].loader = nullptr;
+        models[index].future = INVALID_HANDLE;
+
+        nameIndex.insert(HandleIndex::hashPath(models[index].name), models[index].name, handle);
+
+        return index;
     }
 
-    bool findModel(Model* model, uint32_t& index) {
-        for (uint32_t i = 0; i < modelCount; i++) {
-            if (models[i].model == model) {
-                index = i;
-                return true;
-            }
-        }
-        return false;
+    void addModel(uint32_t index, Model* model) {
+        models[index].model = model;
+
+        modelIndex.insert((uintptr_t) model, nullptr, models[index].handle);
     }
 
     HeapAllocator& allocator;
     Device& device;
 
-    Resource* models;
-    uint32_t modelCount;
+    HandleAllocator handles;
+    HandleIndex nameIndex;
+    HandleIndex modelIndex; //by the Model* address
+
+    Resource* models; //by slot
     uint32_t modelAllocated;
+
+    AssetArchive* archive;
 };
 
 #endif //MODEL_MANAGER_H
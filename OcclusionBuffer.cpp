@@ -0,0 +1,576 @@
+#include "OcclusionBuffer.h"
+
+#include <math.h>
+#include <string.h>
+#include <float.h>
+#include <assert.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE 1
+#else
+#define OCCLUSION_SSE 0
+#endif
+
+/*
+ * Column major out = a * b.
+ */
+static void mnMultiply(const float a[16], const float b[16], float out[16]) {
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            out[col*4 + row] = a[0*4 + row] * b[col*4 + 0] +
+                               a[1*4 + row] * b[col*4 + 1] +
+                               a[2*4 + row] * b[col*4 + 2] +
+                               a[3*4 + row] * b[col*4 + 3];
+        }
+    }
+}
+
+static float mnClamp(float value, float min, float max) {
+    return value < min ? min : (value > max ? max : value);
+}
+
+OcclusionBuffer::OcclusionBuffer(HeapAllocator& allocator, int maxTriangles, int threadCount)
+        : allocator(allocator), occluderCount(0), triangleCount(0), maxTriangles(maxTriangles),
+          cullSpheres(nullptr), cullVisible(nullptr), cullCount(0), stage(STAGE_SETUP), generation(0),
+          pending(0) {
+    this->threadCount = threadCount < 1 ? 1 : (threadCount > OCCLUSION_MAX_THREADS ? OCCLUSION_MAX_THREADS : threadCount);
+
+    for (int i = 0; i < 16; i++)
+        viewProjection[i] = (i % 5) == 0 ? 1 : 0;
+
+    triangles = (OcclusionTriangle*) allocator.allocate(2 * maxTriangles * sizeof(OcclusionTriangle));
+
+    size_t size = OCCLUSION_WIDTH * OCCLUSION_HEIGHT;
+
+    for (int i = 1; i < OCCLUSION_LEVELS; i++)
+        size += 2 * (OCCLUSION_WIDTH >> i) * (OCCLUSION_HEIGHT >> i);
+
+    float* depths = (float*) allocator.allocate(size * sizeof(float));
+
+    farthest[0] = nearest[0] = depths;
+    depths += OCCLUSION_WIDTH * OCCLUSION_HEIGHT;
+
+    for (int i = 1; i < OCCLUSION_LEVELS; i++) {
+        int texels = (OCCLUSION_WIDTH >> i) * (OCCLUSION_HEIGHT >> i);
+
+        farthest[i] = depths;
+        nearest[i] = depths + texels;
+        depths += 2 * texels;
+    }
+
+    for (size_t i = 0; i < size; i++)
+        farthest[0][i] = 1;
+
+    for (int i = 1; i < this->threadCount; i++)
+        threads[i] = std::thread(&OcclusionBuffer::run, this, i);
+}
+
+OcclusionBuffer::~OcclusionBuffer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stage = STAGE_QUIT;
+        generation++;
+    }
+
+    condition.notify_all();
+
+    for (int i = 1; i < threadCount; i++)
+        threads[i].join();
+
+    allocator.deallocate(triangles);
+    allocator.deallocate(farthest[0]);
+}
+
+void OcclusionBuffer::begin(const float projection[16], const float view[16]) {
+    mnMultiply(projection, view, viewProjection);
+
+    occluderCount = 0;
+    triangleCount = 0;
+}
+
+void OcclusionBuffer::addOccluder(const Vector3* vertices, const uint32_t* indices, int count, const float model[16]) {
+    assert(occluderCount < OCCLUSION_MAX_OCCLUDERS);
+    assert(triangleCount + count / 3 <= maxTriangles);
+
+    Occluder& occluder = occluders[occluderCount++];
+    occluder.vertices = vertices;
+    occluder.indices = indices;
+    occluder.count = count;
+    occluder.firstTriangle = triangleCount;
+    mnMultiply(viewProjection, model, occluder.matrix);
+
+    triangleCount += count / 3;
+}
+
+void OcclusionBuffer::rasterize() {
+    execute(STAGE_SETUP);
+    execute(STAGE_SCAN);
+    buildHierarchy();
+}
+
+bool OcclusionBuffer::isVisible(const BoundingBox& box) {
+    const float* m = viewProjection;
+
+    //unbounded, the corners would project to inf or NaN
+    for (int i = 0; i < 3; i++) {
+        if (!isfinite(box.min[i]) || !isfinite(box.max[i]))
+            return true;
+    }
+
+    float minX = +FLT_MAX, minY = +FLT_MAX, minZ = +FLT_MAX;
+    float maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+    for (int i = 0; i < 8; i++) {
+        float x = (i & 1) ? box.max[0] : box.min[0];
+        float y = (i & 2) ? box.max[1] : box.min[1];
+        float z = (i & 4) ? box.max[2] : box.min[2];
+
+        float cx = m[0]*x + m[4]*y + m[8]*z + m[12];
+        float cy = m[1]*x + m[5]*y + m[9]*z + m[13];
+        float cz = m[2]*x + m[6]*y + m[10]*z + m[14];
+        float cw = m[3]*x + m[7]*y + m[11]*z + m[15];
+
+        if (cw <= 0 || cz < -cw)
+            return true;
+
+        float sx = cx / cw, sy = cy / cw, sz = cz / cw;
+
+        minX = sx < minX ? sx : minX;
+        maxX = sx > maxX ? sx : maxX;
+        minY = sy < minY ? sy : minY;
+        maxY = sy > maxY ? sy : maxY;
+        minZ = sz < minZ ? sz : minZ;
+    }
+
+    //every pixel the rectangle touches, not only the covered centers
+    int x0 = (int) floorf(mnClamp((minX * 0.5f + 0.5f) * OCCLUSION_WIDTH, -1, OCCLUSION_WIDTH));
+    int x1 = (int) floorf(mnClamp((maxX * 0.5f + 0.5f) * OCCLUSION_WIDTH, -1, OCCLUSION_WIDTH));
+    int y0 = (int) floorf(mnClamp((minY * 0.5f + 0.5f) * OCCLUSION_HEIGHT, -1, OCCLUSION_HEIGHT));
+    int y1 = (int) floorf(mnClamp((maxY * 0.5f + 0.5f) * OCCLUSION_HEIGHT, -1, OCCLUSION_HEIGHT));
+
+    if (x1 < 0 || y1 < 0 || x0 >= OCCLUSION_WIDTH || y0 >= OCCLUSION_HEIGHT || minZ > 1)
+        return false;
+
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 >= OCCLUSION_WIDTH ? OCCLUSION_WIDTH - 1 : x1;
+    y1 = y1 >= OCCLUSION_HEIGHT ? OCCLUSION_HEIGHT - 1 : y1;
+
+    //the coarsest level where the rectangle covers at most 2x2 texels
+    int level = 0;
+
+    while (level < OCCLUSION_LEVELS - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        level++;
+
+    return isRegionVisible(level, x0, y0, x1, y1, minZ);
+}
+
+bool OcclusionBuffer::isVisible(const BoundingSphere& sphere) {
+    //the default bounds of a ModelInstance, never culled
+    if (!isfinite(sphere.radius) || !isfinite(sphere.center[0]) || !isfinite(sphere.center[1]) ||
+        !isfinite(sphere.center[2]))
+        return true;
+
+    BoundingBox box;
+
+    for (int i = 0; i < 3; i++) {
+        box.min[i] = sphere.center[i] - sphere.radius;
+        box.max[i] = sphere.center[i] + sphere.radius;
+    }
+
+    return isVisible(box);
+}
+
+int OcclusionBuffer::cull(const BoundingSphere* spheres, int count, uint8_t* visible) {
+    if (count < OCCLUSION_PARALLEL_CULL || threadCount == 1) {
+        int visibleCount = 0;
+
+        for (int i = 0; i < count; i++) {
+            if (visible[i] && !isVisible(spheres[i]))
+                visible[i] = 0;
+
+            visibleCount += visible[i];
+        }
+
+        return visibleCount;
+    }
+
+    cullSpheres = spheres;
+    cullVisible = visible;
+    cullCount = count;
+
+    execute(STAGE_CULL);
+
+    int visibleCount = 0;
+
+    for (int i = 0; i < threadCount; i++)
+        visibleCount += cullVisibleCount[i];
+
+    return visibleCount;
+}
+
+const float* OcclusionBuffer::getDepth() {
+    return farthest[0];
+}
+
+void OcclusionBuffer::execute(Stage stage) {
+    if (threadCount == 1) {
+        work(stage, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->stage = stage;
+        generation++;
+        pending = threadCount - 1;
+    }
+
+    condition.notify_all();
+
+    //the calling thread takes the first share
+    work(stage, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return pending == 0; });
+}
+
+void OcclusionBuffer::run(int worker) {
+    uint32_t seen = 0;
+
+    while (true) {
+        Stage current;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this, seen]() { return generation != seen; });
+
+            seen = generation;
+            current = stage;
+        }
+
+        if (current == STAGE_QUIT)
+            break;
+
+        work(current, worker);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+        }
+
+        finished.notify_one();
+    }
+}
+
+void OcclusionBuffer::work(Stage stage, int worker) {
+    switch (stage) {
+    case STAGE_SETUP:
+        setup(worker);
+        break;
+    case STAGE_SCAN:
+        scan(worker);
+        break;
+    case STAGE_CULL: {
+        int begin = cullCount * worker / threadCount;
+        int end = cullCount * (worker + 1) / threadCount;
+        int visibleCount = 0;
+
+        for (int i = begin; i < end; i++) {
+            if (cullVisible[i] && !isVisible(cullSpheres[i]))
+                cullVisible[i] = 0;
+
+            visibleCount += cullVisible[i];
+        }
+
+        cullVisibleCount[worker] = visibleCount;
+        break;
+    }
+    case STAGE_QUIT:
+        break;
+    }
+}
+
+/*
+ * v holds screen x, y and NDC z of the corners.
+ */
+static void mnSetupTriangle(const float v0[3], const float v1[3], const float v2[3], OcclusionTriangle& triangle) {
+    float det = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+
+    triangle.minX = 1;
+    triangle.maxX = 0;
+
+    if (fabsf(det) < 1e-8f)
+        return;
+
+    //double sided, back facing triangles are turned around
+    if (det < 0) {
+        const float* tmp = v1;
+        v1 = v2;
+        v2 = tmp;
+        det = -det;
+    }
+
+    const float* v[3] = {v0, v1, v2};
+
+    float minX = v0[0], maxX = v0[0], minY = v0[1], maxY = v0[1];
+
+    for (int i = 1; i < 3; i++) {
+        minX = v[i][0] < minX ? v[i][0] : minX;
+        maxX = v[i][0] > maxX ? v[i][0] : maxX;
+        minY = v[i][1] < minY ? v[i][1] : minY;
+        maxY = v[i][1] > maxY ? v[i][1] : maxY;
+    }
+
+    //pixels whose centers are inside the bounds
+    triangle.minX = (int) ceilf(mnClamp(minX - 0.5f, -1, OCCLUSION_WIDTH));
+    triangle.maxX = (int) floorf(mnClamp(maxX - 0.5f, -1, OCCLUSION_WIDTH));
+    triangle.minY = (int) ceilf(mnClamp(minY - 0.5f, -1, OCCLUSION_HEIGHT));
+    triangle.maxY = (int) floorf(mnClamp(maxY - 0.5f, -1, OCCLUSION_HEIGHT));
+
+    triangle.minX = triangle.minX < 0 ? 0 : triangle.minX;
+    triangle.minY = triangle.minY < 0 ? 0 : triangle.minY;
+    triangle.maxX = triangle.maxX >= OCCLUSION_WIDTH ? OCCLUSION_WIDTH - 1 : triangle.maxX;
+    triangle.maxY = triangle.maxY >= OCCLUSION_HEIGHT ? OCCLUSION_HEIGHT - 1 : triangle.maxY;
+
+    if (triangle.minY > triangle.maxY)
+        triangle.maxX = triangle.minX - 1;
+
+    for (int i = 0; i < 3; i++) {
+        const float* a = v[i];
+        const float* b = v[(i + 1) % 3];
+
+        triangle.edgeA[i] = a[1] - b[1];
+        triangle.edgeB[i] = b[0] - a[0];
+        triangle.edgeC[i] = -(triangle.edgeA[i] * a[0] + triangle.edgeB[i] * a[1]);
+    }
+
+    float dz1 = v1[2] - v0[2], dz2 = v2[2] - v0[2];
+
+    triangle.depthA = (dz1 * (v2[1] - v0[1]) - dz2 * (v1[1] - v0[1])) / det;
+    triangle.depthB = (dz2 * (v1[0] - v0[0]) - dz1 * (v2[0] - v0[0])) / det;
+    triangle.depthC = v0[2] - triangle.depthA * v0[0] - triangle.depthB * v0[1];
+}
+
+void OcclusionBuffer::setup(int worker) {
+    int begin = triangleCount * worker / threadCount;
+    int end = triangleCount * (worker + 1) / threadCount;
+    int o = 0;
+
+    for (int t = begin; t < end; t++) {
+        while (t >= occluders[o].firstTriangle + occluders[o].count / 3)
+            o++;
+
+        const Occluder& occluder = occluders[o];
+        const uint32_t* indices = &occluder.indices[(t - occluder.firstTriangle) * 3];
+        const float* m = occluder.matrix;
+
+        float clip[3][4];
+
+        for (int i = 0; i < 3; i++) {
+            const Vector3& v = occluder.vertices[indices[i]];
+
+            clip[i][0] = m[0]*v.x + m[4]*v.y + m[8]*v.z + m[12];
+            clip[i][1] = m[1]*v.x + m[5]*v.y + m[9]*v.z + m[13];
+            clip[i][2] = m[2]*v.x + m[6]*v.y + m[10]*v.z + m[14];
+            clip[i][3] = m[3]*v.x + m[7]*v.y + m[11]*v.z + m[15];
+        }
+
+        //clipped against the near plane, z >= -w, a triangle becomes at most a quad
+        float polygon[4][4];
+        int vertexCount = 0;
+
+        for (int i = 0; i < 3; i++) {
+            const float* a = clip[i];
+            const float* b = clip[(i + 1) % 3];
+            float da = a[2] + a[3];
+            float db = b[2] + b[3];
+
+            if (da >= 0)
+                memcpy(polygon[vertexCount++], a, sizeof(polygon[0]));
+
+            if ((da >= 0) != (db >= 0)) {
+                float s = da / (da - db);
+
+                for (int j = 0; j < 4; j++)
+                    polygon[vertexCount][j] = a[j] + (b[j] - a[j]) * s;
+
+                vertexCount++;
+            }
+        }
+
+        OcclusionTriangle* out = &triangles[t * 2];
+        out[0].minX = out[1].minX = 1;
+        out[0].maxX = out[1].maxX = 0;
+
+        if (vertexCount < 3)
+            continue;
+
+        float screen[4][3];
+
+        for (int i = 0; i < vertexCount; i++) {
+            if (polygon[i][3] <= 1e-6f)
+                polygon[i][3] = 1e-6f;
+
+            float invW = 1 / polygon[i][3];
+
+            screen[i][0] = (polygon[i][0] * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+            screen[i][1] = (polygon[i][1] * invW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+            screen[i][2] = polygon[i][2] * invW;
+        }
+
+        mnSetupTriangle(screen[0], screen[1], screen[2], out[0]);
+
+        if (vertexCount == 4)
+            mnSetupTriangle(screen[0], screen[2], screen[3], out[1]);
+    }
+}
+
+void OcclusionBuffer::scan(int worker) {
+    int begin = OCCLUSION_HEIGHT * worker / threadCount;
+    int end = OCCLUSION_HEIGHT * (worker + 1) / threadCount;
+    float* depth = farthest[0];
+
+    for (int i = begin * OCCLUSION_WIDTH; i < end * OCCLUSION_WIDTH; i++)
+        depth[i] = 1;
+
+    for (int t = 0; t < triangleCount * 2; t++) {
+        const OcclusionTriangle& triangle = triangles[t];
+
+        if (triangle.minX > triangle.maxX)
+            continue;
+
+        int minY = triangle.minY > begin ? triangle.minY : begin;
+        int maxY = triangle.maxY < end - 1 ? triangle.maxY : end - 1;
+
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float* row = &depth[y * OCCLUSION_WIDTH];
+
+#if OCCLUSION_SSE
+            __m128 zero = _mm_setzero_ps();
+            __m128 step = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+
+            __m128 a0 = _mm_set1_ps(triangle.edgeA[0]);
+            __m128 a1 = _mm_set1_ps(triangle.edgeA[1]);
+            __m128 a2 = _mm_set1_ps(triangle.edgeA[2]);
+            __m128 c0 = _mm_set1_ps(triangle.edgeB[0] * py + triangle.edgeC[0]);
+            __m128 c1 = _mm_set1_ps(triangle.edgeB[1] * py + triangle.edgeC[1]);
+            __m128 c2 = _mm_set1_ps(triangle.edgeB[2] * py + triangle.edgeC[2]);
+            __m128 da = _mm_set1_ps(triangle.depthA);
+            __m128 dc = _mm_set1_ps(triangle.depthB * py + triangle.depthC);
+
+            //four pixels at a time, the row width is a multiple of 4
+            for (int x = triangle.minX & ~3; x <= triangle.maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float) x), step);
+
+                __m128 inside = _mm_and_ps(
+                        _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), c0), zero),
+                                   _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), c1), zero)),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), c2), zero));
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(da, px), dc);
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(current, z);
+
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+            }
+#else
+            for (int x = triangle.minX; x <= triangle.maxX; x++) {
+                float px = x + 0.5f;
+                bool inside = true;
+
+                for (int i = 0; i < 3; i++)
+                    inside &= triangle.edgeA[i] * px + triangle.edgeB[i] * py + triangle.edgeC[i] >= 0;
+
+                float z = triangle.depthA * px + triangle.depthB * py + triangle.depthC;
+
+                if (inside && z < row[x])
+                    row[x] = z;
+            }
+#endif
+        }
+    }
+}
+
+void OcclusionBuffer::buildHierarchy() {
+    for (int level = 1; level < OCCLUSION_LEVELS; level++) {
+        int width = OCCLUSION_WIDTH >> level;
+        int height = OCCLUSION_HEIGHT >> level;
+        int sourceWidth = width * 2;
+
+        const float* sourceFar = farthest[level - 1];
+        const float* sourceNear = nearest[level - 1];
+        float* far = farthest[level];
+        float* near = nearest[level];
+
+        for (int y = 0; y < height; y++) {
+            const float* far0 = &sourceFar[(y * 2 + 0) * sourceWidth];
+            const float* far1 = &sourceFar[(y * 2 + 1) * sourceWidth];
+            const float* near0 = &sourceNear[(y * 2 + 0) * sourceWidth];
+            const float* near1 = &sourceNear[(y * 2 + 1) * sourceWidth];
+            int x = 0;
+
+#if OCCLUSION_SSE
+            //eight texels of two rows become four
+            for (; x + 4 <= width; x += 4) {
+                __m128 f0 = _mm_max_ps(_mm_loadu_ps(far0 + x*2 + 0), _mm_loadu_ps(far1 + x*2 + 0));
+                __m128 f1 = _mm_max_ps(_mm_loadu_ps(far0 + x*2 + 4), _mm_loadu_ps(far1 + x*2 + 4));
+                __m128 n0 = _mm_min_ps(_mm_loadu_ps(near0 + x*2 + 0), _mm_loadu_ps(near1 + x*2 + 0));
+                __m128 n1 = _mm_min_ps(_mm_loadu_ps(near0 + x*2 + 4), _mm_loadu_ps(near1 + x*2 + 4));
+
+                _mm_storeu_ps(&far[y * width + x], _mm_max_ps(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                              _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1))));
+                _mm_storeu_ps(&near[y * width + x], _mm_min_ps(_mm_shuffle_ps(n0, n1, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                               _mm_shuffle_ps(n0, n1, _MM_SHUFFLE(3, 1, 3, 1))));
+            }
+#endif
+
+            for (; x < width; x++) {
+                float f = far0[x*2] > far0[x*2 + 1] ? far0[x*2] : far0[x*2 + 1];
+                f = far1[x*2] > f ? far1[x*2] : f;
+                f = far1[x*2 + 1] > f ? far1[x*2 + 1] : f;
+
+                float n = near0[x*2] < near0[x*2 + 1] ? near0[x*2] : near0[x*2 + 1];
+                n = near1[x*2] < n ? near1[x*2] : n;
+                n = near1[x*2 + 1] < n ? near1[x*2 + 1] : n;
+
+                far[y * width + x] = f;
+                near[y * width + x] = n;
+            }
+        }
+    }
+}
+
+/*
+ * x0, y0, x1 and y1 are the pixels of level 0, depth the nearest depth of the
+ * bounds. A texel only needs the level below when depth is between its nearest
+ * and farthest depths.
+ */
+bool OcclusionBuffer::isRegionVisible(int level, int x0, int y0, int x1, int y1, float depth) {
+    int width = OCCLUSION_WIDTH >> level;
+
+    for (int ty = y0 >> level; ty <= y1 >> level; ty++) {
+        for (int tx = x0 >> level; tx <= x1 >> level; tx++) {
+            if (depth > farthest[level][ty * width + tx])
+                continue;
+
+            if (level == 0 || depth <= nearest[level][ty * width + tx])
+                return true;
+
+            int cx0 = tx << level, cx1 = ((tx + 1) << level) - 1;
+            int cy0 = ty << level, cy1 = ((ty + 1) << level) - 1;
+
+            cx0 = x0 > cx0 ? x0 : cx0;
+            cx1 = x1 < cx1 ? x1 : cx1;
+            cy0 = y0 > cy0 ? y0 : cy0;
+            cy1 = y1 < cy1 ? y1 : cy1;
+
+            if (isRegionVisible(level - 1, cx0, cy0, cx1, cy1, depth))
+                return true;
+        }
+    }
+
+    return false;
+}
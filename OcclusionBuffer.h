@@ -0,0 +1,159 @@
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Vector.h"
+#include "Allocator.h"
+#include "Culling.h"
+
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+const int OCCLUSION_LEVELS = 8; //down to 2x1
+const int OCCLUSION_MAX_OCCLUDERS = 64;
+const int OCCLUSION_MAX_THREADS = 8;
+
+//fewer bounds than this are tested on the calling thread
+const int OCCLUSION_PARALLEL_CULL = 128;
+
+struct Occluder {
+    const Vector3* vertices;
+    const uint32_t* indices;
+    int count;
+    int firstTriangle;
+    float matrix[16]; //projection * view * model
+};
+
+/*
+ * Screen space triangle ready to be scanned, edge functions are positive inside
+ * and depth is the plane z = depthA * x + depthB * y + depthC. Empty when
+ * minX > maxX.
+ */
+struct OcclusionTriangle {
+    int minX, maxX, minY, maxY;
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+};
+
+/*
+ * Software occlusion culling. Occluders, a few big opaque meshes, are rasterized
+ * on the CPU into a small depth buffer from which a hierarchy of min/max depths
+ * is built. Bounds whose nearest point is behind the farthest occluder depth of
+ * the pixels they cover are hidden.
+ *
+ * Depths are NDC z, 1 is the far plane. Occluders are rasterized double sided
+ * and only the pixels whose centers they cover are written, so bounds are only
+ * ever rejected when they are really hidden.
+ *
+ * Nothing here touches the device. The triangle setup, the scan of the depth
+ * buffer and large cull requests are split between threadCount threads, the
+ * calling one included.
+ */
+class OcclusionBuffer {
+public:
+    /*
+     * maxTriangles is the sum of the triangles of the occluders of one frame.
+     */
+    OcclusionBuffer(HeapAllocator& allocator, int maxTriangles, int threadCount);
+
+    ~OcclusionBuffer();
+
+    /*
+     * Forgets the occluders of the last frame.
+     */
+    void begin(const float projection[16], const float view[16]);
+
+    /*
+     * Indexed triangles in model space, the arrays must live until rasterize().
+     */
+    void addOccluder(const Vector3* vertices, const uint32_t* indices, int count, const float model[16]);
+
+    /*
+     * Clears the depth buffer, draws every occluder added since begin() and
+     * builds the hierarchy.
+     */
+    void rasterize();
+
+    /*
+     * False when the box is hidden behind the occluders or out of the screen.
+     * Boxes crossing the near plane or not finite are always visible.
+     */
+    bool isVisible(const BoundingBox& box);
+
+    /*
+     * Tests the box around the sphere, an infinite radius is always visible.
+     */
+    bool isVisible(const BoundingSphere& sphere);
+
+    /*
+     * Clears visible[i] when spheres[i] is hidden, spheres with visible[i] already
+     * zero, culled by the frustum for instance, are skipped. Returns how many stay
+     * visible.
+     */
+    int cull(const BoundingSphere* spheres, int count, uint8_t* visible);
+
+    /*
+     * Depths of the last rasterize(), OCCLUSION_WIDTH * OCCLUSION_HEIGHT floats
+     * with the bottom row first.
+     */
+    const float* getDepth();
+private:
+    enum Stage {
+        STAGE_SETUP,
+        STAGE_SCAN,
+        STAGE_CULL,
+        STAGE_QUIT,
+    };
+
+    void execute(Stage stage);
+
+    void run(int worker);
+
+    void work(Stage stage, int worker);
+
+    void setup(int worker);
+
+    void scan(int worker);
+
+    void buildHierarchy();
+
+    bool isRegionVisible(int level, int x0, int y0, int x1, int y1, float depth);
+
+    HeapAllocator& allocator;
+
+    float viewProjection[16];
+
+    Occluder occluders[OCCLUSION_MAX_OCCLUDERS];
+    int occluderCount;
+    int triangleCount;
+    int maxTriangles;
+
+    OcclusionTriangle* triangles; //two per occluder triangle, a near clip may split it
+
+    /*
+     * Level 0 is the depth buffer, where both pointers are the same, every other
+     * level keeps the farthest and the nearest depth of 2x2 texels of the one
+     * below.
+     */
+    float* farthest[OCCLUSION_LEVELS];
+    float* nearest[OCCLUSION_LEVELS];
+
+    const BoundingSphere* cullSpheres;
+    uint8_t* cullVisible;
+    int cullCount;
+    int cullVisibleCount[OCCLUSION_MAX_THREADS];
+
+    int threadCount;
+    std::thread threads[OCCLUSION_MAX_THREADS];
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable finished;
+    Stage stage;
+    uint32_t generation; //bumped for every stage handed to the threads
+    int pending;
+};
+
+#endif //OCCLUSION_BUFFER_H
@@ -0,0 +1,214 @@
+#include "Profiler.h"
+
+#include <string.h>
+#include <chrono>
+
+Profiler* active_profiler = nullptr;
+
+const char* PROFILER_ROOT_SCOPE = "Frame";
+
+Profiler::Profiler(Device& device, HeapAllocator& allocator)
+        : device(device), allocator(allocator), currentFrame(0), frameCount(0), resolved(false),
+          stackDepth(0), chromeTrace(nullptr) {
+    frames = (ProfileFrame*) allocator.allocate((PROFILER_LATENCY + 1) * sizeof(ProfileFrame));
+    queries = (Query*) allocator.allocate(PROFILER_LATENCY * PROFILER_MAX_SCOPES * 2 * sizeof(Query));
+
+    memset(frames, 0, (PROFILER_LATENCY + 1) * sizeof(ProfileFrame));
+    memset(queries, 0, PROFILER_LATENCY * PROFILER_MAX_SCOPES * 2 * sizeof(Query));
+
+    //getTime() subtracts the epoch
+    epoch = 0;
+    epoch = getTime();
+
+    beginScope(PROFILER_ROOT_SCOPE);
+}
+
+Profiler::~Profiler() {
+    setChromeTrace(nullptr);
+
+    if (active_profiler == this)
+        active_profiler = nullptr;
+
+    for (int i = 0; i < PROFILER_LATENCY * PROFILER_MAX_SCOPES * 2; i++)
+        device.destroyQuery(queries[i]);
+
+    allocator.deallocate(queries);
+    allocator.deallocate(frames);
+}
+
+double Profiler::getTime() {
+    std::chrono::duration<double> time = std::chrono::steady_clock::now().time_since_epoch();
+
+    return time.count() - epoch;
+}
+
+void Profiler::beginScope(const char* name) {
+    ProfileFrame& frame = frames[currentFrame];
+
+    assert(stackDepth < PROFILER_MAX_SCOPES);
+
+    if (frame.scopeCount >= PROFILER_MAX_SCOPES) {
+        frame.droppedScopes++;
+        stack[stackDepth++] = -1;
+        return;
+    }
+
+    int index = frame.scopeCount++;
+    ProfileScope& scope = frame.scopes[index];
+
+    scope.name = name;
+    scope.depth = stackDepth;
+    scope.cpuBegin = getTime();
+
+    Query& query = queries[(currentFrame * PROFILER_MAX_SCOPES + index) * 2];
+
+    if (query.id == 0)
+        query = device.createTimestampQuery();
+
+    device.queryTimestamp(query);
+
+    stack[stackDepth++] = index;
+}
+
+void Profiler::endScope() {
+    assert(stackDepth > 0);
+
+    int index = stack[--stackDepth];
+
+    if (index == -1)
+        return;
+
+    ProfileScope& scope = frames[currentFrame].scopes[index];
+
+    Query& query = queries[(currentFrame * PROFILER_MAX_SCOPES + index) * 2 + 1];
+
+    if (query.id == 0)
+        query = device.createTimestampQuery();
+
+    device.queryTimestamp(query);
+
+    scope.cpuEnd = getTime();
+}
+
+void Profiler::endFrame() {
+    //only the root scope can be open
+    assert(stackDepth == 1);
+
+    endScope();
+
+    currentFrame = (currentFrame + 1) % PROFILER_LATENCY;
+    frameCount++;
+
+    ProfileFrame& frame = frames[currentFrame];
+
+    //the slot still holds the frame issued PROFILER_LATENCY frames ago
+    if (frame.scopeCount > 0)
+        resolveFrame(currentFrame);
+
+    frame.frame = frameCount;
+    frame.scopeCount = 0;
+    frame.droppedScopes = 0;
+    frame.gpuValid = false;
+
+    beginScope(PROFILER_ROOT_SCOPE);
+}
+
+void Profiler::resolveFrame(int index) {
+    ProfileFrame& frame = frames[index];
+    ProfileFrame& result = frames[PROFILER_LATENCY];
+
+    frame.gpuValid = true;
+
+    for (int i = 0; i < frame.scopeCount && frame.gpuValid; i++) {
+        ProfileScope& scope = frame.scopes[i];
+
+        uint64_t begin = 0;
+        uint64_t end = 0;
+
+        Query beginQuery = queries[(index * PROFILER_MAX_SCOPES + i) * 2];
+        Query endQuery = queries[(index * PROFILER_MAX_SCOPES + i) * 2 + 1];
+
+        //late queries are dropped rather than waited on, the CPU times are still kept
+        if (!device.getQueryResult(beginQuery, begin) || !device.getQueryResult(endQuery, end)) {
+            frame.gpuValid = false;
+            break;
+        }
+
+        scope.gpuBegin = begin * 1e-9;
+        scope.gpuEnd = end * 1e-9;
+    }
+
+    memcpy(&result, &frame, sizeof(ProfileFrame));
+    resolved = true;
+
+    if (chromeTrace != nullptr)
+        writeChromeTrace(result);
+}
+
+const ProfileFrame* Profiler::getResolvedFrame() {
+    return resolved ? &frames[PROFILER_LATENCY] : nullptr;
+}
+
+void Profiler::printSummary(FILE* stream) {
+    const ProfileFrame* frame = getResolvedFrame();
+
+    if (frame == nullptr)
+        return;
+
+    fprintf(stream, "frame %llu%s\n", (unsigned long long) frame->frame, frame->gpuValid ? "" : " (gpu not ready)");
+    fprintf(stream, "%-40s %10s %10s\n", "scope", "cpu ms", "gpu ms");
+
+    for (int i = 0; i < frame->scopeCount; i++) {
+        const ProfileScope& scope = frame->scopes[i];
+
+        char name[64];
+        snprintf(name, sizeof(name), "%*s%s", scope.depth * 2, "", scope.name);
+
+        double cpu = (scope.cpuEnd - scope.cpuBegin) * 1000.0;
+        double gpu = frame->gpuValid ? (scope.gpuEnd - scope.gpuBegin) * 1000.0 : 0;
+
+        fprintf(stream, "%-40s %10.3f %10.3f\n", name, cpu, gpu);
+    }
+
+    if (frame->droppedScopes > 0)
+        fprintf(stream, "%d scopes dropped\n", frame->droppedScopes);
+}
+
+void Profiler::setChromeTrace(FILE* stream) {
+    if (chromeTrace != nullptr)
+        fprintf(chromeTrace, "\n]\n");
+
+    chromeTrace = stream;
+
+    if (chromeTrace == nullptr)
+        return;
+
+    fprintf(chromeTrace, "[\n");
+    fprintf(chromeTrace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(chromeTrace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+}
+
+/*
+ * The CPU scopes go in thread 1 and the GPU scopes in thread 2. The GPU clock has
+ * its own origin, it is shifted so the root scope starts together on both.
+ */
+void Profiler::writeChromeTrace(const ProfileFrame& frame) {
+    for (int i = 0; i < frame.scopeCount; i++) {
+        const ProfileScope& scope = frame.scopes[i];
+
+        fprintf(chromeTrace, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                scope.name, scope.cpuBegin * 1e6, (scope.cpuEnd - scope.cpuBegin) * 1e6);
+    }
+
+    if (!frame.gpuValid || frame.scopeCount == 0)
+        return;
+
+    double offset = frame.scopes[0].cpuBegin - frame.scopes[0].gpuBegin;
+
+    for (int i = 0; i < frame.scopeCount; i++) {
+        const ProfileScope& scope = frame.scopes[i];
+
+        fprintf(chromeTrace, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f}",
+                scope.name, (scope.gpuBegin + offset) * 1e6, (scope.gpuEnd - scope.gpuBegin) * 1e6);
+    }
+}
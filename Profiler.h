@@ -0,0 +1,128 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+
+#include "Device.h"
+#include "Allocator.h"
+
+/*
+ * Build with -DPROFILING=0 to compile PROFILE_SCOPE out, ProfileBegin/ProfileEnd
+ * commands still run but do nothing while no profiler is active.
+ */
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+const int PROFILER_MAX_SCOPES = 256;
+
+/*
+ * GPU timestamps are read back this many frames after they were issued, by then
+ * the driver has normally finished them and the CPU never waits on a query.
+ */
+const int PROFILER_LATENCY = FRAMES_IN_FLIGHT + 1;
+
+struct ProfileScope {
+    const char* name;
+    int depth;
+    double cpuBegin; //seconds since the profiler was created
+    double cpuEnd;
+    double gpuBegin; //seconds, GPU clock
+    double gpuEnd;
+};
+
+struct ProfileFrame {
+    uint64_t frame;
+    int scopeCount;
+    int droppedScopes; //scopes past PROFILER_MAX_SCOPES
+    bool gpuValid;     //false when the queries were not ready in time
+    ProfileScope scopes[PROFILER_MAX_SCOPES];
+};
+
+/*
+ * Scopes nest and are timed on the CPU and, through a pair of timestamp queries,
+ * on the GPU. Every frame implicitly opens a root "Frame" scope.
+ */
+class Profiler {
+public:
+    Profiler(Device& device, HeapAllocator& allocator);
+
+    ~Profiler();
+
+    void beginScope(const char* name);
+
+    void endScope();
+
+    /*
+     * Closes the current frame and resolves the one issued PROFILER_LATENCY frames
+     * ago. Must be called outside of any scope, before Device::endFrame.
+     */
+    void endFrame();
+
+    /*
+     * Last frame with its GPU results read back, nullptr until the first one.
+     */
+    const ProfileFrame* getResolvedFrame();
+
+    /*
+     * One line per scope of the resolved frame, indented by depth.
+     */
+    void printSummary(FILE* stream);
+
+    /*
+     * Resolved frames are appended to stream as Chrome trace events, open it in
+     * chrome://tracing. The event array is closed when the stream is replaced or
+     * the profiler is destroyed.
+     */
+    void setChromeTrace(FILE* stream);
+private:
+    double getTime();
+
+    void resolveFrame(int index);
+
+    void writeChromeTrace(const ProfileFrame& frame);
+
+    Device& device;
+    HeapAllocator& allocator;
+
+    ProfileFrame* frames; //PROFILER_LATENCY in flight plus the resolved one
+    Query* queries;       //two per scope and frame, created on first use
+    int currentFrame;
+    uint64_t frameCount;
+    bool resolved;
+
+    int stack[PROFILER_MAX_SCOPES];
+    int stackDepth;
+
+    double epoch;
+
+    FILE* chromeTrace;
+};
+
+/*
+ * Target of PROFILE_SCOPE and of the ProfileBegin/ProfileEnd commands.
+ */
+extern Profiler* active_profiler;
+
+struct ProfileMarker {
+    ProfileMarker(const char* name) {
+        if (active_profiler != nullptr)
+            active_profiler->beginScope(name);
+    }
+
+    ~ProfileMarker() {
+        if (active_profiler != nullptr)
+            active_profiler->endScope();
+    }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+
+#if PROFILING
+#define PROFILE_SCOPE(name) ProfileMarker PROFILE_CONCAT(profileMarker, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) do { } while (0)
+#endif
+
+#endif //PROFILER_H
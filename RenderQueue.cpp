@@ -9,8 +9,16 @@ bool operator<(const RenderItem& i0, const RenderItem& i1) {
 }
 
 RenderQueue::RenderQueue(Device& device, HeapAllocator& allocator)
-        : device(device), allocator(allocator), itemsCount(0) {
+        : device(device), allocator(allocator), itemsCount(0), hasProjection(false), occlusionBuffer(nullptr),
+          executedCommands(0), skippedCommands(0) {
     items = (RenderItem*) allocator.allocate(sizeof(RenderItem) * 1024);
+
+    for (int i = 0; i < 16; i++)
+        viewMatrix[i] = (i % 5) == 0 ? 1 : 0;
+
+    cameraPosition[0] = cameraPosition[1] = cameraPosition[2] = 0;
+
+    resetStatistics();
 }
 
 RenderQueue::~RenderQueue() {
@@ -18,15 +26,115 @@ RenderQueue::~RenderQueue() {
 }
 
 void RenderQueue::submit(uint64_t key, CommandBuffer** commandBuffer, int commandBufferCount) {
-    items[itemsCount].key = key;
+    submit(key, 0, commandBuffer, commandBufferCount);
+}
+
+void RenderQueue::submit(uint64_t key, uint32_t depth, CommandBuffer** commandBuffer, int commandBufferCount) {
+    items[itemsCount].key = (key << SORT_KEY_DEPTH_BITS) | (depth & SORT_KEY_DEPTH_MASK);
     for (int i = 0; i < commandBufferCount; i++)
         items[itemsCount].commandBuffer[i] = commandBuffer[i];
     items[itemsCount].commandBufferCount = commandBufferCount;
     itemsCount++;
+
+    statistics.itemsSubmitted++;
 }
 
 void RenderQueue::sort() {
-    std::sort(items, items+itemsCount);
+    PROFILE_SCOPE("RenderQueue::sort");
+
+    //items with the same key keep the submission order
+    std::stable_sort(items, items+itemsCount);
+}
+
+void RenderQueue::setViewMatrix(const float view[16]) {
+    memcpy(viewMatrix, view, sizeof(viewMatrix));
+
+    //-transpose(rotation) * translation
+    for (int i = 0; i < 3; i++)
+        cameraPosition[i] = -(view[i*4 + 0]*view[12] + view[i*4 + 1]*view[13] + view[i*4 + 2]*view[14]);
+
+    if (hasProjection)
+        mnExtractFrustum(projectionMatrix, viewMatrix, frustum);
+}
+
+const float* RenderQueue::getViewMatrix() {
+    return viewMatrix;
+}
+
+const float* RenderQueue::getCameraPosition() {
+    return cameraPosition;
+}
+
+void RenderQueue::setProjectionMatrix(const float projection[16]) {
+    memcpy(projectionMatrix, projection, sizeof(projectionMatrix));
+    hasProjection = true;
+
+    mnExtractFrustum(projectionMatrix, viewMatrix, frustum);
+}
+
+const Frustum* RenderQueue::getFrustum() {
+    return hasProjection ? &frustum : nullptr;
+}
+
+void RenderQueue::setOcclusionBuffer(OcclusionBuffer* occlusionBuffer) {
+    this->occlusionBuffer = occlusionBuffer;
+}
+
+OcclusionBuffer* RenderQueue::getOcclusionBuffer() {
+    return occlusionBuffer;
+}
+
+void RenderQueue::countCulled(int items) {
+    statistics.itemsCulled += items;
+}
+
+float RenderQueue::getScreenSize(const BoundingSphere& bounds) {
+    if (!hasProjection)
+        return INFINITY;
+
+    const float* c = bounds.center;
+    float z = viewMatrix[2]*c[0] + viewMatrix[6]*c[1] + viewMatrix[10]*c[2] + viewMatrix[14];
+
+    //clip w, the view distance for perspective projections and 1 for orthographic ones
+    float w = projectionMatrix[11]*z + projectionMatrix[15];
+
+    if (w <= bounds.radius * fabsf(projectionMatrix[11]))
+        return INFINITY;
+
+    return bounds.radius * fabsf(projectionMatrix[5]) / w;
+}
+
+/*
+ * The bit pattern of a positive float grows with its value, so the top bits
+ * of the IEEE representation give an ordering that needs no near/far range.
+ */
+uint32_t RenderQueue::quantizeDepth(float depth, bool backToFront) {
+    if (!(depth > 0))
+        depth = 0;
+
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+
+    //drop the sign bit (always zero) and the low mantissa bits
+    uint32_t quantized = bits >> (32 - SORT_KEY_DEPTH_BITS - 1);
+
+    if (backToFront)
+        quantized = SORT_KEY_DEPTH_MASK - quantized;
+
+    return quantized & SORT_KEY_DEPTH_MASK;
+}
+
+uint32_t RenderQueue::quantizeDepth(float depth, bool backToFront, uint32_t stateId) {
+    uint32_t quantized = quantizeDepth(depth, backToFront);
+
+    if (backToFront || stateId == 0)
+        return quantized;
+
+    const int depthBits = SORT_KEY_DEPTH_BITS - SORT_KEY_STATE_BITS;
+
+    assert(stateId < (1u << SORT_KEY_STATE_BITS));
+
+    return (stateId << depthBits) | (quantized >> SORT_KEY_STATE_BITS);
 }
 
 CommandBuffer* RenderQueue::sendToCommandBuffer() {
@@ -49,6 +157,8 @@ CommandBuffer* RenderQueue::sendToCommandBuffer() {
 }
 
 void RenderQueue::sendToDevice() {
+    PROFILE_SCOPE("RenderQueue::sendToDevice");
+
     std::function<void(Command*)> exec = [this](Command* cmd) {
         invoke(cmd);
     };
@@ -64,6 +174,14 @@ int RenderQueue::getExecutedCommands() {
     return executedCommands;
 }
 
+const RenderQueueStatistics& RenderQueue::getStatistics() {
+    return statistics;
+}
+
+void RenderQueue::resetStatistics() {
+    memset(&statistics, 0, sizeof(statistics));
+}
+
 void RenderQueue::submit(std::function<void(Command*)> execute) {
     Command* previousCmd[COMMAND_MAX];
 
@@ -88,8 +206,10 @@ void RenderQueue::submit(std::function<void(Command*)> execute) {
                 if (isDirectCommand(id) || !previousCmd[id] || memcmp(previousCmd[id], cmd, size) != 0) {
                     execute(cmd);
                     previousCmd[id] = cmd;
+                    statistics.executedCommands[id]++;
                 } else {
                     skippedCommands++;
+                    statistics.skippedCommands[id]++;
                 }
             }
         }
@@ -10,14 +10,36 @@
 
 #include "Allocator.h"
 #include "Commands.h"
+#include "Culling.h"
+#include "OcclusionBuffer.h"
 #include "Device.h"
 
+/*
+ * The low SORT_KEY_DEPTH_BITS of every sort key hold the quantized view depth,
+ * the caller key goes in the bits above it.
+ */
+const int SORT_KEY_DEPTH_BITS = 24;
+const uint32_t SORT_KEY_DEPTH_MASK = (1 << SORT_KEY_DEPTH_BITS) - 1;
+
+/*
+ * Opaque items with a state id keep it in the top SORT_KEY_STATE_BITS of the
+ * depth bits, see quantizeDepth().
+ */
+const int SORT_KEY_STATE_BITS = 8;
+
 struct RenderItem {
     uint64_t key;
     int commandBufferCount;
     CommandBuffer* commandBuffer[16];
 };
 
+struct RenderQueueStatistics {
+    uint32_t itemsSubmitted;
+    uint32_t itemsCulled;
+    uint32_t executedCommands[COMMAND_MAX];
+    uint32_t skippedCommands[COMMAND_MAX];
+};
+
 struct RenderGroup {
     CommandBuffer* commandBuffer;
     int itemsCount;
@@ -32,6 +54,56 @@ public:
 
     void submit(uint64_t key, CommandBuffer** commandBuffer, int commandBufferCount);
 
+    void submit(uint64_t key, uint32_t depth, CommandBuffer** commandBuffer, int commandBufferCount);
+
+    void setViewMatrix(const float view[16]);
+
+    const float* getViewMatrix();
+
+    /*
+     * World space position of the view matrix, which must not scale.
+     */
+    const float* getCameraPosition();
+
+    /*
+     * Enables frustum culling in ModelInstance::draw, the planes follow both the
+     * projection and the view matrix.
+     */
+    void setProjectionMatrix(const float projection[16]);
+
+    /*
+     * nullptr until a projection matrix is set.
+     */
+    const Frustum* getFrustum();
+
+    /*
+     * Enables occlusion culling in ModelInstance::draw and InstanceBatcher, the
+     * buffer must be rasterized for the current frame. nullptr disables it.
+     */
+    void setOcclusionBuffer(OcclusionBuffer* occlusionBuffer);
+
+    OcclusionBuffer* getOcclusionBuffer();
+
+    void countCulled(int items);
+
+    /*
+     * Fraction of the viewport height covered by the sphere, infinite until a
+     * projection matrix is set or when the camera is inside the sphere.
+     */
+    float getScreenSize(const BoundingSphere& bounds);
+
+    /*
+     * Maps a view space distance to the depth bits of the sort key, nearest first
+     * or, when backToFront is set, farthest first.
+     */
+    static uint32_t quantizeDepth(float depth, bool backToFront);
+
+    /*
+     * Same as above, but front-to-back items with a non zero stateId are grouped
+     * by it first, items sharing a state are still sorted nearest first.
+     */
+    static uint32_t quantizeDepth(float depth, bool backToFront, uint32_t stateId);
+
     void sort();
 
     CommandBuffer* sendToCommandBuffer();
@@ -41,6 +113,10 @@ public:
     int getSkippedCommands();
 
     int getExecutedCommands();
+
+    const RenderQueueStatistics& getStatistics();
+
+    void resetStatistics();
 private:
     void submit(std::function<void(Command*)> execute);
 
@@ -53,8 +129,15 @@ private:
 
     int itemsCount;
     RenderItem* items;
+    float viewMatrix[16];
+    float cameraPosition[3];
+    float projectionMatrix[16];
+    bool hasProjection;
+    Frustum frustum;
+    OcclusionBuffer* occlusionBuffer;
     int executedCommands;
     int skippedCommands;
+    RenderQueueStatistics statistics;
 };
 
 #endif //RENDERQUEUE_H
@@ -0,0 +1,232 @@
+#include "RenderStatistics.h"
+
+#include <string.h>
+
+static const char* commandNames[] = {
+        "DRAW_ARRAYS",
+        "DRAW_ARRAYS_INSTANCED",
+        "DRAW_TRIANGLES",
+        "DRAW_TRIANGLES_INSTANCED",
+        "MULTI_DRAW_TRIANGLES",
+        "CLEAR_COLOR0",
+        "CLEAR_COLOR1",
+        "CLEAR_COLOR2",
+        "CLEAR_COLOR3",
+        "CLEAR_COLOR4",
+        "CLEAR_COLOR5",
+        "CLEAR_COLOR6",
+        "CLEAR_COLOR7",
+        "CLEAR_DEPTH_STENCIL",
+        "PROFILE_BEGIN",
+        "PROFILE_END",
+        "SET_VIEWPORT0",
+        "SET_VIEWPORT1",
+        "SET_VIEWPORT2",
+        "SET_VIEWPORT3",
+        "SET_SCISSOR0",
+        "SET_SCISSOR1",
+        "SET_SCISSOR2",
+        "SET_SCISSOR3",
+        "SET_DEPTH_TEST",
+        "SET_CULL_FACE",
+        "SET_BLEND0",
+        "SET_BLEND1",
+        "SET_BLEND2",
+        "SET_BLEND3",
+        "SET_BLEND4",
+        "SET_BLEND5",
+        "SET_BLEND6",
+        "SET_BLEND7",
+        "SET_DRAWBUFFERS",
+        "COPY_CONSTANT_BUFFER",
+        "BIND_CONSTANT_BUFFER",
+        "BIND_FRAMEBUFFER",
+        "BIND_VERTEX_ARRAY",
+        "BIND_PROGRAM",
+        "BIND_TEXTURE0",
+        "BIND_TEXTURE1",
+        "BIND_TEXTURE2",
+        "BIND_TEXTURE3",
+        "BIND_TEXTURE4",
+        "BIND_TEXTURE5",
+        "BIND_TEXTURE6",
+        "BIND_TEXTURE7",
+};
+
+static_assert(sizeof(commandNames) / sizeof(commandNames[0]) == COMMAND_MAX, "Missing command name");
+
+static const char* stateChangeNames[] = {
+        "program",
+        "vertex_array",
+        "framebuffer",
+        "texture",
+        "sampler",
+        "constant_buffer",
+        "viewport",
+        "depth_stencil",
+        "rasterizer",
+        "blend",
+        "drawbuffers",
+};
+
+static_assert(sizeof(stateChangeNames) / sizeof(stateChangeNames[0]) == STATE_CHANGE_MAX, "Missing state change name");
+
+RenderStatistics::RenderStatistics() : frameCount(0), exportHook(nullptr), exportUserData(nullptr) {
+    memset(history, 0, sizeof(history));
+}
+
+void RenderStatistics::endFrame(Device& device, RenderQueue& renderQueue, double frameTime) {
+    FrameStatistics& statistics = history[frameCount % STATISTICS_HISTORY_SIZE];
+
+    statistics.frame = frameCount;
+    statistics.frameTime = frameTime;
+    statistics.queue = renderQueue.getStatistics();
+    statistics.device = device.getStatistics();
+
+    renderQueue.resetStatistics();
+    device.resetStatistics();
+
+    frameCount++;
+
+    if (exportHook != nullptr)
+        exportHook(statistics, exportUserData);
+}
+
+const FrameStatistics& RenderStatistics::getFrame(int framesAgo) {
+    assert(framesAgo >= 0 && framesAgo < getFrameCount());
+
+    return history[(frameCount - 1 - framesAgo) % STATISTICS_HISTORY_SIZE];
+}
+
+int RenderStatistics::getFrameCount() {
+    return frameCount < STATISTICS_HISTORY_SIZE ? (int) frameCount : STATISTICS_HISTORY_SIZE;
+}
+
+void RenderStatistics::getAverage(FrameStatistics& average) {
+    memset(&average, 0, sizeof(average));
+
+    int count = getFrameCount();
+
+    if (count == 0)
+        return;
+
+    for (int i = 0; i < count; i++) {
+        const FrameStatistics& frame = getFrame(i);
+
+        average.frameTime += frame.frameTime;
+        average.queue.itemsSubmitted += frame.queue.itemsSubmitted;
+        average.queue.itemsCulled += frame.queue.itemsCulled;
+
+        for (int j = 0; j < COMMAND_MAX; j++) {
+            average.queue.executedCommands[j] += frame.queue.executedCommands[j];
+            average.queue.skippedCommands[j] += frame.queue.skippedCommands[j];
+        }
+
+        average.device.drawCalls += frame.device.drawCalls;
+        average.device.instancedDrawCalls += frame.device.instancedDrawCalls;
+        average.device.trianglesSubmitted += frame.device.trianglesSubmitted;
+        average.device.constantBufferBytesUploaded += frame.device.constantBufferBytesUploaded;
+        average.device.vertexBufferBytesUploaded += frame.device.vertexBufferBytesUploaded;
+
+        for (int j = 0; j < STATE_CHANGE_MAX; j++)
+            average.device.stateChanges[j] += frame.device.stateChanges[j];
+    }
+
+    average.frame = getFrame().frame;
+    average.frameTime /= count;
+    average.queue.itemsSubmitted /= count;
+    average.queue.itemsCulled /= count;
+
+    for (int j = 0; j < COMMAND_MAX; j++) {
+        average.queue.executedCommands[j] /= count;
+        average.queue.skippedCommands[j] /= count;
+    }
+
+    average.device.drawCalls /= count;
+    average.device.instancedDrawCalls /= count;
+    average.device.trianglesSubmitted /= count;
+    average.device.constantBufferBytesUploaded /= count;
+    average.device.vertexBufferBytesUploaded /= count;
+
+    for (int j = 0; j < STATE_CHANGE_MAX; j++)
+        average.device.stateChanges[j] /= count;
+}
+
+void RenderStatistics::setExportHook(FnExportStatistics exportHook, void* userData) {
+    this->exportHook = exportHook;
+    this->exportUserData = userData;
+}
+
+uint32_t RenderStatistics::getExecutedCommands(const FrameStatistics& statistics) {
+    uint32_t total = 0;
+
+    for (int i = 0; i < COMMAND_MAX; i++)
+        total += statistics.queue.executedCommands[i];
+
+    return total;
+}
+
+uint32_t RenderStatistics::getSkippedCommands(const FrameStatistics& statistics) {
+    uint32_t total = 0;
+
+    for (int i = 0; i < COMMAND_MAX; i++)
+        total += statistics.queue.skippedCommands[i];
+
+    return total;
+}
+
+uint32_t RenderStatistics::getStateChanges(const FrameStatistics& statistics) {
+    uint32_t total = 0;
+
+    for (int i = 0; i < STATE_CHANGE_MAX; i++)
+        total += statistics.device.stateChanges[i];
+
+    return total;
+}
+
+const char* RenderStatistics::getCommandName(int type) {
+    assert(type >= 0 && type < COMMAND_MAX);
+
+    return commandNames[type];
+}
+
+const char* RenderStatistics::getStateChangeName(int type) {
+    assert(type >= 0 && type < STATE_CHANGE_MAX);
+
+    return stateChangeNames[type];
+}
+
+void RenderStatistics::exportJson(const FrameStatistics& statistics, void* userData) {
+    FILE* stream = (FILE*) userData;
+
+    fprintf(stream, "{\"frame\":%llu,\"frameTime\":%f,\"items\":%u,\"culled\":%u",
+            (unsigned long long) statistics.frame, statistics.frameTime, statistics.queue.itemsSubmitted,
+            statistics.queue.itemsCulled);
+
+    fprintf(stream, ",\"drawCalls\":%u,\"instancedDrawCalls\":%u,\"triangles\":%llu",
+            statistics.device.drawCalls, statistics.device.instancedDrawCalls,
+            (unsigned long long) statistics.device.trianglesSubmitted);
+
+    fprintf(stream, ",\"constantBufferBytes\":%llu,\"vertexBufferBytes\":%llu",
+            (unsigned long long) statistics.device.constantBufferBytesUploaded,
+            (unsigned long long) statistics.device.vertexBufferBytesUploaded);
+
+    fprintf(stream, ",\"stateChanges\":{");
+    for (int i = 0; i < STATE_CHANGE_MAX; i++)
+        fprintf(stream, "%s\"%s\":%u", i > 0 ? "," : "", stateChangeNames[i], statistics.device.stateChanges[i]);
+    fprintf(stream, "}");
+
+    fprintf(stream, ",\"commands\":{");
+    bool first = true;
+    for (int i = 0; i < COMMAND_MAX; i++) {
+        uint32_t executed = statistics.queue.executedCommands[i];
+        uint32_t skipped = statistics.queue.skippedCommands[i];
+
+        if (executed == 0 && skipped == 0)
+            continue;
+
+        fprintf(stream, "%s\"%s\":[%u,%u]", first ? "" : ",", commandNames[i], executed, skipped);
+        first = false;
+    }
+    fprintf(stream, "}}\n");
+}
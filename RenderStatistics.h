@@ -0,0 +1,64 @@
+#ifndef RENDER_STATISTICS_H
+#define RENDER_STATISTICS_H
+
+#include <stdio.h>
+
+#include "Commands.h"
+#include "Device.h"
+#include "RenderQueue.h"
+
+const int STATISTICS_HISTORY_SIZE = 128;
+
+struct FrameStatistics {
+    uint64_t frame;
+    double frameTime;
+    RenderQueueStatistics queue;
+    DeviceStatistics device;
+};
+
+typedef void (* FnExportStatistics)(const FrameStatistics& statistics, void* userData);
+
+class RenderStatistics {
+public:
+    RenderStatistics();
+
+    /*
+     * Collects the counters accumulated by the device and the render queue since
+     * the previous call, stores them in the history and resets both sources.
+     */
+    void endFrame(Device& device, RenderQueue& renderQueue, double frameTime);
+
+    /*
+     * framesAgo = 0 is the last completed frame.
+     */
+    const FrameStatistics& getFrame(int framesAgo = 0);
+
+    int getFrameCount();
+
+    void getAverage(FrameStatistics& average);
+
+    void setExportHook(FnExportStatistics exportHook, void* userData);
+
+    static uint32_t getExecutedCommands(const FrameStatistics& statistics);
+
+    static uint32_t getSkippedCommands(const FrameStatistics& statistics);
+
+    static uint32_t getStateChanges(const FrameStatistics& statistics);
+
+    static const char* getCommandName(int type);
+
+    static const char* getStateChangeName(int type);
+
+    /*
+     * Writes one JSON object per line, userData must be a FILE*.
+     */
+    static void exportJson(const FrameStatistics& statistics, void* userData);
+private:
+    FrameStatistics history[STATISTICS_HISTORY_SIZE];
+    uint64_t frameCount;
+
+    FnExportStatistics exportHook;
+    void* exportUserData;
+};
+
+#endif //RENDER_STATISTICS_H
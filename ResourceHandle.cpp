@@ -0,0 +1,178 @@
+#include "ResourceHandle.h"
+
+#include <string.h>
+
+//entries removed from the index keep the probe chains through them intact
+const ResourceHandle HANDLE_TOMBSTONE = 0xffffffff;
+
+HandleAllocator::HandleAllocator(HeapAllocator& allocator) : allocator(allocator) {
+    freeCount = 0;
+    slotCount = 0;
+    slotAllocated = 16;
+    generations = (uint16_t*) allocator.allocate(slotAllocated * sizeof(uint16_t));
+    freeSlots = (uint32_t*) allocator.allocate(slotAllocated * sizeof(uint32_t));
+}
+
+HandleAllocator::~HandleAllocator() {
+    allocator.deallocate(generations);
+    allocator.deallocate(freeSlots);
+}
+
+ResourceHandle HandleAllocator::create() {
+    uint32_t slot;
+
+    if (freeCount > 0) {
+        slot = freeSlots[--freeCount];
+    } else {
+        assert(slotCount < HANDLE_MAX_SLOTS);
+
+        if (slotCount >= slotAllocated) {
+            slotAllocated = slotAllocated * 3 / 2;
+            generations = (uint16_t*) allocator.reallocate(generations, slotAllocated * sizeof(uint16_t));
+            freeSlots = (uint32_t*) allocator.reallocate(freeSlots, slotAllocated * sizeof(uint32_t));
+        }
+
+        slot = slotCount++;
+        generations[slot] = 1;
+    }
+
+    return ((uint32_t) generations[slot] << HANDLE_SLOT_BITS) | slot;
+}
+
+void HandleAllocator::destroy(ResourceHandle handle) {
+    assert(isValid(handle));
+
+    uint32_t slot = mnHandleSlot(handle);
+
+    //0 is skipped when the generation wraps so no handle is ever 0
+    generations[slot] = (uint16_t) ((generations[slot] & HANDLE_GENERATION_MASK) + 1);
+
+    if (generations[slot] > HANDLE_GENERATION_MASK)
+        generations[slot] = 1;
+
+    freeSlots[freeCount++] = slot;
+}
+
+bool HandleAllocator::isValid(ResourceHandle handle) {
+    uint32_t slot = mnHandleSlot(handle);
+
+    return handle != INVALID_HANDLE && slot < slotCount && generations[slot] == handle >> HANDLE_SLOT_BITS;
+}
+
+uint32_t HandleAllocator::getCapacity() {
+    return slotAllocated;
+}
+
+uint32_t HandleAllocator::getCount() {
+    return slotCount - freeCount;
+}
+
+/*
+ * Spreads small integer keys, like texture names, over the whole table.
+ */
+static uint32_t mnMixKey(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+
+    return (uint32_t) key;
+}
+
+HandleIndex::HandleIndex(HeapAllocator& allocator) : allocator(allocator) {
+    capacity = 64;
+    used = 0;
+    entries = (Entry*) allocator.allocate(capacity * sizeof(Entry));
+    memset(entries, 0, capacity * sizeof(Entry));
+}
+
+HandleIndex::~HandleIndex() {
+    allocator.deallocate(entries);
+}
+
+uint64_t HandleIndex::hashPath(const char* path) {
+    //FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+
+    for (const char* c = path; *c != 0; c++) {
+        hash ^= (uint8_t) *c;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+ResourceHandle HandleIndex::find(uint64_t key, const char* path) {
+    uint32_t mask = capacity - 1;
+
+    for (uint32_t i = mnMixKey(key) & mask; entries[i].handle != INVALID_HANDLE; i = (i + 1) & mask) {
+        const Entry& entry = entries[i];
+
+        if (entry.handle == HANDLE_TOMBSTONE || entry.key != key)
+            continue;
+
+        if (path == nullptr || (entry.path != nullptr && strcmp(entry.path, path) == 0))
+            return entry.handle;
+    }
+
+    return INVALID_HANDLE;
+}
+
+void HandleIndex::insert(uint64_t key, const char* path, ResourceHandle handle) {
+    assert(handle != INVALID_HANDLE && handle != HANDLE_TOMBSTONE);
+
+    //at most 3/4 full, counting the removed entries
+    if ((used + 1) * 4 > capacity * 3)
+        grow();
+
+    uint32_t mask = capacity - 1;
+    uint32_t i = mnMixKey(key) & mask;
+
+    while (entries[i].handle != INVALID_HANDLE && entries[i].handle != HANDLE_TOMBSTONE)
+        i = (i + 1) & mask;
+
+    if (entries[i].handle == INVALID_HANDLE)
+        used++;
+
+    entries[i].key = key;
+    entries[i].path = path;
+    entries[i].handle = handle;
+}
+
+void HandleIndex::remove(uint64_t key, ResourceHandle handle) {
+    uint32_t mask = capacity - 1;
+
+    for (uint32_t i = mnMixKey(key) & mask; entries[i].handle != INVALID_HANDLE; i = (i + 1) & mask) {
+        if (entries[i].handle == handle && entries[i].key == key) {
+            entries[i].handle = HANDLE_TOMBSTONE;
+            return;
+        }
+    }
+}
+
+/*
+ * Rehashes the live entries, doubling the table only when they fill half of it.
+ */
+void HandleIndex::grow() {
+    Entry* old = entries;
+    uint32_t oldCapacity = capacity;
+    uint32_t live = 0;
+
+    for (uint32_t i = 0; i < oldCapacity; i++) {
+        if (old[i].handle != INVALID_HANDLE && old[i].handle != HANDLE_TOMBSTONE)
+            live++;
+    }
+
+    while (live * 2 >= capacity)
+        capacity *= 2;
+
+    entries = (Entry*) allocator.allocate(capacity * sizeof(Entry));
+    memset(entries, 0, capacity * sizeof(Entry));
+    used = 0;
+
+    for (uint32_t i = 0; i < oldCapacity; i++) {
+        if (old[i].handle != INVALID_HANDLE && old[i].handle != HANDLE_TOMBSTONE)
+            insert(old[i].key, old[i].path, old[i].handle);
+    }
+
+    allocator.deallocate(old);
+}
@@ -0,0 +1,102 @@
+#ifndef RESOURCE_HANDLE_H
+#define RESOURCE_HANDLE_H
+
+#include <stdint.h>
+
+#include "Allocator.h"
+
+/*
+ * Handles are the slot of the resource in the low HANDLE_SLOT_BITS and the
+ * generation of the slot above them. Destroying a resource bumps the generation
+ * of its slot, so handles kept around after that stop resolving instead of
+ * reaching whatever reuses the slot. 0 is never a valid handle.
+ */
+typedef uint32_t ResourceHandle;
+
+const ResourceHandle INVALID_HANDLE = 0;
+
+const int HANDLE_SLOT_BITS = 20;
+const uint32_t HANDLE_SLOT_MASK = (1 << HANDLE_SLOT_BITS) - 1;
+const uint32_t HANDLE_GENERATION_MASK = (1 << (32 - HANDLE_SLOT_BITS)) - 1;
+
+//the last slot is never handed out, no handle has every bit set
+const uint32_t HANDLE_MAX_SLOTS = HANDLE_SLOT_MASK;
+
+inline uint32_t mnHandleSlot(ResourceHandle handle) {
+    return handle & HANDLE_SLOT_MASK;
+}
+
+/*
+ * Hands out handles and recycles the slots of destroyed ones. The managers keep
+ * their resources in arrays of getCapacity() entries indexed by mnHandleSlot().
+ */
+class HandleAllocator {
+public:
+    HandleAllocator(HeapAllocator& allocator);
+
+    ~HandleAllocator();
+
+    ResourceHandle create();
+
+    void destroy(ResourceHandle handle);
+
+    /*
+     * True while the resource the handle was created for is alive.
+     */
+    bool isValid(ResourceHandle handle);
+
+    uint32_t getCapacity();
+
+    uint32_t getCount();
+private:
+    HeapAllocator& allocator;
+
+    uint16_t* generations;
+    uint32_t* freeSlots;
+    uint32_t freeCount;
+    uint32_t slotCount;
+    uint32_t slotAllocated;
+};
+
+/*
+ * Open addressed hash table from a 64 bit key to a handle, with linear probing.
+ * Assets are found by the hash of their path, which is compared as well so two
+ * paths with the same hash don't get mixed up, other resources by any unique
+ * integer with a nullptr path.
+ */
+class HandleIndex {
+public:
+    HandleIndex(HeapAllocator& allocator);
+
+    ~HandleIndex();
+
+    static uint64_t hashPath(const char* path);
+
+    /*
+     * INVALID_HANDLE when nothing was inserted with the key and path.
+     */
+    ResourceHandle find(uint64_t key, const char* path = nullptr);
+
+    /*
+     * The path is not copied, it must live until the entry is removed.
+     */
+    void insert(uint64_t key, const char* path, ResourceHandle handle);
+
+    void remove(uint64_t key, ResourceHandle handle);
+private:
+    struct Entry {
+        uint64_t key;
+        const char* path;
+        ResourceHandle handle; //INVALID_HANDLE when empty
+    };
+
+    void grow();
+
+    HeapAllocator& allocator;
+
+    Entry* entries;
+    uint32_t capacity; //power of two
+    uint32_t used;     //live and removed entries, both lengthen the probes
+};
+
+#endif //RESOURCE_HANDLE_H
@@ -15,7 +15,7 @@ struct Shape {
     Vector3* tangent;
     Vector3* bitangent;
     Vector2* texture;
-    uint16_t* indices;
+    uint32_t* indices;
 };
 
 void mnCreateSphere(float size, int numberSlices, Shape& shape) {
@@ -33,7 +33,7 @@ void mnCreateSphere(float size, int numberSlices, Shape& shape) {
     shape.tangent = (Vector3*)malloc(sizeof(Vector3) * numberVertices);
     shape.bitangent = (Vector3*)malloc(sizeof(Vector3) * numberVertices);
     shape.texture = (Vector2*)malloc(sizeof(Vector2) * numberVertices);
-    shape.indices = (uint16_t*)malloc(sizeof(uint16_t) * numberIndices);
+    shape.indices = (uint32_t*)malloc(sizeof(uint32_t) * numberIndices);
 
     for (int i = 0; i < numberParallels + 1; i++) {
         for (int j = 0; j < numberSlices + 1; j++) {
@@ -0,0 +1,271 @@
+#include "Simplify.h"
+
+#include <string.h>
+#include <algorithm>
+
+/*
+ * Symmetric 4x4 matrix, sum of the squared distances to a set of planes.
+ */
+struct Quadric {
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+};
+
+struct Collapse {
+    float cost;
+    uint32_t from;
+    uint32_t to;
+};
+
+static void mnQuadricFromPlane(double a, double b, double c, double d, double weight, Quadric& q) {
+    q.a2 = a*a*weight; q.ab = a*b*weight; q.ac = a*c*weight; q.ad = a*d*weight;
+    q.b2 = b*b*weight; q.bc = b*c*weight; q.bd = b*d*weight;
+    q.c2 = c*c*weight; q.cd = c*d*weight;
+    q.d2 = d*d*weight;
+}
+
+static void mnQuadricAdd(Quadric& q, const Quadric& r) {
+    q.a2 += r.a2; q.ab += r.ab; q.ac += r.ac; q.ad += r.ad;
+    q.b2 += r.b2; q.bc += r.bc; q.bd += r.bd;
+    q.c2 += r.c2; q.cd += r.cd;
+    q.d2 += r.d2;
+}
+
+static double mnQuadricError(const Quadric& q, const Quadric& r, const Vector3& v) {
+    double x = v.x, y = v.y, z = v.z;
+
+    double a2 = q.a2 + r.a2, ab = q.ab + r.ab, ac = q.ac + r.ac, ad = q.ad + r.ad;
+    double b2 = q.b2 + r.b2, bc = q.bc + r.bc, bd = q.bd + r.bd;
+    double c2 = q.c2 + r.c2, cd = q.cd + r.cd;
+    double d2 = q.d2 + r.d2;
+
+    double error = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x +
+                   b2*y*y + 2*bc*y*z + 2*bd*y +
+                   c2*z*z + 2*cd*z +
+                   d2;
+
+    return error > 0 ? error : 0;
+}
+
+static void mnTriangleNormal(const Vector3& v0, const Vector3& v1, const Vector3& v2, Vector3& normal) {
+    Vector3 e0, e1;
+
+    mnVector3Sub(v1.values, v0.values, e0.values);
+    mnVector3Sub(v2.values, v0.values, e1.values);
+    mnVector3Cross(e0.values, e1.values, normal.values);
+}
+
+static uint64_t mnEdgeKey(uint32_t a, uint32_t b) {
+    return a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+}
+
+/*
+ * Rejects the collapse when a triangle around from, that survives it, would turn
+ * around or become degenerate.
+ */
+static bool mnCollapseFlips(const Vector3* vertices, const uint32_t* indices, const uint32_t* adjacency,
+                            int adjacencyCount, uint32_t from, uint32_t to) {
+    for (int i = 0; i < adjacencyCount; i++) {
+        const uint32_t* triangle = &indices[adjacency[i] * 3];
+
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue;
+
+        Vector3 before, after;
+        mnTriangleNormal(vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]], before);
+        mnTriangleNormal(vertices[triangle[0] == from ? to : triangle[0]],
+                         vertices[triangle[1] == from ? to : triangle[1]],
+                         vertices[triangle[2] == from ? to : triangle[2]], after);
+
+        float dot = mnVector3Dot(before.values, after.values);
+        float length2 = mnVector3Dot(after.values, after.values);
+
+        if (dot <= 0 || length2 <= 1e-12f)
+            return true;
+    }
+
+    return false;
+}
+
+int mnSimplifyMesh(HeapAllocator& allocator, const Vector3* vertices, int numberVertices,
+                   const uint32_t* indices, int count, int targetCount, uint32_t* out) {
+    memcpy(out, indices, count * sizeof(uint32_t));
+
+    if (count <= targetCount)
+        return count;
+
+    Quadric* quadrics = (Quadric*) allocator.allocate(numberVertices * sizeof(Quadric));
+    uint8_t* locked = (uint8_t*) allocator.allocate(numberVertices);
+    uint8_t* touched = (uint8_t*) allocator.allocate(numberVertices);
+    uint32_t* remap = (uint32_t*) allocator.allocate(numberVertices * sizeof(uint32_t));
+    uint32_t* adjacencyOffset = (uint32_t*) allocator.allocate((numberVertices + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = (uint32_t*) allocator.allocate(count * sizeof(uint32_t));
+    uint64_t* edges = (uint64_t*) allocator.allocate(count * sizeof(uint64_t));
+    Collapse* collapses = (Collapse*) allocator.allocate(count * sizeof(Collapse));
+
+    memset(quadrics, 0, numberVertices * sizeof(Quadric));
+    memset(locked, 0, numberVertices);
+
+    //area weighted planes of the original triangles
+    for (int i = 0; i < count; i += 3) {
+        const Vector3& v0 = vertices[out[i + 0]];
+
+        Vector3 normal;
+        mnTriangleNormal(v0, vertices[out[i + 1]], vertices[out[i + 2]], normal);
+
+        float length = mnVector3Length(normal.values);
+
+        if (length <= 0)
+            continue;
+
+        double a = normal.x / length, b = normal.y / length, c = normal.z / length;
+        double d = -(a*v0.x + b*v0.y + c*v0.z);
+
+        Quadric q;
+        mnQuadricFromPlane(a, b, c, d, length * 0.5, q);
+
+        for (int j = 0; j < 3; j++)
+            mnQuadricAdd(quadrics[out[i + j]], q);
+    }
+
+    //edges used by one triangle are open, more than two is not a manifold
+    for (int i = 0; i < count; i += 3) {
+        for (int j = 0; j < 3; j++)
+            edges[i + j] = mnEdgeKey(out[i + j], out[i + (j + 1) % 3]);
+    }
+
+    std::sort(edges, edges + count);
+
+    for (int i = 0; i < count;) {
+        int j = i + 1;
+
+        while (j < count && edges[j] == edges[i])
+            j++;
+
+        if (j - i != 2) {
+            locked[edges[i] >> 32] = 1;
+            locked[edges[i] & 0xffffffff] = 1;
+        }
+
+        i = j;
+    }
+
+    while (count > targetCount) {
+        //candidate edges of the current triangles, in both directions
+        for (int i = 0; i < count; i += 3) {
+            for (int j = 0; j < 3; j++)
+                edges[i + j] = mnEdgeKey(out[i + j], out[i + (j + 1) % 3]);
+        }
+
+        std::sort(edges, edges + count);
+        int edgeCount = (int) (std::unique(edges, edges + count) - edges);
+        int collapseCount = 0;
+
+        for (int i = 0; i < edgeCount; i++) {
+            uint32_t a = (uint32_t) (edges[i] >> 32);
+            uint32_t b = (uint32_t) (edges[i] & 0xffffffff);
+
+            double costAB = locked[a] ? HUGE_VAL : mnQuadricError(quadrics[a], quadrics[b], vertices[b]);
+            double costBA = locked[b] ? HUGE_VAL : mnQuadricError(quadrics[a], quadrics[b], vertices[a]);
+
+            if (locked[a] && locked[b])
+                continue;
+
+            Collapse& collapse = collapses[collapseCount++];
+            collapse.cost = (float) (costAB <= costBA ? costAB : costBA);
+            collapse.from = costAB <= costBA ? a : b;
+            collapse.to = costAB <= costBA ? b : a;
+        }
+
+        std::sort(collapses, collapses + collapseCount, [](const Collapse& c0, const Collapse& c1) {
+            return c0.cost < c1.cost;
+        });
+
+        //triangles around each vertex
+        memset(adjacencyOffset, 0, (numberVertices + 1) * sizeof(uint32_t));
+
+        for (int i = 0; i < count; i++)
+            adjacencyOffset[out[i] + 1]++;
+
+        for (int i = 0; i < numberVertices; i++)
+            adjacencyOffset[i + 1] += adjacencyOffset[i];
+
+        for (int i = 0; i < count; i++)
+            adjacency[adjacencyOffset[out[i]]++] = (uint32_t) (i / 3);
+
+        for (int i = numberVertices; i > 0; i--)
+            adjacencyOffset[i] = adjacencyOffset[i - 1];
+
+        adjacencyOffset[0] = 0;
+
+        //each collapse removes about two triangles, the rest waits for the next pass
+        int collapsesLeft = (count - targetCount) / 6 + 1;
+        int collapsed = 0;
+
+        memset(touched, 0, numberVertices);
+
+        for (int i = 0; i < numberVertices; i++)
+            remap[i] = (uint32_t) i;
+
+        for (int i = 0; i < collapseCount && collapsed < collapsesLeft; i++) {
+            uint32_t from = collapses[i].from;
+            uint32_t to = collapses[i].to;
+
+            if (touched[from] || touched[to])
+                continue;
+
+            const uint32_t* around = &adjacency[adjacencyOffset[from]];
+            int aroundCount = adjacencyOffset[from + 1] - adjacencyOffset[from];
+
+            if (mnCollapseFlips(vertices, out, around, aroundCount, from, to))
+                continue;
+
+            remap[from] = to;
+            mnQuadricAdd(quadrics[to], quadrics[from]);
+
+            //the triangles around from changed, their vertices wait for the next pass
+            for (int j = 0; j < aroundCount; j++) {
+                const uint32_t* triangle = &out[around[j] * 3];
+
+                touched[triangle[0]] = 1;
+                touched[triangle[1]] = 1;
+                touched[triangle[2]] = 1;
+            }
+
+            collapsed++;
+        }
+
+        if (collapsed == 0)
+            break;
+
+        int newCount = 0;
+
+        for (int i = 0; i < count; i += 3) {
+            uint32_t i0 = remap[out[i + 0]];
+            uint32_t i1 = remap[out[i + 1]];
+            uint32_t i2 = remap[out[i + 2]];
+
+            if (i0 == i1 || i1 == i2 || i2 == i0)
+                continue;
+
+            out[newCount++] = i0;
+            out[newCount++] = i1;
+            out[newCount++] = i2;
+        }
+
+        count = newCount;
+    }
+
+    allocator.deallocate(quadrics);
+    allocator.deallocate(locked);
+    allocator.deallocate(touched);
+    allocator.deallocate(remap);
+    allocator.deallocate(adjacencyOffset);
+    allocator.deallocate(adjacency);
+    allocator.deallocate(edges);
+    allocator.deallocate(collapses);
+
+    return count;
+}
@@ -0,0 +1,21 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <stdint.h>
+
+#include "Vector.h"
+#include "Allocator.h"
+
+/*
+ * Collapses edges by quadric error until at most targetCount indices are left or
+ * nothing else can be collapsed, returns how many indices were written to out,
+ * which must hold count indices.
+ *
+ * Vertices are only ever moved onto one of their neighbours, so the result still
+ * indexes the same vertex buffer. Vertices on open edges, including the seams
+ * where attributes split a vertex, never move and the outline stays crack free.
+ */
+int mnSimplifyMesh(HeapAllocator& allocator, const Vector3* vertices, int numberVertices,
+                   const uint32_t* indices, int count, int targetCount, uint32_t* out);
+
+#endif //SIMPLIFY_H
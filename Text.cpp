@@ -3,6 +3,7 @@
 //
 
 #include "Text.h"
+#include "Profiler.h"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -78,26 +79,27 @@ void TextManager::printText(Font fontId, Framebuffer framebuffer, const float co
 
     size_t size = strlen(text);
 
+    PROFILE_SCOPE("TextManager::printText");
+
     device.bindProgram(program);
     device.setValue(program, "in_Color", color[0], color[1], color[2]); //TODO remove this call
     device.bindVertexArray(vertexArray);
 
     int width = 0;
     int height = 0;
-    GLFWwindow* window = glfwGetCurrentContext();
-    glfwGetFramebufferSize(window, &width, &height);
+    device.getFramebufferSize(width, height);
+
+    Rect viewport = {0, 0, (float) width, (float) height};
 
     device.bindDrawFramebuffer(framebuffer);
-    glViewport(0, 0, width, height);
+    device.setViewport(0, viewport);
 
     float invw = 1.0f / width;
     float invh = 1.0f / height;
 
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    device.setCullFace(false, GL_NONE, GL_NONE);
+    device.setDepthTest(false, GL_NONE);
+    device.setBlend(0, true, GL_FUNC_ADD, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_FUNC_ADD, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     Sampler sampler = {0};
     device.bindSampler(sampler, 0);
@@ -139,7 +141,7 @@ void TextManager::printText(Font fontId, Framebuffer framebuffer, const float co
         x += ch.advance * scale;
     }
 
-    glDisable(GL_BLEND);
+    device.setBlend(0, false, GL_NONE, GL_NONE, GL_NONE, GL_NONE, GL_NONE, GL_NONE);
 }
 
 Font TextManager::loadFont(const char* fontface, int height) {
@@ -167,7 +169,7 @@ Font TextManager::loadFont(const char* fontface, int height) {
 
     FT_Set_Pixel_Sizes(face, 0, height);
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    device.setUnpackAlignment(1);
 
     font->fontface = fontface;
     font->height = height;
@@ -192,7 +194,7 @@ Font TextManager::loadFont(const char* fontface, int height) {
     FT_Done_Face(face);
     FT_Done_FreeType(ft);
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    device.setUnpackAlignment(1);
 
     return {fontId};
 }
@@ -6,6 +6,7 @@
 #define TEXTURE_MANAGER_H
 
 #include <type_traits>
+#include <algorithm>
 
 void loadImage(HeapAllocator& allocator, const char* filename, Image& image) {
     FILE* file = fopen(filename, "rb");
@@ -97,45 +98,364 @@ TextureCube createTextureCube(Device& device, const ImageCube cube[], int mipLev
 
 #include "TgaReader.h"
 #include "JpegReader.h"
+#include "ResourceHandle.h"
+#include "AssetLoader.h"
+#include "AssetArchive.h"
+
+const int INITIAL_STREAMING_TEXTURES = 256;
+const int STREAMING_TAIL_SIZE = 64;
+const int STREAMING_MAX_UPLOADS = 4;
+const uint64_t STREAMING_DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+struct TextureStreamingStatistics {
+    uint64_t budget;
+    uint64_t residentBytes;  //levels on the GPU
+    uint64_t requestedBytes; //levels the last update was asked for
+    uint32_t textures;
+    uint32_t uploadedLevels; //by the last update
+    uint32_t evictedLevels;
+};
 
+/*
+ * Textures are shared by path and live in slots addressed by generational
+ * handles, found by path or by texture without walking the loaded ones.
+ *
+ * Streaming textures keep their whole mip chain in system memory but only the
+ * levels up to STREAMING_TAIL_SIZE are always on the GPU. The finer ones are
+ * uploaded as requestTexture() asks for them and the least recently requested
+ * are evicted to keep the resident levels within the budget. Only the streaming
+ * textures count against the budget.
+ */
 class TextureManager {
 public:
-    TextureManager(HeapAllocator& allocator, Device& device) : allocator(allocator), device(device) {
+    TextureManager(HeapAllocator& allocator, Device& device)
+            : allocator(allocator), device(device), handles(allocator), pathIndex(allocator), textureIndex(allocator),
+              streamedCount(0), streamingFrame(0), archive(nullptr) {
         linear = device.createSampler(GL_LINEAR, GL_LINEAR);
         nearest = device.createSampler(GL_NEAREST, GL_NEAREST);
+        trilinear = device.createSampler(GL_LINEAR, GL_LINEAR, GL_LINEAR);
 
-        textureCount = 0;
-        textureAllocated = 16;
+        textureAllocated = handles.getCapacity();
         textures = (Resource*) allocator.allocate(textureAllocated * sizeof(Resource));
         memset(textures, 0, textureAllocated * sizeof(Resource));
+
+        streamedAllocated = INITIAL_STREAMING_TEXTURES;
+        streamed = (StreamingTexture**) allocator.allocate(streamedAllocated * sizeof(StreamingTexture*));
+
+        memset(&streamingStatistics, 0, sizeof(streamingStatistics));
+        streamingStatistics.budget = STREAMING_DEFAULT_BUDGET;
     }
 
     ~TextureManager() {
-        assert(textureCount == 0);
+        assert(handles.getCount() == 0);
 
         allocator.deallocate(textures);
+        allocator.deallocate(streamed);
 
         device.destroySampler(linear);
         device.destroySampler(nearest);
+        device.destroySampler(trilinear);
+    }
+
+    /*
+     * Files cooked into the archive are loaded from it instead. Streaming textures
+     * keep reading their levels from it, so it must stay open until they are
+     * unloaded. nullptr goes back to the loose files.
+     */
+    void setArchive(AssetArchive* archive) {
+        this->archive = archive;
+    }
+
+    /*
+     * Decodes the file and writes it with its whole mip chain to the archive.
+     */
+    static void cookTexture(HeapAllocator& allocator, const char* filename, ArchiveWriter& writer) {
+        Image image;
+        TextureDescriptor descriptor;
+
+        readImage(allocator, filename, image, descriptor);
+
+        uint8_t* mips = createMipChain(image);
+        int levels = Device::getMipLevels(image.width, image.height);
+        uint64_t size = 0;
+
+        for(int i = 0; i < levels; i++)
+            size += getLevelSize(image.width, image.height, image.format, i);
+
+        ArchiveTexture cooked = {};
+        cooked.width = image.width;
+        cooked.height = image.height;
+        cooked.channels = image.format;
+        cooked.levels = levels;
+        cooked.internalFormat = descriptor.internalFormat;
+        cooked.format = descriptor.format;
+        cooked.type = descriptor.type;
+        cooked.pixelsOffset = mnArchiveAlign(sizeof(ArchiveTexture));
+
+        writer.beginEntry(filename, ARCHIVE_TEXTURE);
+        writer.write(&cooked, sizeof(ArchiveTexture));
+        writer.write(mips, size);
+        writer.endEntry();
+
+        allocator.deallocate(image.pixels);
+        free(mips);
     }
 
-    Texture2D loadTexture(const char* filename) {
+    Texture2D loadTexture(const char* filename, bool streaming = false) {
         uint32_t index;
 
         if(findTexture(filename, index)) {
+            finishLoading(index);
+
             textures[index].refs++;
             return textures[index].texture;
         }
 
-        if(textureCount >= textureAllocated) {
-            textureAllocated = textureAllocated * 3 / 2;
-            textures = (Resource*) allocator.reallocate(textures, textureAllocated * sizeof(Resource));
+        const ArchiveEntry* entry = findCooked(filename);
+
+        if(entry != nullptr) {
+            index = addTexture(filename, {0});
+            return addCooked(index, entry, streaming);
+        }
+
+        Image image;
+        TextureDescriptor descriptor;
+
+        readImage(allocator, filename, image, descriptor);
+
+        if(streaming) {
+            uint8_t* mips = createMipChain(image);
+
+            allocator.deallocate(image.pixels);
+
+            index = addTexture(filename, {0});
+            return addStreaming(index, descriptor, image.format, mips, false);
+        }
+
+        Texture2D texture = device.createTexture(descriptor);
+
+        //shows a placeholder until the copy lands, the pixels are staged already
+        descriptor.pixels = image.pixels;
+        device.uploadTexture(texture, descriptor);
+
+        allocator.deallocate(image.pixels);
+
+        addTexture(filename, texture);
+
+        return texture;
+    }
+
+    /*
+     * Returns at once, the file is read and decoded on the loader workers and the
+     * texture created when the loader finalizes it. getTexture() is {0} and
+     * unloadTexture() can't be called until then, future completes with it.
+     */
+    ResourceHandle loadTexture(const char* filename, AssetLoader& loader, AssetFuture* future = nullptr,
+                               bool streaming = false) {
+        uint32_t index;
+
+        if(findTexture(filename, index)) {
+            textures[index].refs++;
+        } else {
+            index = addTexture(filename, {0});
+
+            //the future stays INVALID_HANDLE, which is done
+            const ArchiveEntry* entry = findCooked(filename);
+
+            if(entry != nullptr)
+                addCooked(index, entry, streaming);
+        }
+
+        Resource& resource = textures[index];
+
+        if(resource.texture.id == 0 && resource.loader == nullptr) {
+            DecodedTexture* request = (DecodedTexture*) allocator.allocate(sizeof(DecodedTexture));
+            request->manager = this;
+            request->handle = resource.handle;
+            request->filename = resource.filename;
+            request->streaming = streaming;
+            request->mips = nullptr;
+
+            resource.loader = &loader;
+            resource.future = loader.load(decodeTextureJob, finalizeTextureJob, request);
+        }
+
+        if(future != nullptr)
+            *future = resource.future;
+
+        return resource.handle;
+    }
+
+    void unloadTexture(Texture2D texture) {
+        uint32_t index;
+
+        if (findTexture(texture, index)) {
+            Resource& resource = textures[index];
+
+            resource.refs--;
+
+            if (resource.refs == 0) {
+                pathIndex.remove(HandleIndex::hashPath(resource.filename), resource.handle);
+                textureIndex.remove(resource.texture.id, resource.handle);
+
+                destroy(&resource);
+                allocator.deallocate(resource.filename);
+
+                handles.destroy(resource.handle);
+            }
+        }
+    }
+
+    /*
+     * Usage feedback for streaming textures, screenSize is about how many pixels
+     * the texture spans on screen, the finest level wanted is the one closest to
+     * that size. Call it every frame the texture is drawn, other textures are
+     * ignored.
+     */
+    void requestTexture(Texture2D texture, float screenSize) {
+        uint32_t index;
+
+        if(!findTexture(texture, index) || textures[index].streaming == nullptr)
+            return;
+
+        StreamingTexture* streaming = textures[index].streaming;
+        int size = std::max(streaming->descriptor.width, streaming->descriptor.height);
+        int level = 0;
+
+        while(level < streaming->tailLevel && (size >> (level + 1)) >= screenSize)
+            level++;
+
+        streaming->wantedLevel = std::min(streaming->wantedLevel, level);
+        streaming->lastUsed = streamingFrame;
+    }
+
+    /*
+     * Call once per frame after the requests. Uploads at most STREAMING_MAX_UPLOADS
+     * levels, the blurriest of the requested textures first, evicting the levels
+     * not requested since the longest time when the budget would be exceeded.
+     */
+    void updateStreaming() {
+        streamingStatistics.requestedBytes = 0;
+        streamingStatistics.uploadedLevels = 0;
+        streamingStatistics.evictedLevels = 0;
+
+        for(int i = 0; i < streamedCount; i++)
+            streamingStatistics.requestedBytes += getResidentSize(streamed[i], streamed[i]->wantedLevel);
+
+        for(int i = 0; i < STREAMING_MAX_UPLOADS; i++) {
+            StreamingTexture* next = nullptr;
+
+            for(int j = 0; j < streamedCount; j++) {
+                StreamingTexture* streaming = streamed[j];
+                int missing = streaming->residentLevel - streaming->wantedLevel;
+
+                if(missing > 0 && (next == nullptr || missing > next->residentLevel - next->wantedLevel))
+                    next = streaming;
+            }
+
+            if(next == nullptr)
+                break;
+
+            uint64_t size = getLevelSize(next, next->residentLevel - 1);
+            bool fits = true;
+
+            while(fits && streamingStatistics.residentBytes + size > streamingStatistics.budget)
+                fits = evictLevel(next);
+
+            if(!fits)
+                break;
+
+            uploadLevel(next);
+        }
+
+        //the budget may have been lowered
+        while(streamingStatistics.residentBytes > streamingStatistics.budget && evictLevel(nullptr)) {
         }
 
-        index = textureCount++;
+        for(int i = 0; i < streamedCount; i++)
+            streamed[i]->wantedLevel = streamed[i]->tailLevel;
+
+        streamingFrame++;
+    }
+
+    void setStreamingBudget(uint64_t bytes) {
+        streamingStatistics.budget = bytes;
+    }
+
+    TextureStreamingStatistics getStreamingStatistics() {
+        streamingStatistics.textures = streamedCount;
+
+        return streamingStatistics;
+    }
+
+    /*
+     * INVALID_HANDLE when the texture was not loaded here.
+     */
+    ResourceHandle getHandle(Texture2D texture) {
+        return textureIndex.find(texture.id);
+    }
+
+    /*
+     * {0} once the texture is unloaded.
+     */
+    Texture2D getTexture(ResourceHandle handle) {
+        if (!handles.isValid(handle))
+            return {0};
+
+        return textures[mnHandleSlot(handle)].texture;
+    }
+
+    Sampler getLinear() {
+        return linear;
+    }
+
+    Sampler getNearest() {
+        return nearest;
+    }
+
+    Sampler getTrilinear() {
+        return trilinear;
+    }
+private:
+    struct StreamingTexture {
+        Texture2D texture;
+        TextureDescriptor descriptor;
+        int channels;
+        const uint8_t* mips; //every level back to back, malloc'ed because it may change thread
+        bool mapped;         //or mapped from an archive
+        int levels;
+        int tailLevel;     //this level and the coarser ones are always resident
+        int residentLevel; //finest level on the GPU
+        int wantedLevel;   //finest level requested since the last update
+        uint64_t lastUsed; //streamingFrame of the last request
+    };
+
+    struct Resource {
+        char* filename; //allocated, the path index points to it
+        ResourceHandle handle;
+        Texture2D texture;
+        uint32_t refs;
+
+        //set while an AssetLoader is decoding the texture
+        AssetLoader* loader;
+        AssetFuture future;
+
+        StreamingTexture* streaming; //nullptr unless streamed
+    };
 
+    struct DecodedTexture {
+        TextureManager* manager;
+        ResourceHandle handle;
+        const char* filename;
+        bool streaming;
+
+        //filled on a worker
         Image image;
+        TextureDescriptor descriptor;
+        uint8_t* mips;
+    };
 
+    static void readImage(HeapAllocator& allocator, const char* filename, Image& image, TextureDescriptor& descriptor) {
         FILE* stream = fopen(filename, "rb");
         assert(stream != nullptr);
 
@@ -148,87 +468,382 @@ public:
 
         assert(image.format == 1 || image.format == 3 || image.format == 4);
 
-        textures[index].refs = 1;
-        textures[index].filename = filename;
+        descriptor.width = image.width;
+        descriptor.height = image.height;
+        descriptor.type = GL_UNSIGNED_BYTE;
+        descriptor.mipLevels = 0;
+        descriptor.generateMips = true;
+        descriptor.pixels = nullptr;
+
         switch(image.format) {
         case 1:
-            textures[index].texture = device.createRTexture(image.width, image.height, image.pixels);
+            descriptor.internalFormat = GL_R8;
+            descriptor.format = GL_RED;
             break;
         case 3:
-            textures[index].texture = device.createRGBTexture(image.width, image.height, image.pixels);
+            descriptor.internalFormat = GL_RGB8;
+            descriptor.format = GL_RGB;
             break;
         case 4:
-            textures[index].texture = device.createRGBATexture(image.width, image.height, image.pixels);
+            descriptor.internalFormat = GL_RGBA8;
+            descriptor.format = GL_RGBA;
             break;
         }
+    }
 
-        allocator.deallocate(image.pixels);
+    static void decodeTextureJob(HeapAllocator& allocator, void* data) {
+        DecodedTexture* request = (DecodedTexture*) data;
+
+        readImage(allocator, request->filename, request->image, request->descriptor);
 
-        return textures[index].texture;
+        //the box filtering is the slow part of streaming textures
+        if(request->streaming) {
+            request->mips = createMipChain(request->image);
+
+            allocator.deallocate(request->image.pixels);
+        }
     }
 
-    void unloadTexture(Texture2D texture) {
-        uint32_t index;
+    static void finalizeTextureJob(Device& device, HeapAllocator& allocator, void* data) {
+        DecodedTexture* request = (DecodedTexture*) data;
+        TextureManager* manager = request->manager;
 
-        if (findTexture(texture, index)) {
-            textures[index].refs--;
+        if(request->streaming) {
+            uint32_t index = mnHandleSlot(request->handle);
 
-            if (textures[index].refs == 0) {
-                destroy(&textures[index]);
+            manager->textures[index].loader = nullptr;
+            manager->addStreaming(index, request->descriptor, request->image.format, request->mips, false);
 
-                textureCount--;
-                std::swap(textures[index], textures[textureCount]);
-            }
+            manager->allocator.deallocate(request);
+            return;
         }
+
+        Texture2D texture = device.createTexture(request->descriptor);
+
+        request->descriptor.pixels = request->image.pixels;
+        device.uploadTexture(texture, request->descriptor);
+
+        allocator.deallocate(request->image.pixels);
+
+        Resource& resource = manager->textures[mnHandleSlot(request->handle)];
+        resource.texture = texture;
+        resource.loader = nullptr;
+        manager->textureIndex.insert(texture.id, nullptr, resource.handle);
+
+        manager->allocator.deallocate(request);
     }
 
-    Sampler getLinear() {
-        return linear;
+    /*
+     * A texture still being decoded is waited on.
+     */
+    void finishLoading(uint32_t index) {
+        if(textures[index].loader != nullptr)
+            textures[index].loader->wait(textures[index].future);
     }
 
-    Sampler getNearest() {
-        return nearest;
+    uint32_t addTexture(const char* filename, Texture2D texture) {
+        ResourceHandle handle = handles.create();
+
+        if (handles.getCapacity() > textureAllocated) {
+            textureAllocated = handles.getCapacity();
+            textures = (Resource*) allocator.reallocate(textures, textureAllocated * sizeof(Resource));
+        }
+
+        Resource& resource = textures[mnHandleSlot(handle)];
+        size_t length = strlen(filename);
+
+        resource.filename = (char*) allocator.allocate(length + 1);
+        memcpy(resource.filename, filename, length + 1);
+        resource.handle = handle;
+        resource.refs = 1;
+        resource.texture = texture;
+        resource.loader = nullptr;
+        resource.future = INVALID_HANDLE;
+        resource.streaming = nullptr;
+
+        pathIndex.insert(HandleIndex::hashPath(resource.filename), resource.filename, handle);
+
+        if(texture.id != 0)
+            textureIndex.insert(texture.id, nullptr, handle);
+
+        return mnHandleSlot(handle);
     }
-private:
-    struct Resource {
-        const char* filename;
-        Texture2D texture;
-        uint32_t refs;
-    };
 
     void destroy(Resource* resource) {
         device.destroyTexture(resource->texture);
-    }
 
-    bool findTexture(Texture2D texture, uint32_t& index) {
-        for(uint32_t i = 0; i < textureCount; i++) {
-            if(textures[i].texture.id == texture.id) {
-                index = i;
-                return true;
+        StreamingTexture* streaming = resource->streaming;
+
+        if(streaming != nullptr) {
+            streamingStatistics.residentBytes -= getResidentSize(streaming, streaming->residentLevel);
+
+            for(int i = 0; i < streamedCount; i++) {
+                if(streamed[i] == streaming) {
+                    streamed[i] = streamed[--streamedCount];
+                    break;
+                }
             }
+
+            if(!streaming->mapped)
+                free((void*) streaming->mips);
+            allocator.deallocate(streaming);
         }
-        return false;
     }
 
-    bool findTexture(const char* filename, uint32_t& index) {
-        for(uint32_t i = 0; i < textureCount; i++) {
-            if(textures[i].filename != nullptr && strcmp(textures[i].filename, filename) == 0) {
-                index = i;
-                return true;
+    static uint64_t getLevelSize(int width, int height, int channels, int level) {
+        uint64_t w = std::max(width >> level, 1);
+        uint64_t h = std::max(height >> level, 1);
+
+        return w * h * channels;
+    }
+
+    static uint64_t getLevelSize(const StreamingTexture* streaming, int level) {
+        return getLevelSize(streaming->descriptor.width, streaming->descriptor.height, streaming->channels, level);
+    }
+
+    //bytes of the levels from level down to 1x1
+    static uint64_t getResidentSize(const StreamingTexture* streaming, int level) {
+        uint64_t size = 0;
+
+        for(int i = level; i < streaming->levels; i++)
+            size += getLevelSize(streaming, i);
+
+        return size;
+    }
+
+    /*
+     * Box filters the image down to 1x1, the levels are stored back to back.
+     */
+    static uint8_t* createMipChain(const Image& image) {
+        int levels = Device::getMipLevels(image.width, image.height);
+        int channels = image.format;
+        uint64_t total = 0;
+
+        for(int i = 0; i < levels; i++)
+            total += getLevelSize(image.width, image.height, channels, i);
+
+        uint8_t* mips = (uint8_t*) malloc(total);
+        memcpy(mips, image.pixels, getLevelSize(image.width, image.height, channels, 0));
+
+        const uint8_t* src = mips;
+
+        for(int i = 1; i < levels; i++) {
+            int srcWidth = std::max(image.width >> (i - 1), 1);
+            int srcHeight = std::max(image.height >> (i - 1), 1);
+            int width = std::max(image.width >> i, 1);
+            int height = std::max(image.height >> i, 1);
+
+            uint8_t* dst = (uint8_t*) src + srcWidth * srcHeight * channels;
+
+            for(int y = 0; y < height; y++) {
+                int y0 = std::min(y * 2, srcHeight - 1) * srcWidth;
+                int y1 = std::min(y * 2 + 1, srcHeight - 1) * srcWidth;
+
+                for(int x = 0; x < width; x++) {
+                    int x0 = std::min(x * 2, srcWidth - 1);
+                    int x1 = std::min(x * 2 + 1, srcWidth - 1);
+
+                    for(int c = 0; c < channels; c++) {
+                        int sum = src[(y0 + x0) * channels + c] + src[(y0 + x1) * channels + c] +
+                                  src[(y1 + x0) * channels + c] + src[(y1 + x1) * channels + c];
+
+                        dst[(y * width + x) * channels + c] = (uint8_t) ((sum + 2) / 4);
+                    }
+                }
             }
+
+            src = dst;
+        }
+
+        return mips;
+    }
+
+    /*
+     * Creates the texture of slot index with only the tail resident, takes mips.
+     */
+    Texture2D addStreaming(uint32_t index, const TextureDescriptor& descriptor, int channels, const uint8_t* mips,
+                           bool mapped) {
+        StreamingTexture* streaming = (StreamingTexture*) allocator.allocate(sizeof(StreamingTexture));
+        streaming->descriptor = descriptor;
+        streaming->descriptor.mipLevels = Device::getMipLevels(descriptor.width, descriptor.height);
+        streaming->descriptor.generateMips = false;
+        streaming->descriptor.pixels = nullptr;
+        streaming->channels = channels;
+        streaming->mips = mips;
+        streaming->mapped = mapped;
+        streaming->levels = streaming->descriptor.mipLevels;
+        streaming->tailLevel = 0;
+        streaming->lastUsed = streamingFrame;
+
+        while(streaming->tailLevel < streaming->levels - 1 &&
+              std::max(descriptor.width, descriptor.height) >> streaming->tailLevel > STREAMING_TAIL_SIZE)
+            streaming->tailLevel++;
+
+        Texture2D texture = device.createStreamingTexture(streaming->descriptor);
+        streaming->texture = texture;
+
+        Resource& resource = textures[index];
+        resource.texture = texture;
+        resource.streaming = streaming;
+        textureIndex.insert(texture.id, nullptr, resource.handle);
+
+        if(streamedCount == streamedAllocated) {
+            streamedAllocated = streamedAllocated * 3 / 2;
+            streamed = (StreamingTexture**) allocator.reallocate(streamed, streamedAllocated * sizeof(StreamingTexture*));
+        }
+
+        streamed[streamedCount++] = streaming;
+
+        //the tail goes in coarsest first, the base level follows each upload
+        streaming->residentLevel = streaming->levels;
+        streaming->wantedLevel = streaming->tailLevel;
+
+        while(streaming->residentLevel > streaming->tailLevel)
+            uploadLevel(streaming);
+
+        return texture;
+    }
+
+    const ArchiveEntry* findCooked(const char* filename) {
+        if(archive == nullptr)
+            return nullptr;
+
+        const ArchiveEntry* entry = archive->find(filename);
+
+        return entry != nullptr && entry->type == ARCHIVE_TEXTURE ? entry : nullptr;
+    }
+
+    /*
+     * The levels are uploaded straight from the mapped pages, a streaming texture
+     * keeps pointing at them.
+     */
+    Texture2D addCooked(uint32_t index, const ArchiveEntry* entry, bool streaming) {
+        const uint8_t* blob = (const uint8_t*) archive->getData(entry);
+        const ArchiveTexture* cooked = (const ArchiveTexture*) blob;
+        const uint8_t* mips = blob + cooked->pixelsOffset;
+
+        TextureDescriptor descriptor;
+        descriptor.width = cooked->width;
+        descriptor.height = cooked->height;
+        descriptor.internalFormat = cooked->internalFormat;
+        descriptor.format = cooked->format;
+        descriptor.type = cooked->type;
+        descriptor.mipLevels = cooked->levels;
+        descriptor.generateMips = false;
+        descriptor.pixels = nullptr;
+
+        if(streaming)
+            return addStreaming(index, descriptor, cooked->channels, mips, true);
+
+        //immutable storage for every cooked level, nothing is generated
+        Texture2D texture = device.createTexture(descriptor);
+        const uint8_t* pixels = mips;
+
+        for(int i = 0; i < cooked->levels; i++) {
+            device.updateTextureLevel(texture, descriptor, i, pixels);
+            pixels += getLevelSize(cooked->width, cooked->height, cooked->channels, i);
         }
-        return false;
+
+        textures[index].texture = texture;
+        textureIndex.insert(texture.id, nullptr, textures[index].handle);
+
+        return texture;
+    }
+
+    const uint8_t* getLevelPixels(const StreamingTexture* streaming, int level) {
+        const uint8_t* pixels = streaming->mips;
+
+        for(int i = 0; i < level; i++)
+            pixels += getLevelSize(streaming, i);
+
+        return pixels;
+    }
+
+    void uploadLevel(StreamingTexture* streaming) {
+        int level = streaming->residentLevel - 1;
+
+        device.setTextureLevel(streaming->texture, streaming->descriptor, level, getLevelPixels(streaming, level));
+        device.setTextureBaseLevel(streaming->texture, level);
+
+        streaming->residentLevel = level;
+
+        streamingStatistics.residentBytes += getLevelSize(streaming, level);
+        streamingStatistics.uploadedLevels++;
+    }
+
+    /*
+     * Drops the finest level of the texture requested least recently, not counting
+     * the tails. For an upload only the textures not requested since the last
+     * update qualify, or those with more levels than they were asked for.
+     */
+    bool evictLevel(StreamingTexture* requester) {
+        StreamingTexture* victim = nullptr;
+
+        for(int i = 0; i < streamedCount; i++) {
+            StreamingTexture* streaming = streamed[i];
+
+            if(streaming == requester || streaming->residentLevel >= streaming->tailLevel)
+                continue;
+
+            if(requester != nullptr && streaming->lastUsed >= requester->lastUsed &&
+               streaming->residentLevel >= streaming->wantedLevel)
+                continue;
+
+            if(victim == nullptr || streaming->lastUsed < victim->lastUsed)
+                victim = streaming;
+        }
+
+        if(victim == nullptr)
+            return false;
+
+        int level = victim->residentLevel;
+
+        device.setTextureBaseLevel(victim->texture, level + 1);
+        device.setTextureLevel(victim->texture, victim->descriptor, level, nullptr);
+
+        victim->residentLevel = level + 1;
+
+        streamingStatistics.residentBytes -= getLevelSize(victim, level);
+        streamingStatistics.evictedLevels++;
+
+        return true;
+    }
+
+    bool findTexture(Texture2D texture, uint32_t& index) {
+        ResourceHandle handle = textureIndex.find(texture.id);
+
+        index = mnHandleSlot(handle);
+        return handle != INVALID_HANDLE;
+    }
+
+    bool findTexture(const char* filename, uint32_t& index) {
+        ResourceHandle handle = pathIndex.find(HandleIndex::hashPath(filename), filename);
+
+        index = mnHandleSlot(handle);
+        return handle != INVALID_HANDLE;
     }
 
     HeapAllocator& allocator;
     Device& device;
 
-    Resource* textures;
-    uint32_t textureCount;
+    HandleAllocator handles;
+    HandleIndex pathIndex;
+    HandleIndex textureIndex; //by texture id
+
+    Resource* textures; //by slot
     uint32_t textureAllocated;
 
+    StreamingTexture** streamed;
+    int streamedCount;
+    int streamedAllocated;
+    uint64_t streamingFrame;
+    TextureStreamingStatistics streamingStatistics;
+
+    AssetArchive* archive;
+
     Sampler linear;
     Sampler nearest;
+    Sampler trilinear;
 };
 
 #endif //TEXTURE_MANAGER_H
@@ -0,0 +1,265 @@
+#include "TransformHierarchy.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORM_SSE 1
+#else
+#define TRANSFORM_SSE 0
+#endif
+
+TransformHierarchy::TransformHierarchy(HeapAllocator& allocator, int capacity)
+        : allocator(allocator), capacity((capacity + 3) & ~3), count(0) {
+    float* components = (float*) allocator.allocate(10 * this->capacity * sizeof(float));
+
+    positionX = components + 0 * this->capacity;
+    positionY = components + 1 * this->capacity;
+    positionZ = components + 2 * this->capacity;
+    rotationX = components + 3 * this->capacity;
+    rotationY = components + 4 * this->capacity;
+    rotationZ = components + 5 * this->capacity;
+    rotationW = components + 6 * this->capacity;
+    scaleX = components + 7 * this->capacity;
+    scaleY = components + 8 * this->capacity;
+    scaleZ = components + 9 * this->capacity;
+
+    for (int i = 0; i < this->capacity; i++) {
+        positionX[i] = positionY[i] = positionZ[i] = 0;
+        rotationX[i] = rotationY[i] = rotationZ[i] = 0;
+        rotationW[i] = 1;
+        scaleX[i] = scaleY[i] = scaleZ[i] = 1;
+    }
+
+    parent = (int*) allocator.allocate(this->capacity * sizeof(int));
+    dirty = (uint8_t*) allocator.allocate(this->capacity);
+    world = (float*) allocator.allocate(16 * this->capacity * sizeof(float));
+    output = (float**) allocator.allocate(this->capacity * sizeof(float*));
+
+    memset(dirty, 0, this->capacity);
+}
+
+TransformHierarchy::~TransformHierarchy() {
+    allocator.deallocate(positionX);
+    allocator.deallocate(parent);
+    allocator.deallocate(dirty);
+    allocator.deallocate(world);
+    allocator.deallocate(output);
+}
+
+int TransformHierarchy::create(int parent) {
+    assert(count < capacity);
+    assert(parent < count);
+
+    int transform = count++;
+
+    this->parent[transform] = parent;
+    dirty[transform] = 1;
+    output[transform] = nullptr;
+
+    return transform;
+}
+
+void TransformHierarchy::setPosition(int transform, const float position[3]) {
+    positionX[transform] = position[0];
+    positionY[transform] = position[1];
+    positionZ[transform] = position[2];
+    dirty[transform] = 1;
+}
+
+void TransformHierarchy::setRotation(int transform, const float axis[3], float angle) {
+    float s = sinf(angle * 0.5f);
+
+    rotationX[transform] = axis[0] * s;
+    rotationY[transform] = axis[1] * s;
+    rotationZ[transform] = axis[2] * s;
+    rotationW[transform] = cosf(angle * 0.5f);
+    dirty[transform] = 1;
+}
+
+void TransformHierarchy::setScale(int transform, const float scale[3]) {
+    scaleX[transform] = scale[0];
+    scaleY[transform] = scale[1];
+    scaleZ[transform] = scale[2];
+    dirty[transform] = 1;
+}
+
+void TransformHierarchy::setOutput(int transform, float* matrix) {
+    output[transform] = matrix;
+    dirty[transform] = 1;
+}
+
+const float* TransformHierarchy::getWorldMatrix(int transform) {
+    return &world[transform * 16];
+}
+
+int TransformHierarchy::getCount() {
+    return count;
+}
+
+/*
+ * Column major out = a * b.
+ */
+static void mnMultiply(const float a[16], const float b[16], float out[16]) {
+#if TRANSFORM_SSE
+    __m128 c0 = _mm_loadu_ps(a + 0);
+    __m128 c1 = _mm_loadu_ps(a + 4);
+    __m128 c2 = _mm_loadu_ps(a + 8);
+    __m128 c3 = _mm_loadu_ps(a + 12);
+
+    for (int i = 0; i < 4; i++) {
+        __m128 column = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(b[i*4 + 0])), _mm_mul_ps(c1, _mm_set1_ps(b[i*4 + 1]))),
+                _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(b[i*4 + 2])), _mm_mul_ps(c3, _mm_set1_ps(b[i*4 + 3]))));
+
+        _mm_storeu_ps(out + i*4, column);
+    }
+#else
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            out[i*4 + j] = a[0*4 + j] * b[i*4 + 0] +
+                           a[1*4 + j] * b[i*4 + 1] +
+                           a[2*4 + j] * b[i*4 + 2] +
+                           a[3*4 + j] * b[i*4 + 3];
+        }
+    }
+#endif
+}
+
+/*
+ * Local matrices of the transforms first to first + 3, one per lane.
+ */
+void TransformHierarchy::computeLocal(int first, float local[4][16]) {
+#if TRANSFORM_SSE
+    __m128 x = _mm_loadu_ps(rotationX + first);
+    __m128 y = _mm_loadu_ps(rotationY + first);
+    __m128 z = _mm_loadu_ps(rotationZ + first);
+    __m128 w = _mm_loadu_ps(rotationW + first);
+
+    __m128 one = _mm_set1_ps(1);
+    __m128 two = _mm_set1_ps(2);
+
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    __m128 sx = _mm_loadu_ps(scaleX + first);
+    __m128 sy = _mm_loadu_ps(scaleY + first);
+    __m128 sz = _mm_loadu_ps(scaleZ + first);
+
+    //rotation columns scaled by the matching scale component
+    __m128 m0 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+    __m128 m1 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+    __m128 m2 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+    __m128 m3 = _mm_setzero_ps();
+
+    __m128 m4 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+    __m128 m5 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+    __m128 m6 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+    __m128 m7 = _mm_setzero_ps();
+
+    __m128 m8 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+    __m128 m9 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+    __m128 m10 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+    __m128 m11 = _mm_setzero_ps();
+
+    __m128 m12 = _mm_loadu_ps(positionX + first);
+    __m128 m13 = _mm_loadu_ps(positionY + first);
+    __m128 m14 = _mm_loadu_ps(positionZ + first);
+    __m128 m15 = one;
+
+    //each column of the four lanes becomes the column of one matrix
+    _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+    _MM_TRANSPOSE4_PS(m4, m5, m6, m7);
+    _MM_TRANSPOSE4_PS(m8, m9, m10, m11);
+    _MM_TRANSPOSE4_PS(m12, m13, m14, m15);
+
+    __m128 columns[4][4] = {
+            {m0, m4, m8, m12},
+            {m1, m5, m9, m13},
+            {m2, m6, m10, m14},
+            {m3, m7, m11, m15},
+    };
+
+    for (int lane = 0; lane < 4; lane++) {
+        for (int column = 0; column < 4; column++)
+            _mm_storeu_ps(&local[lane][column * 4], columns[lane][column]);
+    }
+#else
+    for (int lane = 0; lane < 4; lane++) {
+        int i = first + lane;
+
+        float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+        float* m = local[lane];
+
+        m[0] = (1 - 2*(y*y + z*z)) * scaleX[i];
+        m[1] = 2*(x*y + w*z) * scaleX[i];
+        m[2] = 2*(x*z - w*y) * scaleX[i];
+        m[3] = 0;
+
+        m[4] = 2*(x*y - w*z) * scaleY[i];
+        m[5] = (1 - 2*(x*x + z*z)) * scaleY[i];
+        m[6] = 2*(y*z + w*x) * scaleY[i];
+        m[7] = 0;
+
+        m[8] = 2*(x*z + w*y) * scaleZ[i];
+        m[9] = 2*(y*z - w*x) * scaleZ[i];
+        m[10] = (1 - 2*(x*x + y*y)) * scaleZ[i];
+        m[11] = 0;
+
+        m[12] = positionX[i];
+        m[13] = positionY[i];
+        m[14] = positionZ[i];
+        m[15] = 1;
+    }
+#endif
+}
+
+int TransformHierarchy::update() {
+    //parents come first, one pass carries the flags down the whole tree
+    for (int i = 0; i < count; i++) {
+        if (parent[i] != TRANSFORM_ROOT && dirty[parent[i]])
+            dirty[i] = 1;
+    }
+
+    int updated = 0;
+
+    for (int first = 0; first < count; first += 4) {
+        int lanes = count - first < 4 ? count - first : 4;
+        bool anyDirty = false;
+
+        for (int lane = 0; lane < lanes; lane++)
+            anyDirty |= dirty[first + lane] != 0;
+
+        if (!anyDirty)
+            continue;
+
+        float local[4][16];
+        computeLocal(first, local);
+
+        //a parent in the same group is a lower lane and is already done
+        for (int lane = 0; lane < lanes; lane++) {
+            int i = first + lane;
+
+            if (!dirty[i])
+                continue;
+
+            float* matrix = &world[i * 16];
+
+            if (parent[i] == TRANSFORM_ROOT)
+                memcpy(matrix, local[lane], 16 * sizeof(float));
+            else
+                mnMultiply(&world[parent[i] * 16], local[lane], matrix);
+
+            if (output[i] != nullptr)
+                memcpy(output[i], matrix, 16 * sizeof(float));
+
+            updated++;
+        }
+    }
+
+    memset(dirty, 0, count);
+
+    return updated;
+}
@@ -0,0 +1,75 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <stdint.h>
+
+#include "Allocator.h"
+
+const int TRANSFORM_ROOT = -1;
+
+/*
+ * Local transforms are kept as separate position, rotation (quaternion) and scale
+ * arrays in parent-first order. update() only recomputes the transforms changed
+ * since the last call and their descendants, four local matrices at a time.
+ *
+ * world = parent world * translation * rotation * scale, the same matrix
+ * mnMatrix4Transformation builds.
+ */
+class TransformHierarchy {
+public:
+    TransformHierarchy(HeapAllocator& allocator, int capacity);
+
+    ~TransformHierarchy();
+
+    /*
+     * Parents must be created before their children, which keeps the arrays
+     * topologically sorted. Starts at the identity.
+     */
+    int create(int parent = TRANSFORM_ROOT);
+
+    void setPosition(int transform, const float position[3]);
+
+    void setRotation(int transform, const float axis[3], float angle);
+
+    void setScale(int transform, const float scale[3]);
+
+    /*
+     * The world matrix is also copied to matrix every time it changes, usually the
+     * instance data of a UniformArena block. nullptr stops the copies.
+     */
+    void setOutput(int transform, float* matrix);
+
+    /*
+     * Returns how many world matrices were recomputed.
+     */
+    int update();
+
+    const float* getWorldMatrix(int transform);
+
+    int getCount();
+private:
+    void computeLocal(int first, float local[4][16]);
+
+    HeapAllocator& allocator;
+
+    int capacity; //multiple of 4, lanes past count stay at the identity
+    int count;
+
+    float* positionX;
+    float* positionY;
+    float* positionZ;
+    float* rotationX;
+    float* rotationY;
+    float* rotationZ;
+    float* rotationW;
+    float* scaleX;
+    float* scaleY;
+    float* scaleZ;
+
+    int* parent;
+    uint8_t* dirty;
+    float* world; //16 floats per transform
+    float** output;
+};
+
+#endif //TRANSFORM_HIERARCHY_H
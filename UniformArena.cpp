@@ -0,0 +1,47 @@
+#include "UniformArena.h"
+#include "Profiler.h"
+
+UniformArena::UniformArena(Device& device, HeapAllocator& allocator, size_t capacity)
+        : device(device), allocator(allocator), capacity(capacity), used(0), blockCount(0) {
+    buffer = device.createConstantBuffer(capacity);
+    data = (uint8_t*) allocator.allocate(capacity);
+
+    memset(data, 0, capacity);
+}
+
+UniformArena::~UniformArena() {
+    for (int i = 0; i < blockCount; i++)
+        device.destroyConstantBuffer(blocks[i]);
+
+    device.destroyConstantBuffer(buffer);
+    allocator.deallocate(data);
+}
+
+ConstantBuffer UniformArena::allocate(size_t size, void** data) {
+    size_t alignment = device.getConstantBufferAlignment();
+    size_t offset = (used + alignment - 1) / alignment * alignment;
+
+    assert(blockCount < MAX_ARENA_BLOCKS);
+    assert(offset + size <= capacity);
+
+    ConstantBuffer block = device.createConstantBufferView(buffer, offset, size);
+
+    blocks[blockCount++] = block;
+    used = offset + size;
+
+    *data = this->data + offset;
+
+    return block;
+}
+
+void UniformArena::upload() {
+    //one scope for every block of the frame, the device copy itself is not profiled
+    PROFILE_SCOPE("UniformArena::upload");
+
+    if (used > 0)
+        device.copyConstantBuffer(buffer, data, used);
+}
+
+size_t UniformArena::getUsed() {
+    return used;
+}
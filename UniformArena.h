@@ -0,0 +1,47 @@
+#ifndef UNIFORM_ARENA_H
+#define UNIFORM_ARENA_H
+
+#include "Device.h"
+#include "Allocator.h"
+
+const int MAX_ARENA_BLOCKS = 64;
+
+/*
+ * Suballocates constant buffer blocks from a single parent buffer. The blocks are
+ * filled through the pointers returned by allocate() and all of them are sent to
+ * the device with a single copy in upload().
+ */
+class UniformArena {
+public:
+    UniformArena(Device& device, HeapAllocator& allocator, size_t capacity);
+
+    ~UniformArena();
+
+    /*
+     * Returns a view bindable with BindConstantBuffer, data receives the CPU side
+     * of the block.
+     */
+    ConstantBuffer allocate(size_t size, void** data);
+
+    template<typename T>
+    ConstantBuffer allocate(int count, T** data) {
+        return allocate(count * sizeof(T), (void**) data);
+    }
+
+    void upload();
+
+    size_t getUsed();
+private:
+    Device& device;
+    HeapAllocator& allocator;
+
+    ConstantBuffer buffer;
+    uint8_t* data;
+    size_t capacity;
+    size_t used;
+
+    ConstantBuffer blocks[MAX_ARENA_BLOCKS];
+    int blockCount;
+};
+
+#endif //UNIFORM_ARENA_H
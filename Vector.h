@@ -7,6 +7,9 @@
 
 #include <math.h>
 
+//shared with the code that only reads view matrices, Matrix.h picks its builders from it
+#define RIGHT_HANDED 1
+
 //////////////////////////////////////////////////////////////////////////////
 
 static inline void mnVector2Add(const float in0[2], const float in1[2], float out[2]) {
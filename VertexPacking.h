@@ -0,0 +1,102 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * Interleaved layout used by the ModelManager meshes, 24 bytes per vertex against
+ * the 44 bytes of the four float streams it replaces:
+ *
+ *   position  VertexFloat3        offset 0
+ *   texture   VertexHalf2         offset 12
+ *   normal    VertexSNorm1010102  offset 16
+ *   tangent   VertexSNorm1010102  offset 20
+ *
+ * Texture coordinates are half floats rather than unorm16 so wrapped coordinates
+ * outside [0, 1] still work. Normals and tangents lose the w component, which the
+ * shaders do not read.
+ */
+struct PackedVertex {
+    float position[3];
+    uint16_t texture[2];
+    uint32_t normal;
+    uint32_t tangent;
+};
+
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex must not be padded");
+
+static inline uint16_t mnPackHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+    int32_t exponent = (int32_t) ((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    //NaN
+    if ((bits & 0x7fffffff) > 0x7f800000)
+        return sign | 0x7e00;
+
+    //too large, infinity
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    //too small, denormal or zero
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+
+        mantissa |= 0x800000;
+
+        uint32_t shift = (uint32_t) (14 - exponent);
+        uint16_t half = (uint16_t) (mantissa >> shift);
+
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+
+        return sign | half;
+    }
+
+    uint16_t half = (uint16_t) ((exponent << 10) | (mantissa >> 13));
+
+    //round to nearest, a carry into the exponent is still the right value
+    if (mantissa & 0x1000)
+        half++;
+
+    return sign | half;
+}
+
+static inline uint32_t mnPackSNorm(float value, int bits) {
+    float max = (float) ((1 << (bits - 1)) - 1);
+    float clamped = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+
+    int32_t integer = (int32_t) roundf(clamped * max);
+
+    return (uint32_t) integer & ((1u << bits) - 1);
+}
+
+/*
+ * Matches GL_INT_2_10_10_10_REV, x in the lowest bits.
+ */
+static inline uint32_t mnPackSNorm1010102(const float in[3], float w) {
+    return mnPackSNorm(in[0], 10) |
+           (mnPackSNorm(in[1], 10) << 10) |
+           (mnPackSNorm(in[2], 10) << 20) |
+           (mnPackSNorm(w, 2) << 30);
+}
+
+static inline void mnPackVertex(const float position[3], const float texture[2], const float normal[3],
+                                const float tangent[3], PackedVertex& out) {
+    out.position[0] = position[0];
+    out.position[1] = position[1];
+    out.position[2] = position[2];
+    out.texture[0] = mnPackHalf(texture[0]);
+    out.texture[1] = mnPackHalf(texture[1]);
+    out.normal = mnPackSNorm1010102(normal, 1);
+    out.tangent = mnPackSNorm1010102(tangent, 1);
+}
+
+#endif //VERTEX_PACKING_H
@@ -102,7 +102,7 @@ struct WavefrontTemporary {
     Vector3* vertices;
     Vector3* normals;
     Vector2* textures;
-    uint16_t* indices;
+    uint32_t* indices;
 };
 
 static void mnWavefrontTemporaryInit(HeapAllocator& allocator, WavefrontTemporary* temporary, bool forceNotIndexed) {
@@ -123,7 +123,7 @@ static void mnWavefrontTemporaryInit(HeapAllocator& allocator, WavefrontTemporar
     temporary->indices = nullptr;
 
     if (!forceNotIndexed)
-        temporary->indices = (uint16_t*)allocator.allocate(sizeof(uint16_t) * temporary->allocatedIndices);
+        temporary->indices = (uint32_t*)allocator.allocate(sizeof(uint32_t) * temporary->allocatedIndices);
 }
 
 static void mnWavefrontTemporaryDestroy(HeapAllocator& allocator, WavefrontTemporary* temporary) {
@@ -145,8 +145,8 @@ static void mnWavefrontCopy(HeapAllocator& allocator, WavefrontObject* currentOb
 
     if(!temporary->forceNotIndexed) {
         currentObject->numberIndices = temporary->indexCount;
-        currentObject->indices = (uint16_t*)allocator.allocate(sizeof(uint16_t) * temporary->indexCount);
-        memcpy(currentObject->indices, temporary->indices, sizeof(uint16_t) * temporary->indexCount);
+        currentObject->indices = (uint32_t*)allocator.allocate(sizeof(uint32_t) * temporary->indexCount);
+        memcpy(currentObject->indices, temporary->indices, sizeof(uint32_t) * temporary->indexCount);
     }
 
     for(int i = 0; i < temporary->vertexCount; i++) {
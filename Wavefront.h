@@ -36,7 +36,7 @@ struct WavefrontObject {
     Vector2* texture;
 
     int numberIndices;
-    uint16_t* indices;
+    uint32_t* indices;
 };
 
 struct Wavefront {
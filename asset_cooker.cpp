@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <chrono>
+
+#include "Vector.h"
+#include "Allocator.h"
+#include "Device.h"
+#include "Commands.h"
+#include "RenderQueue.h"
+#include "Material.h"
+#include "ModelManager.h"
+#include "TextureManager.h"
+#include "AssetArchive.h"
+
+/*
+ * Cooks the Wavefront models and the TGA/JPEG textures found under the given
+ * directories into one archive. Models go through the same clustering,
+ * simplification and index ordering as loadWavefront and textures get their
+ * whole mip chain, so loading is only mapping. Paths are kept as given, run it
+ * from the directory the demos load from.
+ *
+ * usage: asset_cooker [archive] [directories or files...]
+ *        defaults to assets.pack models images
+ */
+
+static int cooked;
+
+static bool hasExtension(const char* path, const char* extension) {
+    size_t length = strlen(path);
+    size_t extensionLength = strlen(extension);
+
+    return length > extensionLength && strcmp(path + length - extensionLength, extension) == 0;
+}
+
+static void cook(HeapAllocator& allocator, ArchiveWriter& writer, const char* path) {
+    struct stat info;
+
+    if (stat(path, &info) != 0) {
+        printf("%s: not found\n", path);
+        return;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        DIR* dir = opendir(path);
+
+        if (dir == nullptr)
+            return;
+
+        char child[1024];
+
+        while (dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            cook(allocator, writer, child);
+        }
+
+        closedir(dir);
+        return;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (hasExtension(path, ".obj"))
+        ModelManager::cookWavefront(allocator, path, writer);
+    else if (hasExtension(path, ".tga") || hasExtension(path, ".jpg"))
+        TextureManager::cookTexture(allocator, path, writer);
+    else
+        return;
+
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    printf("%s: %.1f ms\n", path, elapsed.count() * 1000.0);
+
+    cooked++;
+}
+
+int main(int argc, char* argv[]) {
+    const char* filename = argc > 1 ? argv[1] : "assets.pack";
+
+    HeapAllocator heapAllocator;
+
+    ArchiveWriter writer(heapAllocator);
+
+    if (!writer.open(filename)) {
+        printf("can't write %s\n", filename);
+        return 1;
+    }
+
+    if (argc > 2) {
+        for (int i = 2; i < argc; i++)
+            cook(heapAllocator, writer, argv[i]);
+    } else {
+        cook(heapAllocator, writer, "models");
+        cook(heapAllocator, writer, "images");
+    }
+
+    uint64_t size = writer.close();
+
+    if (size == 0) {
+        printf("can't write %s\n", filename);
+        return 1;
+    }
+
+    printf("%s: %d assets, %.1f MB\n", filename, cooked, size / (1024.0 * 1024.0));
+
+    return 0;
+}
@@ -19,6 +19,7 @@
 #include "Device.h"
 #include "Commands.h"
 #include "RenderQueue.h"
+#include "Profiler.h"
 #include "Text.h"
 #include "Material.h"
 #include "ModelManager.h"
@@ -30,6 +31,7 @@ Rect viewport = {};
 int framebufferIndex = 9;
 float angle = 0;
 bool autoAngle = true;
+bool printProfile = false;
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -51,6 +53,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
         case GLFW_KEY_SPACE:
             autoAngle = !autoAngle;
             break;
+        case GLFW_KEY_P:
+            printProfile = true;
+            break;
         case GLFW_KEY_0:
             framebufferIndex = 0;
             break;
@@ -311,12 +316,18 @@ int main() {
     Model* sphereModel = modelManager.createSphere("sphere01", 1.0, 20);
     Model* quadModel = modelManager.createQuad("quad");
 
+    device.setProgramCache("programs");
+
     Program cubeShader = device.createProgram(commonSource, cube_shader_vert, cube_shader_frag, nullptr);
     Program initShader = device.createProgram(commonSource, cube_shader_vert, dual_init_frag, nullptr);
     Program dualPeelShader = device.createProgram(commonSource, dual_peel_vert, dual_peel_frag, nullptr);
     Program blendShader = device.createProgram(commonSource, blend_vert, blend_frag, nullptr);
     Program finalShader = device.createProgram(commonSource, blend_vert, final_frag, nullptr);
 
+    const ProgramCacheStatistics& programCache = device.getProgramCacheStatistics();
+    printf("Programs: %d from cache in %.1f ms, %d compiled in %.1f ms\n",
+           programCache.hits, programCache.loadTime * 1000, programCache.misses, programCache.compileTime * 1000);
+
     struct In_InstanceData {
         Matrix4 in_Rotation;
         Vector4 in_Color;
@@ -434,6 +445,28 @@ int main() {
     CommandBuffer* stage3[LAYERS] = {nullptr};
     CommandBuffer* stage4 = nullptr;
 
+    Profiler profiler(device, heapAllocator);
+    active_profiler = &profiler;
+
+    //one scope for the initialization, one per peeled layer and one for the final pass
+    char passNames[LAYERS + 1][16];
+    CommandBuffer* passBegin[LAYERS + 1];
+
+    for (int i = 0; i <= LAYERS; i++) {
+        if (i == 0)
+            snprintf(passNames[i], sizeof(passNames[i]), "Initialize");
+        else if (i == LAYERS)
+            snprintf(passNames[i], sizeof(passNames[i]), "Final");
+        else
+            snprintf(passNames[i], sizeof(passNames[i]), "Layer %d", i);
+
+        passBegin[i] = CommandBuffer::create(heapAllocator, 1);
+        ProfileBegin::create(passBegin[i], passNames[i]);
+    }
+
+    CommandBuffer* passEnd = CommandBuffer::create(heapAllocator, 1);
+    ProfileEnd::create(passEnd);
+
     double current = glfwGetTime();
     double inc = 0;
     int fps = 0;
@@ -493,6 +526,7 @@ int main() {
             BindProgram::create(stage1, initShader);
         }
 
+        renderQueue.submit(0, &passBegin[0], 1);
         ModelInstance::drawNoMaterial(modelInstance, 0, renderQueue, stage1);
 
         //2. Dual Depth Peeling + Blending
@@ -502,11 +536,12 @@ int main() {
             SetDrawBuffers::create(clearColorBuffer, (1 << 6));
             ClearColor::create(clearColorBuffer, 0, bg[0], bg[1], bg[2], 0);
             BindProgram::create(clearColorBuffer, blendShader);
-            BindTexture::create(clearColorBuffer, stained_glass, textureManager.getLinear(), 0);
+            BindTexture::create(clearColorBuffer, stained_glass, textureManager.getTrilinear(), 0);
         }
 
         //Model::draw(quadModel, 0, renderQueue, clearColorBuffer);
         renderQueue.submit(0, &clearColorBuffer, 1);
+        renderQueue.submit(0, &passEnd, 1);
 
         int currId = 0;
         for (int layer = 1; layer < LAYERS; layer++) {
@@ -529,9 +564,10 @@ int main() {
                 BindProgram::create(stage2[layer], dualPeelShader);
                 BindTexture::create(stage2[layer], depthTexId[prevId], textureManager.getNearest(), 0);
                 BindTexture::create(stage2[layer], frontTexId[prevId], textureManager.getNearest(), 1);
-                BindTexture::create(stage2[layer], stained_glass, textureManager.getLinear(), 2);
+                BindTexture::create(stage2[layer], stained_glass, textureManager.getTrilinear(), 2);
             }
 
+            renderQueue.submit(0, &passBegin[layer], 1);
             ModelInstance::drawNoMaterial(modelInstance, 0, renderQueue, stage2[layer]);
 
             //fullscreen pass
@@ -546,6 +582,7 @@ int main() {
             }
 
             Model::draw(quadModel, 0, renderQueue, stage3[layer]);
+            renderQueue.submit(0, &passEnd, 1);
         }
 
         //3. Final pass
@@ -563,7 +600,9 @@ int main() {
             BindTexture::create(stage4, backBlenderTexId, {0}, 2);
         }
 
+        renderQueue.submit(0, &passBegin[LAYERS], 1);
         Model::draw(quadModel, 0, renderQueue, stage4);
+        renderQueue.submit(0, &passEnd, 1);
 
         renderQueue.sendToDevice();
 
@@ -583,6 +622,14 @@ int main() {
         const float color[3] = {1, 1, 1};
         textManager.printText(fontRegular, {0}, color, 10, 30, "Dual Depth Peeling");
 
+        if (printProfile) {
+            profiler.printSummary(stdout);
+            printProfile = false;
+        }
+
+        profiler.endFrame();
+        device.endFrame();
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -623,6 +670,9 @@ int main() {
             CommandBuffer::destroy(heapAllocator, stage3[i]);
     }
     CommandBuffer::destroy(heapAllocator, stage4);
+    CommandBuffer::destroy(heapAllocator, passEnd);
+    for (int i = 0; i <= LAYERS; i++)
+        CommandBuffer::destroy(heapAllocator, passBegin[i]);
 
     return 0;
 }
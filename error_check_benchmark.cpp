@@ -0,0 +1,153 @@
+#include <GL/gl3w.h>
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Device.h"
+
+/*
+ * Measures the CPU cost of each error checking strategy on a draw heavy frame.
+ *
+ * usage: error_check_benchmark [draws per frame] [frames]
+ */
+
+#define STR(x) #x
+
+const char* commonSource = STR(
+\n#define POSITION 0\n
+);
+
+const char* vertexSource = STR(
+layout(location = POSITION) in vec3 in_Position;
+
+void main() {
+    gl_Position = vec4(in_Position, 1);
+}
+);
+
+const char* fragmentSource0 = STR(
+out vec4 out_Color;
+
+void main() {
+    out_Color = vec4(1, 0, 0, 1);
+}
+);
+
+const char* fragmentSource1 = STR(
+out vec4 out_Color;
+
+void main() {
+    out_Color = vec4(0, 1, 0, 1);
+}
+);
+
+const char* modeNames[] = {
+        "none",
+        "frame",
+        "call",
+        "debug",
+};
+
+int main(int argc, char* argv[]) {
+    int drawsPerFrame = argc > 1 ? atoi(argv[1]) : 5000;
+    int frames = argc > 2 ? atoi(argv[2]) : 100;
+
+    if (!glfwInit())
+        return -1;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
+    GLFWwindow* window = glfwCreateWindow(64, 64, "Error Check Benchmark", NULL, NULL);
+
+    if (!window) {
+        glfwTerminate();
+        return -1;
+    }
+
+    glfwMakeContextCurrent(window);
+
+    glfwSwapInterval(0);
+
+    if (gl3wInit()) {
+        return -1;
+    }
+
+    Device device;
+
+    float vertices[] = {
+            -0.01f, -0.01f, 0,
+            +0.01f, -0.01f, 0,
+            +0.00f, +0.01f, 0,
+    };
+
+    VertexBuffer vertexBuffer = device.createStaticVertexBuffer(sizeof(vertices), vertices);
+
+    VertexDeclaration vertexDeclaration = {VertexFloat3, 0, 0, vertexBuffer};
+    VertexArray vertexArray = device.createVertexArray(&vertexDeclaration, 1, {0});
+
+    Program programs[] = {
+            device.createProgram(commonSource, vertexSource, fragmentSource0, nullptr),
+            device.createProgram(commonSource, vertexSource, fragmentSource1, nullptr),
+    };
+
+    printf("%d draws per frame, %d frames\n", drawsPerFrame, frames);
+    printf("%-8s %12s %12s %12s\n", "mode", "ms/frame", "us/draw", "finish ms");
+
+    for (int mode = ERROR_CHECK_NONE; mode <= ERROR_CHECK_DEBUG_OUTPUT; mode++) {
+        device.setErrorCheckMode((ErrorCheckMode) mode);
+
+        if (device.getErrorCheckMode() != mode) {
+            printf("%-8s %12s\n", modeNames[mode], "unsupported");
+            continue;
+        }
+
+        //warm up the driver before timing
+        for (int i = 0; i < 10; i++) {
+            device.bindProgram(programs[i & 1]);
+            device.bindVertexArray(vertexArray);
+            device.drawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glFinish();
+
+        //only submission is timed, the finish keeps the queue from filling up and is reported apart
+        double elapsed = 0;
+        double finished = 0;
+
+        for (int frame = 0; frame < frames; frame++) {
+            double start = glfwGetTime();
+
+            for (int i = 0; i < drawsPerFrame; i++) {
+                device.bindProgram(programs[i & 1]);
+                device.bindVertexArray(vertexArray);
+                device.drawArrays(GL_TRIANGLES, 0, 3);
+            }
+
+            device.endFrame();
+
+            double submitted = glfwGetTime();
+            glFinish();
+
+            elapsed += submitted - start;
+            finished += glfwGetTime() - submitted;
+        }
+
+        printf("%-8s %12.3f %12.3f %12.3f\n", modeNames[mode],
+               elapsed * 1000.0 / frames,
+               elapsed * 1000000.0 / ((double) frames * drawsPerFrame),
+               finished * 1000.0 / frames);
+    }
+
+    device.destroyProgram(programs[0]);
+    device.destroyProgram(programs[1]);
+    device.destroyVertexArray(vertexArray);
+    device.destroyVertexBuffer(vertexBuffer);
+
+    glfwTerminate();
+    return 0;
+}
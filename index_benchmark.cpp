@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#include "Vector.h"
+#include "Allocator.h"
+#include "Device.h"
+#include "Commands.h"
+#include "RenderQueue.h"
+#include "Material.h"
+#include "ModelManager.h"
+
+/*
+ * Loads meshes through the ModelManager and reports how the post-transform
+ * cache would do with their indices as generated or read from the file and as
+ * uploaded after the index ordering. The cache is simulated on the CPU and the
+ * null device backend is linked, so no GPU is involved.
+ *
+ * usage: index_benchmark [wavefront file] [sphere slices]
+ */
+
+static void printStatistics(const char* name, const IndexStatistics& statistics, double milliseconds) {
+    const VertexCacheStatistics& loaded = statistics.loaded;
+    const VertexCacheStatistics& optimized = statistics.optimized;
+
+    printf("%s: %d triangles, %d vertices, loaded in %.1f ms\n", name, loaded.triangles, loaded.vertices,
+           milliseconds);
+    printf("  %-10s %8s %8s %12s\n", "", "ACMR", "ATVR", "transformed");
+    printf("  %-10s %8.3f %8.3f %12d\n", "loaded", loaded.acmr, loaded.atvr, loaded.transformed);
+    printf("  %-10s %8.3f %8.3f %12d\n", "optimized", optimized.acmr, optimized.atvr, optimized.transformed);
+}
+
+int main(int argc, char* argv[]) {
+    const char* filename = argc > 1 ? argv[1] : "models/venus.obj";
+    int slices = argc > 2 ? atoi(argv[2]) : 64;
+
+    HeapAllocator heapAllocator;
+
+    Device device;
+
+    ModelManager modelManager(heapAllocator, device);
+
+    printf("FIFO post-transform cache of %d vertices\n", VERTEX_CACHE_SIZE);
+
+    IndexStatistics statistics;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    Model* sphereModel = modelManager.createSphere("sphere", 1.0, slices, &statistics);
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    printStatistics("sphere", statistics, elapsed.count() * 1000.0);
+
+    start = std::chrono::high_resolution_clock::now();
+    Model* model = modelManager.loadWavefront(filename, false, &statistics);
+    elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    printStatistics(filename, statistics, elapsed.count() * 1000.0);
+
+    modelManager.destroyModel(model);
+    modelManager.destroyModel(sphereModel);
+
+    return 0;
+}
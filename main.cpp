@@ -14,10 +14,16 @@
 #include "Device.h"
 #include "Commands.h"
 #include "RenderQueue.h"
+#include "RenderStatistics.h"
+#include "UniformArena.h"
+#include "Profiler.h"
+#include "TransformHierarchy.h"
 #include "Text.h"
 #include "Material.h"
+#include "MaterialManager.h"
 #include "ModelManager.h"
 #include "TextureManager.h"
+#include "InstanceBatcher.h"
 #include "Shaders.h"
 
 Rect viewport = {};
@@ -30,6 +36,8 @@ enum ProjectionType {
 
 ProjectionType projection = PERSPECTIVE;
 
+bool printProfile = false;
+
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
@@ -54,6 +62,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 
     if (key == GLFW_KEY_3 && action == GLFW_RELEASE)
         projection = ORTHO;
+
+    if (key == GLFW_KEY_P && action == GLFW_RELEASE)
+        printProfile = true;
 }
 
 void framebuffer_callback(GLFWwindow* window, int width, int height) {
@@ -70,6 +81,10 @@ int main(int argc, char* argv[]) {
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    const char* errorCheck = getenv("GL_ERROR_CHECK");
+    if (errorCheck != nullptr && strcmp(errorCheck, "debug") == 0)
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+
     GLFWwindow* window = glfwCreateWindow(640, 480, "Simple example", NULL, NULL);
 
     if (!window) {
@@ -94,6 +109,7 @@ int main(int argc, char* argv[]) {
 
     ModelManager modelManager(heapAllocator, device);
     TextureManager textureManager(heapAllocator, device);
+    MaterialManager materialManager(heapAllocator);
     TextManager textManager(heapAllocator, device);
 
     Font fontRegular = textManager.loadFont("./fonts/OpenSans-Regular.ttf", 48);
@@ -106,11 +122,17 @@ int main(int argc, char* argv[]) {
     int BINDING_POINT_FRAME_DATA = 1;
     int BINDING_POINT_LIGHT_DATA = 2;
 
+    device.setProgramCache("programs");
+
     Program programOpaque = device.createProgram(commonSource, vertexSource, fragmentSource, nullptr);
     Program programTransparent = device.createProgram(commonSource, vertexTransparencySource, fragmentTransparencySource, nullptr);
     Program quadProgram = device.createProgram(commonSource, quadVertexSource, quadFragmentSource, quadGeometrySource);
     Program copyProgram = device.createProgram(commonSource, quadVertexSource, copyFragmentSource, quadGeometrySource);
 
+    const ProgramCacheStatistics& programCache = device.getProgramCacheStatistics();
+    printf("Programs: %d from cache in %.1f ms, %d compiled in %.1f ms\n",
+           programCache.hits, programCache.loadTime * 1000, programCache.misses, programCache.compileTime * 1000);
+
     device.setTextureBindingPoint(programOpaque, "in_MainTex", 0);
     device.setTextureBindingPoint(programOpaque, "in_BumpMap", 1);
     device.setConstantBufferBindingPoint(programOpaque, "in_InstanceData", BINDING_POINT_INSTANCE_DATA);
@@ -145,10 +167,10 @@ int main(int argc, char* argv[]) {
     };
 
     In_FrameData in_frameData;
-    In_InstanceData in_sphere4Instances[4];
-    In_InstanceData in_sphere2Instances[2];
-    In_InstanceData in_plane1Instance[1];
-    In_InstanceData in_planeTranspInstance[1];
+    In_InstanceData* in_sphere4Instances;
+    In_InstanceData* in_sphere2Instances;
+    In_InstanceData* in_plane1Instance;
+    In_InstanceData* in_planeTranspInstance;
 
     uint32_t pixel = 0x00ff0000;
     uint32_t pixels[] = {pixel, pixel, pixel, pixel};
@@ -162,37 +184,40 @@ int main(int argc, char* argv[]) {
     bumpedDiffuse.program = programOpaque;
     bumpedDiffuse.mainUnit = 0;
     bumpedDiffuse.mainTex = texture0;
-    bumpedDiffuse.mainSampler = textureManager.getLinear();
+    bumpedDiffuse.mainSampler = textureManager.getTrilinear();
     bumpedDiffuse.bumpUnit = 1;
     bumpedDiffuse.bumpMap = texture1;
-    bumpedDiffuse.bumpSampler = textureManager.getNearest();
-    Material* diffuseMaterial = Material::create(heapAllocator, &bumpedDiffuse);
+    bumpedDiffuse.bumpSampler = textureManager.getTrilinear();
+    Material* diffuseMaterial = materialManager.createMaterial(bumpedDiffuse);
 
     MaterialTransparency transparency;
     transparency.program = programTransparent;
     transparency.mainUnit = 0;
     transparency.mainTex = texture2;
-    transparency.mainSampler = textureManager.getLinear();
+    transparency.mainSampler = textureManager.getTrilinear();
     transparency.bumpUnit = 1;
     transparency.bumpMap = texture3;
     transparency.bumpSampler = textureManager.getNearest();
     transparency.alpha = 0.5;
-    Material* transparentMaterial = Material::create(heapAllocator, &transparency);
+    Material* transparentMaterial = materialManager.createMaterial(transparency);
 
     MaterialBumpedDiffuse bumpedDiffuse2;
     bumpedDiffuse2.program = programOpaque;
     bumpedDiffuse2.mainUnit = 0;
     bumpedDiffuse2.mainTex = texture2;
-    bumpedDiffuse2.mainSampler = textureManager.getLinear();
+    bumpedDiffuse2.mainSampler = textureManager.getTrilinear();
     bumpedDiffuse2.bumpUnit = 1;
     bumpedDiffuse2.bumpMap = texture3;
     bumpedDiffuse2.bumpSampler = textureManager.getNearest();
-    Material* backgroundMaterial = Material::create(heapAllocator, &bumpedDiffuse2);
+    Material* backgroundMaterial = materialManager.createMaterial(bumpedDiffuse2);
+
+    //the arena only holds the instance data, the batcher uploads what is visible
+    UniformArena instanceArena(device, heapAllocator, 4 * 1024);
 
-    ConstantBuffer sphere4Instances = device.createConstantBuffer(4 * sizeof(In_InstanceData));
-    ConstantBuffer sphere2Instances = device.createConstantBuffer(2 * sizeof(In_InstanceData));
-    ConstantBuffer plane1Instance = device.createConstantBuffer(1 * sizeof(In_InstanceData));
-    ConstantBuffer planeTranspInstance = device.createConstantBuffer(1 * sizeof(In_InstanceData));
+    ConstantBuffer sphere4Instances = instanceArena.allocate(4, &in_sphere4Instances);
+    ConstantBuffer sphere2Instances = instanceArena.allocate(2, &in_sphere2Instances);
+    ConstantBuffer plane1Instance = instanceArena.allocate(1, &in_plane1Instance);
+    ConstantBuffer planeTranspInstance = instanceArena.allocate(1, &in_planeTranspInstance);
     ConstantBuffer frameDataBuffer = device.createConstantBuffer(sizeof(In_FrameData));
 
     Model* sphereModel = modelManager.createSphere("sphere01", 1.0, 20);
@@ -213,6 +238,10 @@ int main(int argc, char* argv[]) {
 
     modelManager.destroyModel(sphereModel);
 
+    //every group can use all the LODs of its mesh
+    InstanceBatcher instanceBatcher(device, heapAllocator, sizeof(In_InstanceData), 4, 4 * MAX_MESH_LODS,
+                                    BINDING_POINT_INSTANCE_DATA);
+
     int w, h;
     glfwGetFramebufferSize(window, &w, &h);
     viewport.x = 0;
@@ -299,21 +328,8 @@ int main(int argc, char* argv[]) {
 #endif
     BindConstantBuffer::create(setupGBuffer, frameDataBuffer, BINDING_POINT_FRAME_DATA);
 
-    renderQueue.submit(0, &setupGBuffer, 1);
-
     CommandBuffer empty = {0};
 
-    //deferred shading
-    ModelInstance::draw(modelInstance0, 1, renderQueue, &empty);
-    ModelInstance::draw(modelInstance2, 2, renderQueue, &empty);
-
-    //light accumulation
-    Model::draw(quadModel, 3, renderQueue, drawQuadLight);
-
-    //transparent materials
-    ModelInstance::draw(modelInstance1, 4, renderQueue, drawTransparent);
-    ModelInstance::draw(modelInstance3, 5, renderQueue, drawTransparent);
-
     //todo change to glBlitFramebuffer?
     Framebuffer nullFramebuffer = {0};
     CommandBuffer* copyCommand = CommandBuffer::create(heapAllocator, 10);
@@ -324,15 +340,111 @@ int main(int argc, char* argv[]) {
     SetViewport::create(copyCommand, 0, &viewport);
     BindProgram::create(copyCommand, copyProgram);
     BindTexture::create(copyCommand, quadTexture, textureManager.getNearest(), 0);
-    Model::draw(quadModel, 10, renderQueue, copyCommand);
 
-    CommandBuffer* commandBuffer = renderQueue.sendToCommandBuffer();
+    RenderStatistics renderStatistics;
+
+    FILE* statisticsFile = nullptr;
+    if (argc > 1) {
+        statisticsFile = fopen(argv[1], "w");
+
+        if (statisticsFile != nullptr)
+            renderStatistics.setExportHook(RenderStatistics::exportJson, statisticsFile);
+    }
+
+    Profiler profiler(device, heapAllocator);
+    active_profiler = &profiler;
+
+    FILE* profileFile = nullptr;
+    if (argc > 2) {
+        profileFile = fopen(argv[2], "w");
+
+        if (profileFile != nullptr)
+            profiler.setChromeTrace(profileFile);
+    }
+
+    //pass markers, an end marker uses the largest depth to sort after its pass
+    const char* passNames[] = {"G-buffer", "Lighting", "Transparency", "Copy"};
+    CommandBuffer* passBegin[4];
+
+    for (int i = 0; i < 4; i++) {
+        passBegin[i] = CommandBuffer::create(heapAllocator, 1);
+        ProfileBegin::create(passBegin[i], passNames[i]);
+    }
+
+    CommandBuffer* passEnd = CommandBuffer::create(heapAllocator, 1);
+    ProfileEnd::create(passEnd);
 
     double current = glfwGetTime();
     double inc = 0;
     int fps = 0;
     int fps2 = 0;
 
+    float axisX[3] = {1, 0, 0};
+    float axisY[3] = {0, 1, 0};
+    float axisZ[3] = {0, 0, 1};
+
+    float offset0[4][3] = {
+            -.0, -.0, 0,
+            -.5, +.5, 0,
+            +.5, +.5, 0,
+            +.5, -.5, 0,
+    };
+    float scale0[3] = {0.35, 0.35, 0.35};
+    const float* axis0[4] = {axisX, axisY, axisZ, axisX};
+
+    float offset1[2][3] = {
+            -0.5, 0, 0,
+            +0.5, 0, 0
+    };
+    float scale1[3] = {0.45, 0.45, 0.45};
+
+    float offset2[3] = {0, 0, 0};
+    float scale2[3] = {0.75, 0.75, 0.75};
+
+    float offset3[3] = {0, 0, -0.5};
+    float scale3[3] = {0.5, 0.5, 0.5};
+
+    //only the spheres rotate, the planes are computed once
+    TransformHierarchy transforms(heapAllocator, 8);
+    int sphere4Transforms[4];
+    int sphere2Transforms[2];
+
+    for (int i = 0; i < 4; i++) {
+        sphere4Transforms[i] = transforms.create();
+        transforms.setPosition(sphere4Transforms[i], offset0[i]);
+        transforms.setScale(sphere4Transforms[i], scale0);
+        transforms.setOutput(sphere4Transforms[i], in_sphere4Instances[i].in_Rotation.values);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        sphere2Transforms[i] = transforms.create();
+        transforms.setPosition(sphere2Transforms[i], offset1[i]);
+        transforms.setScale(sphere2Transforms[i], scale1);
+        transforms.setOutput(sphere2Transforms[i], in_sphere2Instances[i].in_Rotation.values);
+    }
+
+    int plane1Transform = transforms.create();
+    transforms.setPosition(plane1Transform, offset2);
+    transforms.setScale(plane1Transform, scale2);
+    transforms.setOutput(plane1Transform, in_plane1Instance[0].in_Rotation.values);
+
+    int planeTranspTransform = transforms.create();
+    transforms.setPosition(planeTranspTransform, offset3);
+    transforms.setScale(planeTranspTransform, scale3);
+    transforms.setOutput(planeTranspTransform, in_planeTranspInstance[0].in_Rotation.values);
+
+    //the opaque plane hides whatever is behind it, the translucent one never does
+    Vector3 occluderVertices[] = {
+            -1.0, -1.0, 0.0,
+            -1.0, +1.0, 0.0,
+            +1.0, +1.0, 0.0,
+            +1.0, -1.0, 0.0,
+    };
+    uint32_t occluderIndices[] = {0, 1, 3, 3, 1, 2};
+
+    OcclusionBuffer occlusionBuffer(heapAllocator, 2, std::thread::hardware_concurrency());
+    renderQueue.setOcclusionBuffer(&occlusionBuffer);
+
     float angle = 0;
     while (!glfwWindowShouldClose(window)) {
         double c = glfwGetTime();
@@ -387,37 +499,19 @@ int main(int argc, char* argv[]) {
         float up[3] = {0, 1, 0};
         mnMatrix4LookAt(eye, center, up, in_frameData.view.values);
 
-        float axisX[3] = {1, 0, 0};
-        float axisY[3] = {0, 1, 0};
-        float axisZ[3] = {0, 0, 1};
-
-        float offset0[4][3] = {
-                -.0, -.0, 0,
-                -.5, +.5, 0,
-                +.5, +.5, 0,
-                +.5, -.5, 0,
-        };
-        float scale0[3] = {0.35, 0.35, 0.35};
-        mnMatrix4Transformation(axisX, angle, offset0[0], scale0, in_sphere4Instances[0].in_Rotation.values);
-        mnMatrix4Transformation(axisY, angle, offset0[1], scale0, in_sphere4Instances[1].in_Rotation.values);
-        mnMatrix4Transformation(axisZ, angle, offset0[2], scale0, in_sphere4Instances[2].in_Rotation.values);
-        mnMatrix4Transformation(axisX, angle, offset0[3], scale0, in_sphere4Instances[3].in_Rotation.values);
-
-        float offset1[2][3] = {
-                -0.5, 0, 0,
-                +0.5, 0, 0
-        };
-        float scale1[3] = {0.45, 0.45, 0.45};
-        mnMatrix4Transformation(axisY, angle, offset1[0], scale1, in_sphere2Instances[0].in_Rotation.values);
-        mnMatrix4Transformation(axisY, angle, offset1[1], scale1, in_sphere2Instances[1].in_Rotation.values);
-
-        float offset2[3] = {0, 0, 0};
-        float scale2[3] = {0.75, 0.75, 0.75};
-        mnMatrix4Transformation(axisX, 0, offset2, scale2, in_plane1Instance[0].in_Rotation.values);
-
-        float offset3[3] = {0, 0, -0.5};
-        float scale3[3] = {0.5, 0.5, 0.5};
-        mnMatrix4Transformation(axisX, 0, offset3, scale3, in_planeTranspInstance[0].in_Rotation.values);
+        for (int i = 0; i < 4; i++)
+            transforms.setRotation(sphere4Transforms[i], axis0[i], angle);
+        for (int i = 0; i < 2; i++)
+            transforms.setRotation(sphere2Transforms[i], axisY, angle);
+
+        transforms.update();
+
+        for (int i = 0; i < 4; i++)
+            ModelInstance::setTransform(modelInstance0, i, transforms.getWorldMatrix(sphere4Transforms[i]));
+        for (int i = 0; i < 2; i++)
+            ModelInstance::setTransform(modelInstance1, i, transforms.getWorldMatrix(sphere2Transforms[i]));
+        ModelInstance::setTransform(modelInstance2, 0, transforms.getWorldMatrix(plane1Transform));
+        ModelInstance::setTransform(modelInstance3, 0, transforms.getWorldMatrix(planeTranspTransform));
 
         in_sphere4Instances[0].in_Color = {1, 1, 1, 1};
         in_sphere4Instances[1].in_Color = {1, 1, 1, 1};
@@ -435,12 +529,41 @@ int main(int argc, char* argv[]) {
 
         device.copyConstantBuffer(lightPosConstantBuffer, lightData, 3 * sizeof(In_LightData));
         device.copyConstantBuffer(frameDataBuffer, &in_frameData, sizeof(In_FrameData));
-        device.copyConstantBuffer(sphere4Instances, in_sphere4Instances, 4 * sizeof(In_InstanceData));
-        device.copyConstantBuffer(sphere2Instances, in_sphere2Instances, 2 * sizeof(In_InstanceData));
-        device.copyConstantBuffer(plane1Instance, in_plane1Instance, 1 * sizeof(In_InstanceData));
-        device.copyConstantBuffer(planeTranspInstance, in_planeTranspInstance, 1 * sizeof(In_InstanceData));
 
-        CommandBuffer::execute(commandBuffer, device);
+        renderQueue.setProjectionMatrix(in_frameData.projection.values);
+        renderQueue.setViewMatrix(in_frameData.view.values);
+
+        occlusionBuffer.begin(in_frameData.projection.values, in_frameData.view.values);
+        occlusionBuffer.addOccluder(occluderVertices, occluderIndices, 6, transforms.getWorldMatrix(plane1Transform));
+        occlusionBuffer.rasterize();
+
+        renderQueue.submit(0, &passBegin[0], 1);
+        renderQueue.submit(0, &setupGBuffer, 1);
+
+        //deferred shading
+        instanceBatcher.draw(modelInstance0, in_sphere4Instances, 1, &empty);
+        instanceBatcher.draw(modelInstance2, in_plane1Instance, 1, &empty);
+        renderQueue.submit(1, SORT_KEY_DEPTH_MASK, &passEnd, 1);
+
+        //light accumulation
+        renderQueue.submit(3, &passBegin[1], 1);
+        Model::draw(quadModel, 3, renderQueue, drawQuadLight);
+        renderQueue.submit(3, SORT_KEY_DEPTH_MASK, &passEnd, 1);
+
+        //transparent materials
+        renderQueue.submit(4, &passBegin[2], 1);
+        instanceBatcher.draw(modelInstance1, in_sphere2Instances, 4, drawTransparent);
+        instanceBatcher.draw(modelInstance3, in_planeTranspInstance, 4, drawTransparent);
+        renderQueue.submit(4, SORT_KEY_DEPTH_MASK, &passEnd, 1);
+
+        renderQueue.submit(10, &passBegin[3], 1);
+        Model::draw(quadModel, 10, renderQueue, copyCommand);
+        renderQueue.submit(10, SORT_KEY_DEPTH_MASK, &passEnd, 1);
+
+        instanceBatcher.submit(renderQueue);
+
+        renderQueue.sort();
+        renderQueue.sendToDevice();
 
 #if 0
 //        glBindFramebuffer(GL_READ_FRAMEBUFFER, transparentBuffer.id); CHECK_ERROR;
@@ -471,7 +594,19 @@ int main(int argc, char* argv[]) {
         }
 
         const float white[3] = {1, 1, 1};
+        if (renderStatistics.getFrameCount() > 0) {
+            const FrameStatistics& lastFrame = renderStatistics.getFrame();
+            textManager.printText(fontRegular, nullFramebuffer, white, 10, 280, "Draws %u | Instanced %u | Triangles %llu | State changes %u",
+                                  lastFrame.device.drawCalls, lastFrame.device.instancedDrawCalls,
+                                  (unsigned long long) lastFrame.device.trianglesSubmitted, RenderStatistics::getStateChanges(lastFrame));
+        }
         textManager.printText(fontItalic, nullFramebuffer, white, 10, 230, "Fps: %d Angle: %f", fps2, angle);
+        const ProfileFrame* profileFrame = profiler.getResolvedFrame();
+        if (profileFrame != nullptr && profileFrame->gpuValid) {
+            const ProfileScope& root = profileFrame->scopes[0];
+            textManager.printText(fontRegular, nullFramebuffer, white, 10, 330, "CPU %.2f ms | GPU %.2f ms (P prints the scopes)",
+                                  (root.cpuEnd - root.cpuBegin) * 1000, (root.gpuEnd - root.gpuBegin) * 1000);
+        }
         textManager.printText(fontRegular, nullFramebuffer, white, 10, 180, "viewport: %.2f %.2f %.2f %.2f", viewport.x, viewport.y, viewport.width, viewport.height);
         textManager.printText(fontRegular, nullFramebuffer, white, 10, 130, "Memory used %ld bytes", heapAllocator.memoryUsed());
         float totalCommands = renderQueue.getExecutedCommands() + renderQueue.getSkippedCommands();
@@ -480,18 +615,31 @@ int main(int argc, char* argv[]) {
         textManager.printText(fontRegular, nullFramebuffer, white, 10, 30, "Skipped commands %d | %.2f%% ignored",
                               renderQueue.getSkippedCommands(), renderQueue.getSkippedCommands() / totalCommands * 100);
 
+        renderStatistics.endFrame(device, renderQueue, d);
+
+        if (printProfile) {
+            profiler.printSummary(stdout);
+            printProfile = false;
+        }
+
+        profiler.endFrame();
+        device.endFrame();
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    Material::destroy(heapAllocator, diffuseMaterial);
-    Material::destroy(heapAllocator, transparentMaterial);
-    Material::destroy(heapAllocator, backgroundMaterial);
+    materialManager.destroyMaterial(diffuseMaterial);
+    materialManager.destroyMaterial(transparentMaterial);
+    materialManager.destroyMaterial(backgroundMaterial);
     CommandBuffer::destroy(heapAllocator, setupGBuffer);
     CommandBuffer::destroy(heapAllocator, drawQuadLight);
-    CommandBuffer::destroy(heapAllocator, commandBuffer);
     CommandBuffer::destroy(heapAllocator, drawTransparent);
     CommandBuffer::destroy(heapAllocator, copyCommand);
+    CommandBuffer::destroy(heapAllocator, passEnd);
+
+    for (int i = 0; i < 4; i++)
+        CommandBuffer::destroy(heapAllocator, passBegin[i]);
 
     modelManager.destroyModel(quadModel);
     modelManager.destroyModelInstance(modelInstance0);
@@ -511,16 +659,20 @@ int main(int argc, char* argv[]) {
     device.destroyFramebuffer(gBuffer);
     device.destroyFramebuffer(transparentBuffer);
     device.destroyConstantBuffer(lightPosConstantBuffer);
-    device.destroyConstantBuffer(sphere4Instances);
-    device.destroyConstantBuffer(sphere2Instances);
-    device.destroyConstantBuffer(plane1Instance);
-    device.destroyConstantBuffer(planeTranspInstance);
     device.destroyConstantBuffer(frameDataBuffer);
     device.destroyProgram(programOpaque);
     device.destroyProgram(programTransparent);
     device.destroyProgram(quadProgram);
     device.destroyProgram(copyProgram);
 
+    if (statisticsFile != nullptr)
+        fclose(statisticsFile);
+
+    profiler.setChromeTrace(nullptr);
+
+    if (profileFile != nullptr)
+        fclose(profileFile);
+
     heapAllocator.dumpFreeList();
 
     glfwDestroyWindow(window);
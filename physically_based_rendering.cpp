@@ -19,10 +19,14 @@
 #include "Device.h"
 #include "Commands.h"
 #include "RenderQueue.h"
+#include "Profiler.h"
+#include "UniformArena.h"
 #include "Text.h"
 #include "Material.h"
 #include "ModelManager.h"
 #include "TextureManager.h"
+#include "AssetLoader.h"
+#include "AssetArchive.h"
 #include "Shaders.h"
 #include "Wavefront.h"
 
@@ -30,6 +34,7 @@ Rect viewport = {};
 
 float angle = 0;
 bool autoAngle = true;
+bool printProfile = false;
 
 int baseColorIndex = 1;
 
@@ -103,6 +108,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
         case GLFW_KEY_SPACE:
             autoAngle = !autoAngle;
             break;
+        case GLFW_KEY_P:
+            printProfile = true;
+            break;
         case GLFW_KEY_0:
             baseColorIndex = 0;
             break;
@@ -204,6 +212,96 @@ void main() {
 
 #include "PBRShaders.h"
 
+#define IMG_PATH "images/LancellottiChapel"
+
+struct EnvironmentMaps {
+    ImageCube irradianceImg;
+    ImageCube prefilterEnvImg[8];
+    Image integrateBRDFImg;
+    ImageCube skyboxImg;
+
+    TextureCube skyboxIrradiance;
+    TextureCube prefilterEnv;
+    TextureCube skyboxCube;
+    Texture2D integrateBRDF;
+    Texture2D skybox[6];
+};
+
+void decodeIrradiance(HeapAllocator& allocator, void* data) {
+    EnvironmentMaps* environment = (EnvironmentMaps*) data;
+
+    loadCube(allocator, IMG_PATH"/diffuse_irradiance.irr", environment->irradianceImg);
+}
+
+void finalizeIrradiance(Device& device, HeapAllocator& allocator, void* data) {
+    EnvironmentMaps* environment = (EnvironmentMaps*) data;
+
+    environment->skyboxIrradiance = createTextureCube(device, &environment->irradianceImg, 1);
+
+    for(int i = 0; i < 6; i++)
+        allocator.deallocate(environment->irradianceImg.faces[i].pixels);
+}
+
+void decodePrefilterEnv(HeapAllocator& allocator, void* data) {
+    EnvironmentMaps* environment = (EnvironmentMaps*) data;
+    char filename[256];
+
+    for(int i = 0; i < 8; i++) {
+        snprintf(filename, sizeof(filename), IMG_PATH"/prefilter_env_map_%d.irr", i);
+        loadCube(allocator, filename, environment->prefilterEnvImg[i]);
+    }
+}
+
+void finalizePrefilterEnv(Device& device, HeapAllocator& allocator, void* data) {
+    EnvironmentMaps* environment = (EnvironmentMaps*) data;
+
+    environment->prefilterEnv = createTextureCube(device, environment->prefilterEnvImg, 8);
+
+    for(int i = 0; i < 8; i++) {
+        for(int j = 0; j < 6; j++)
+            allocator.deallocate(environment->prefilterEnvImg[i].faces[j].pixels);
+    }
+}
+
+void decodeIntegrateBRDF(HeapAllocator& allocator, void* data) {
+    EnvironmentMaps* environment = (EnvironmentMaps*) data;
+
+    loadImage(allocator, IMG_PATH"/integrate_brdf.irr", environment->integrateBRDFImg);
+}
+
+void finalizeIntegrateBRDF(Device& device, HeapAllocator& allocator, void* data) {
+    EnvironmentMaps* environment = (EnvironmentMaps*) data;
+
+    environment->integrateBRDF = createTexture2D(device, environment->integrateBRDFImg);
+
+    allocator.deallocate(environment->integrateBRDFImg.pixels);
+}
+
+void decodeSkybox(HeapAllocator& allocator, void* data) {
+    ImageCube& skyboxImg = ((EnvironmentMaps*) data)->skyboxImg;
+
+    readJpeg(allocator, IMG_PATH"/posx.jpg", skyboxImg.faces[POSITIVE_X]);
+    readJpeg(allocator, IMG_PATH"/negx.jpg", skyboxImg.faces[NEGATIVE_X]);
+    readJpeg(allocator, IMG_PATH"/posy.jpg", skyboxImg.faces[POSITIVE_Y]);
+    readJpeg(allocator, IMG_PATH"/negy.jpg", skyboxImg.faces[NEGATIVE_Y]);
+    readJpeg(allocator, IMG_PATH"/posz.jpg", skyboxImg.faces[POSITIVE_Z]);
+    readJpeg(allocator, IMG_PATH"/negz.jpg", skyboxImg.faces[NEGATIVE_Z]);
+}
+
+void finalizeSkybox(Device& device, HeapAllocator& allocator, void* data) {
+    EnvironmentMaps* environment = (EnvironmentMaps*) data;
+    ImageCube& skyboxImg = environment->skyboxImg;
+
+    environment->skyboxCube = createTextureCube(device, &skyboxImg, 1);
+
+    for(int i = 0; i < 6; i++) {
+        environment->skybox[i] = device.createRGBTexture(skyboxImg.faces[i].width, skyboxImg.faces[i].height,
+                                                         skyboxImg.faces[i].pixels);
+
+        allocator.deallocate(skyboxImg.faces[i].pixels);
+    }
+}
+
 int main() {
     float v[3] = {1, 1, 1};
 
@@ -246,10 +344,19 @@ int main() {
 
     Device device;
 
+    //cooked by asset_cooker, declared first since streaming textures read from it until unloaded
+    AssetArchive archive;
+
     ModelManager modelManager(heapAllocator, device);
     TextureManager textureManager(heapAllocator, device);
     TextManager textManager(heapAllocator, device);
 
+    //the loose files are read without it
+    if (archive.open("assets.pack")) {
+        modelManager.setArchive(&archive);
+        textureManager.setArchive(&archive);
+    }
+
     Font fontBig = textManager.loadFont("./fonts/OpenSans-Bold.ttf", 96);
     Font fontSmall = textManager.loadFont("./fonts/OpenSans-Bold.ttf", 48);
 
@@ -262,59 +369,22 @@ int main() {
     const int WIDTH = 1024;
     const int HEIGHT = 1024;
 
-    ImageCube irradianceImg;
-    ImageCube prefilterEnvImg[8];
-    Image integrateBRDFImg;
-    ImageCube skyboxImg;
-
-#define IMG_PATH "images/LancellottiChapel"
-
-    loadCube(heapAllocator, IMG_PATH"/diffuse_irradiance.irr", irradianceImg);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_0.irr", prefilterEnvImg[0]);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_1.irr", prefilterEnvImg[1]);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_2.irr", prefilterEnvImg[2]);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_3.irr", prefilterEnvImg[3]);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_4.irr", prefilterEnvImg[4]);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_5.irr", prefilterEnvImg[5]);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_6.irr", prefilterEnvImg[6]);
-    loadCube(heapAllocator, IMG_PATH"/prefilter_env_map_7.irr", prefilterEnvImg[7]);
-
-    loadImage(heapAllocator, IMG_PATH"/integrate_brdf.irr", integrateBRDFImg);
-
-    readJpeg(heapAllocator, IMG_PATH"/posx.jpg", skyboxImg.faces[POSITIVE_X]);
-    readJpeg(heapAllocator, IMG_PATH"/negx.jpg", skyboxImg.faces[NEGATIVE_X]);
-    readJpeg(heapAllocator, IMG_PATH"/posy.jpg", skyboxImg.faces[POSITIVE_Y]);
-    readJpeg(heapAllocator, IMG_PATH"/negy.jpg", skyboxImg.faces[NEGATIVE_Y]);
-    readJpeg(heapAllocator, IMG_PATH"/posz.jpg", skyboxImg.faces[POSITIVE_Z]);
-    readJpeg(heapAllocator, IMG_PATH"/negz.jpg", skyboxImg.faces[NEGATIVE_Z]);
-
-    TextureCube skyboxIrradiance = createTextureCube(device, &irradianceImg, 1);
-    TextureCube prefilterEnv = createTextureCube(device, prefilterEnvImg, 8);
-    TextureCube skyboxCube = createTextureCube(device, &skyboxImg, 1);
-    Texture2D integrateBRDF = createTexture2D(device, integrateBRDFImg);
-
-    Texture2D skybox[6];
-
-    for(int i = 0; i < 6; i++) {
-        skybox[i] = device.createRGBTexture(skyboxImg.faces[i].width, skyboxImg.faces[i].height, skyboxImg.faces[i].pixels);
+    AssetLoader loader(heapAllocator, device, std::thread::hardware_concurrency());
 
-        heapAllocator.deallocate(skyboxImg.faces[i].pixels);
-        heapAllocator.deallocate(irradianceImg.faces[i].pixels);
-    }
-
-    for(int i = 0; i < 8; i++) {
-        for(int j = 0; j < 6; j++)
-            heapAllocator.deallocate(prefilterEnvImg[i].faces[j].pixels);
-    }
+    //the environment files are decoded in parallel with the rest of the startup
+    EnvironmentMaps environment;
 
-    heapAllocator.deallocate(integrateBRDFImg.pixels);
+    loader.load(decodeIrradiance, finalizeIrradiance, &environment);
+    loader.load(decodePrefilterEnv, finalizePrefilterEnv, &environment);
+    loader.load(decodeIntegrateBRDF, finalizeIntegrateBRDF, &environment);
+    loader.load(decodeSkybox, finalizeSkybox, &environment);
 
-    Texture2D normalTexture = textureManager.loadTexture("images/rockwall_normal.tga");
-    Texture2D metallicTexture = textureManager.loadTexture("images/metallic.jpg");
+    ResourceHandle normalHandle = textureManager.loadTexture("images/rockwall_normal.tga", loader, nullptr, true);
+    ResourceHandle metallicHandle = textureManager.loadTexture("images/metallic.jpg", loader, nullptr, true);
 
     Model* sphereModel = modelManager.createSphere("sphere01", 1.0, 20);
     Model* quadModel = modelManager.createQuad("quad");
-    Model* wavefront = modelManager.loadWavefront("models/venus.obj");
+    ResourceHandle wavefrontHandle = modelManager.loadWavefront("models/venus.obj", loader);
 
     struct In_InstanceData {
         Matrix4 in_Rotation;
@@ -327,23 +397,31 @@ int main() {
         Vector4 cameraPosition;
     };
 
-    ConstantBuffer sphereConstantBuffer = device.createConstantBuffer(NUMBER_SPHERES * sizeof(In_InstanceData));
+    In_InstanceData* sphereData;
+    In_InstanceData* quadData[NUMBER_QUADS];
+    In_FrameData frameData;
+
+    UniformArena instanceArena(device, heapAllocator, 4 * 1024);
+
+    ConstantBuffer sphereConstantBuffer = instanceArena.allocate(NUMBER_SPHERES, &sphereData);
     ConstantBuffer frameConstantBuffer = device.createConstantBuffer(sizeof(In_FrameData));
     ConstantBuffer materialConstantBuffer = device.createConstantBuffer(sizeof(In_MaterialData));
 
     ConstantBuffer skyboxConstantBuffer[6];
     for(int i = 0; i < 6; i++)
-        skyboxConstantBuffer[i] = device.createConstantBuffer(sizeof(In_InstanceData));
-
-    In_InstanceData sphereData[NUMBER_SPHERES];
-    In_InstanceData quadData[NUMBER_QUADS];
-    In_FrameData frameData;
+        skyboxConstantBuffer[i] = instanceArena.allocate(1, &quadData[i]);
 
     ModelInstance* sphereInstances = modelManager.createModelInstance(sphereModel, NUMBER_SPHERES, sphereConstantBuffer, BINDING_POINT_INSTANCE_DATA);
 
+    device.setProgramCache("programs");
+
     Program physicallyBasedShader = device.createProgram(commonSource, physically_based_shader_vert, physically_based_shader_frag, nullptr);
     Program drawTexture = device.createProgram(commonSource, draw_texture_vert, draw_texture_frag, nullptr);
 
+    const ProgramCacheStatistics& programCache = device.getProgramCacheStatistics();
+    printf("Programs: %d from cache in %.1f ms, %d compiled in %.1f ms\n",
+           programCache.hits, programCache.loadTime * 1000, programCache.misses, programCache.compileTime * 1000);
+
     device.setTextureBindingPoint(physicallyBasedShader, "skyboxIrradiance", 0);
     device.setTextureBindingPoint(physicallyBasedShader, "skyboxCube", 1);
     device.setTextureBindingPoint(physicallyBasedShader, "normalTexture", 2);
@@ -398,37 +476,51 @@ int main() {
 
         {
             float tx[3] = {10, 0, 0};
-            mnMatrix4Transformation(Y_AXIS, M_PI_2, tx, sc, quadData[POSITIVE_X].in_Rotation.values);
+            mnMatrix4Transformation(Y_AXIS, M_PI_2, tx, sc, quadData[POSITIVE_X]->in_Rotation.values);
         }
 
         {
             float tx[3] = {-10, 0, 0};
-            mnMatrix4Transformation(Y_AXIS, -M_PI_2, tx, sc, quadData[NEGATIVE_X].in_Rotation.values);
+            mnMatrix4Transformation(Y_AXIS, -M_PI_2, tx, sc, quadData[NEGATIVE_X]->in_Rotation.values);
         }
 
         {
             float tx[3] = {0, 10, 0};
-            mnMatrix4Transformation(X_AXIS, -M_PI_2, tx, sc, quadData[POSITIVE_Y].in_Rotation.values);
+            mnMatrix4Transformation(X_AXIS, -M_PI_2, tx, sc, quadData[POSITIVE_Y]->in_Rotation.values);
         }
 
         {
             float tx[3] = {0, -10, 0};
-            mnMatrix4Transformation(X_AXIS, M_PI_2, tx, sc, quadData[NEGATIVE_Y].in_Rotation.values);
+            mnMatrix4Transformation(X_AXIS, M_PI_2, tx, sc, quadData[NEGATIVE_Y]->in_Rotation.values);
         }
 
         {
             float tx[3] = {0, 0, 10};
-            mnMatrix4Transformation(Y_AXIS, 0, tx, sc, quadData[POSITIVE_Z].in_Rotation.values);
+            mnMatrix4Transformation(Y_AXIS, 0, tx, sc, quadData[POSITIVE_Z]->in_Rotation.values);
         }
 
         {
             float tx[3] = {0, 0, -10};
-            mnMatrix4Transformation(Y_AXIS, M_PI, tx, sc, quadData[NEGATIVE_Z].in_Rotation.values);
+            mnMatrix4Transformation(Y_AXIS, M_PI, tx, sc, quadData[NEGATIVE_Z]->in_Rotation.values);
         }
     }
 
     RenderQueue renderQueue(device, heapAllocator);
 
+    const char* passNames[] = {"Scene", "Skybox"};
+    Profiler profiler(device, heapAllocator);
+    active_profiler = &profiler;
+
+    CommandBuffer* passBegin[2];
+    CommandBuffer* passEnd = CommandBuffer::create(heapAllocator, 1);
+    ProfileEnd::create(passEnd);
+
+    for (int i = 0; i < 2; i++) {
+        passBegin[i] = CommandBuffer::create(heapAllocator, 1);
+        ProfileBegin::create(passBegin[i], passNames[i]);
+    }
+
+
     double current = glfwGetTime();
     double inc = 0;
     int fps = 0;
@@ -444,6 +536,19 @@ int main() {
     materialData.approximationDiffuse = 0;
     baseColorIndex = 0;
 
+    //the passes bind the textures once, so everything must be there before the first frame
+    loader.finish();
+
+    TextureCube skyboxIrradiance = environment.skyboxIrradiance;
+    TextureCube prefilterEnv = environment.prefilterEnv;
+    TextureCube skyboxCube = environment.skyboxCube;
+    Texture2D integrateBRDF = environment.integrateBRDF;
+    Texture2D* skybox = environment.skybox;
+
+    Texture2D normalTexture = textureManager.getTexture(normalHandle);
+    Texture2D metallicTexture = textureManager.getTexture(metallicHandle);
+    Model* wavefront = modelManager.getModel(wavefrontHandle);
+
     while (!glfwWindowShouldClose(window)) {
         double c = glfwGetTime();
         double d = c - current;
@@ -473,17 +578,19 @@ int main() {
         frameData.cameraPosition.y = eye[1];
         frameData.cameraPosition.z = eye[2];
 
+        //the spheres have radius 1 and the textures wrap around them, about twice their size on screen
+        float sphereSize = viewport.height / (mnVector3Length(eye) * tanf(55 * M_PI / 360.0));
+        textureManager.requestTexture(normalTexture, 2 * sphereSize);
+        textureManager.requestTexture(metallicTexture, 2 * sphereSize);
+
         materialData.baseColor.x = baseColors[baseColorIndex].x;
         materialData.baseColor.y = baseColors[baseColorIndex].y;
         materialData.baseColor.z = baseColors[baseColorIndex].z;
 
-        device.copyConstantBuffer(sphereConstantBuffer, sphereData, sizeof(sphereData));
+        instanceArena.upload();
         device.copyConstantBuffer(frameConstantBuffer, &frameData, sizeof(In_FrameData));
         device.copyConstantBuffer(materialConstantBuffer, &materialData, sizeof(In_MaterialData));
 
-        for(int i = 0; i < 6; i++)
-            device.copyConstantBuffer(skyboxConstantBuffer[i], &quadData[i], sizeof(In_InstanceData));
-
         if (scenePassCommon == nullptr) {
             scenePassCommon = CommandBuffer::create(heapAllocator, 100);
 
@@ -514,14 +621,18 @@ int main() {
             BindProgram::create(scenePass, physicallyBasedShader);
             BindTexture::create(scenePass, skyboxIrradiance, {0}, 0);
             BindTexture::create(scenePass, skyboxCube, {0}, 1);
-            BindTexture::create(scenePass, normalTexture, textureManager.getLinear(), 2);
+            BindTexture::create(scenePass, normalTexture, textureManager.getTrilinear(), 2);
             BindTexture::create(scenePass, prefilterEnv, {0}, 3);
             BindTexture::create(scenePass, integrateBRDF, {0}, 4);
             BindTexture::create(scenePass, metallicTexture, {0}, 5);
         }
 
+        renderQueue.submit(0, &passBegin[0], 1);
         renderQueue.submit(0, &scenePassCommon, 1);
         ModelInstance::drawNoMaterial(sphereInstances, 0, renderQueue, scenePass);
+        renderQueue.submit(0, &passEnd, 1);
+
+        renderQueue.submit(0, &passBegin[1], 1);
 
         for(int i = 0; i < 6; i++) {
             if (skyboxPass[i] == nullptr) {
@@ -537,6 +648,8 @@ int main() {
             Model::draw(quadModel, 0, renderQueue, skyboxPass[i]);
         }
 
+        renderQueue.submit(0, &passEnd, 1);
+
         renderQueue.sendToDevice();
 
 #if 0
@@ -566,6 +679,22 @@ int main() {
         textManager.printText(fontSmall, {0}, color, 10, 120, "Roughness: %.2f", materialData.roughness);
         textManager.printText(fontBig, {0}, color, 10, 30, "Physically Based Rendering");
 
+        textureManager.updateStreaming();
+
+        if (printProfile) {
+            profiler.printSummary(stdout);
+
+            TextureStreamingStatistics streaming = textureManager.getStreamingStatistics();
+            printf("texture streaming: %u textures, %llu KB resident, %llu KB requested, %llu KB budget\n",
+                   streaming.textures, (unsigned long long) streaming.residentBytes / 1024,
+                   (unsigned long long) streaming.requestedBytes / 1024, (unsigned long long) streaming.budget / 1024);
+
+            printProfile = false;
+        }
+
+        profiler.endFrame();
+        device.endFrame();
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -579,11 +708,8 @@ int main() {
 
     modelManager.destroyModelInstance(sphereInstances);
 
-    device.destroyConstantBuffer(sphereConstantBuffer);
     device.destroyConstantBuffer(frameConstantBuffer);
     device.destroyConstantBuffer(materialConstantBuffer);
-    for(int i = 0; i < 6; i++)
-        device.destroyConstantBuffer(skyboxConstantBuffer[i]);
 
     device.destroyTexture(skyboxIrradiance);
     device.destroyTexture(prefilterEnv);
@@ -603,4 +729,8 @@ int main() {
     heapAllocator.deallocate(scenePass);
     for(int i = 0; i < 6; i++)
         heapAllocator.deallocate(skyboxPass[i]);
+
+    heapAllocator.deallocate(passEnd);
+    for (int i = 0; i < 2; i++)
+        heapAllocator.deallocate(passBegin[i]);
 }
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+
+#include "Vector.h"
+#include "Matrix.h"
+#include "Allocator.h"
+#include "Device.h"
+#include "Commands.h"
+#include "RenderQueue.h"
+#include "RenderStatistics.h"
+#include "UniformArena.h"
+#include "InstanceBatcher.h"
+#include "OcclusionBuffer.h"
+#include "Material.h"
+#include "MaterialManager.h"
+#include "ModelManager.h"
+
+/*
+ * Measures the CPU cost of building, sorting and submitting a frame. It links the
+ * null device backend, so no window or driver is involved and the numbers only
+ * depend on the engine.
+ *
+ * usage: submission_benchmark [model instances] [frames] [trace file|-] [batched] [occlusion]
+ *
+ * With batched set to 1 the model instances go through an InstanceBatcher and
+ * become one instanced draw per material. With occlusion set to 1 a wall in the
+ * middle of the scene is rasterized as an occluder every frame and hides the
+ * instances behind it.
+ */
+
+const int MATERIAL_COUNT = 8;
+const int INSTANCES_PER_MODEL = 4;
+
+//every material gets at most this many instances, one batched draw per LOD
+const int INSTANCES_PER_DRAW = MAX_ARENA_BLOCKS * INSTANCES_PER_MODEL / MATERIAL_COUNT;
+
+struct InstanceData {
+    float rotation[16];
+    float color[4];
+};
+
+int main(int argc, char* argv[]) {
+    int modelInstances = argc > 1 ? atoi(argv[1]) : MAX_ARENA_BLOCKS;
+    int frames = argc > 2 ? atoi(argv[2]) : 1000;
+    const char* traceFile = argc > 3 && strcmp(argv[3], "-") != 0 ? argv[3] : nullptr;
+    bool batched = argc > 4 && atoi(argv[4]) != 0;
+    bool occlusion = argc > 5 && atoi(argv[5]) != 0;
+
+    if (modelInstances < 1 || modelInstances > MAX_ARENA_BLOCKS) {
+        printf("model instances must be between 1 and %d\n", MAX_ARENA_BLOCKS);
+        return -1;
+    }
+
+    HeapAllocator heapAllocator;
+
+    Device device;
+
+    FILE* trace = nullptr;
+
+    if (traceFile != nullptr) {
+        trace = fopen(traceFile, "w");
+
+        if (trace == nullptr) {
+            printf("Could not open %s\n", traceFile);
+            return -1;
+        }
+
+        device.setTrace(trace);
+    }
+
+    ModelManager modelManager(heapAllocator, device);
+    MaterialManager materialManager(heapAllocator);
+    RenderQueue renderQueue(device, heapAllocator);
+    RenderStatistics renderStatistics;
+
+    Sampler sampler = device.createSampler(GL_LINEAR, GL_LINEAR, GL_LINEAR);
+    Texture2D textures[MATERIAL_COUNT];
+    Program programs[2];
+    Material* materials[MATERIAL_COUNT];
+
+    programs[0] = device.createProgram("", "", "", nullptr);
+    programs[1] = device.createProgram("", "", "", nullptr);
+
+    for (int i = 0; i < MATERIAL_COUNT; i++) {
+        textures[i] = device.createRGBATexture(256, 256, nullptr);
+
+        MaterialBumpedDiffuse bumpedDiffuse;
+        bumpedDiffuse.program = programs[i & 1];
+        bumpedDiffuse.mainUnit = 0;
+        bumpedDiffuse.mainTex = textures[i];
+        bumpedDiffuse.mainSampler = sampler;
+        bumpedDiffuse.bumpUnit = 1;
+        bumpedDiffuse.bumpMap = textures[(i + 1) % MATERIAL_COUNT];
+        bumpedDiffuse.bumpSampler = sampler;
+        materials[i] = materialManager.createMaterial(bumpedDiffuse);
+    }
+
+    size_t blockSize = INSTANCES_PER_MODEL * sizeof(InstanceData);
+    size_t alignment = device.getConstantBufferAlignment();
+    blockSize = (blockSize + alignment - 1) / alignment * alignment;
+
+    UniformArena instanceArena(device, heapAllocator, modelInstances * blockSize);
+
+    Model* sphereModel = modelManager.createSphere("sphere01", 1.0, 20);
+
+    ModelInstance** instances = (ModelInstance**) heapAllocator.allocate(modelInstances * sizeof(ModelInstance*));
+    InstanceData** instanceData = (InstanceData**) heapAllocator.allocate(modelInstances * sizeof(InstanceData*));
+
+    for (int i = 0; i < modelInstances; i++) {
+        ConstantBuffer constantBuffer = instanceArena.allocate(INSTANCES_PER_MODEL, &instanceData[i]);
+
+        instances[i] = modelManager.createModelInstance(sphereModel, INSTANCES_PER_MODEL, constantBuffer, 0);
+        ModelInstance::setMaterial(instances[i], 0, materials[i % MATERIAL_COUNT]);
+    }
+
+    InstanceBatcher instanceBatcher(device, heapAllocator, sizeof(InstanceData), INSTANCES_PER_DRAW,
+                                    MATERIAL_COUNT * MAX_MESH_LODS, 0);
+
+    CommandBuffer empty = {0};
+
+    float view[16];
+    mnMatrix4Identity(view);
+
+    //the instances further to the side fall outside of the frustum and get culled
+    float projection[16];
+    mnMatrix4Perspective(60 * M_PI / 180.0, 16.0f / 9.0f, 0.1, 100, projection);
+    renderQueue.setProjectionMatrix(projection);
+
+    Vector3 wallVertices[] = {
+            -8, -3, -16,
+            -8, +3, -16,
+            +8, +3, -16,
+            +8, -3, -16,
+    };
+    uint32_t wallIndices[] = {0, 1, 3, 3, 1, 2};
+
+    float wallModel[16];
+    mnMatrix4Identity(wallModel);
+
+    OcclusionBuffer occlusionBuffer(heapAllocator, 2, std::thread::hardware_concurrency());
+
+    if (occlusion)
+        renderQueue.setOcclusionBuffer(&occlusionBuffer);
+
+    printf("%d model instances, %d materials, %d frames%s%s\n", modelInstances, MATERIAL_COUNT, frames,
+           batched ? ", batched" : "", occlusion ? ", occlusion" : "");
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    for (int frame = 0; frame < frames; frame++) {
+        std::chrono::high_resolution_clock::time_point frameStart = std::chrono::high_resolution_clock::now();
+
+        float angle = frame * 0.01f;
+
+        for (int i = 0; i < modelInstances; i++) {
+            for (int j = 0; j < INSTANCES_PER_MODEL; j++) {
+                float center[3] = {
+                        cosf(angle + i) * (i + 1) * 2,
+                        sinf(angle + j) * 2,
+                        -10.0f - i - j,
+                };
+
+                mnMatrix4Translate(center, instanceData[i][j].rotation);
+                instanceData[i][j].color[0] = 1;
+                instanceData[i][j].color[1] = 1;
+                instanceData[i][j].color[2] = 1;
+                instanceData[i][j].color[3] = 1;
+
+                ModelInstance::setTransform(instances[i], j, instanceData[i][j].rotation);
+            }
+        }
+
+        renderQueue.setViewMatrix(view);
+
+        if (occlusion) {
+            occlusionBuffer.begin(projection, view);
+            occlusionBuffer.addOccluder(wallVertices, wallIndices, 6, wallModel);
+            occlusionBuffer.rasterize();
+        }
+
+        if (batched) {
+            for (int i = 0; i < modelInstances; i++)
+                instanceBatcher.draw(instances[i], instanceData[i], i % MATERIAL_COUNT, &empty);
+
+            instanceBatcher.submit(renderQueue);
+        } else {
+            instanceArena.upload();
+
+            for (int i = 0; i < modelInstances; i++)
+                ModelInstance::draw(instances[i], i % MATERIAL_COUNT, renderQueue, &empty);
+        }
+
+        renderQueue.sort();
+        renderQueue.sendToDevice();
+
+        device.endFrame();
+
+        std::chrono::duration<double> frameTime = std::chrono::high_resolution_clock::now() - frameStart;
+        renderStatistics.endFrame(device, renderQueue, frameTime.count());
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    FrameStatistics average;
+    renderStatistics.getAverage(average);
+
+    printf("%-16s %12.3f\n", "ms/frame", elapsed.count() * 1000.0 / frames);
+    printf("%-16s %12u\n", "items", average.queue.itemsSubmitted);
+    printf("%-16s %12u\n", "culled", average.queue.itemsCulled);
+    if (batched)
+        printf("%-16s %12d\n", "batched draws", instanceBatcher.getDrawCount());
+    if (batched && instanceBatcher.getDroppedCount() > 0)
+        printf("%-16s %12d\n", "dropped", instanceBatcher.getDroppedCount());
+    printf("%-16s %12u\n", "executed", RenderStatistics::getExecutedCommands(average));
+    printf("%-16s %12u\n", "skipped", RenderStatistics::getSkippedCommands(average));
+    printf("%-16s %12u\n", "state changes", RenderStatistics::getStateChanges(average));
+    printf("%-16s %12u\n", "draw calls", average.device.drawCalls + average.device.instancedDrawCalls);
+    printf("%-16s %12llu\n", "device calls", (unsigned long long) device.getCallCount());
+
+    //instances without bounds are never occluded, one behind the wall is
+    bool occlusionFailed = false;
+
+    if (occlusion) {
+        BoundingSphere unbounded = {{0, 0, 0}, INFINITY};
+        BoundingSphere hidden = {{0, 0, -32}, 1};
+
+        occlusionFailed = !occlusionBuffer.isVisible(unbounded) || occlusionBuffer.isVisible(hidden);
+
+        if (occlusionFailed)
+            printf("occlusion check failed\n");
+    }
+
+    for (int i = 0; i < modelInstances; i++)
+        modelManager.destroyModelInstance(instances[i]);
+
+    heapAllocator.deallocate(instances);
+    heapAllocator.deallocate(instanceData);
+
+    modelManager.destroyModel(sphereModel);
+
+    for (int i = 0; i < MATERIAL_COUNT; i++) {
+        materialManager.destroyMaterial(materials[i]);
+        device.destroyTexture(textures[i]);
+    }
+
+    device.destroyProgram(programs[0]);
+    device.destroyProgram(programs[1]);
+    device.destroySampler(sampler);
+
+    device.setTrace(nullptr);
+
+    if (trace != nullptr)
+        fclose(trace);
+
+    return occlusionFailed ? 1 : 0;
+}
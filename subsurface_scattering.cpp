@@ -19,10 +19,12 @@
 #include "Device.h"
 #include "Commands.h"
 #include "RenderQueue.h"
+#include "Profiler.h"
 #include "Text.h"
 #include "Material.h"
 #include "ModelManager.h"
 #include "TextureManager.h"
+#include "AssetLoader.h"
 #include "Shaders.h"
 #include "Wavefront.h"
 
@@ -31,6 +33,7 @@ Rect viewport = {};
 int framebufferIndex = 9;
 float angle = 0;
 bool autoAngle = true;
+bool printProfile = false;
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -52,6 +55,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
         case GLFW_KEY_SPACE:
             autoAngle = !autoAngle;
             break;
+        case GLFW_KEY_P:
+            printProfile = true;
+            break;
         case GLFW_KEY_0:
             framebufferIndex = 0;
             break;
@@ -326,6 +332,7 @@ int main() {
 
     ModelManager modelManager(heapAllocator, device);
     TextureManager textureManager(heapAllocator, device);
+    AssetLoader loader(heapAllocator, device, std::thread::hardware_concurrency());
     TextManager textManager(heapAllocator, device);
 
     Font fontRegular = textManager.loadFont("./fonts/OpenSans-Bold.ttf", 96);
@@ -339,7 +346,10 @@ int main() {
 
     Model* sphereModel = modelManager.createSphere("sphere01", 1.0, 20);
     Model* quadModel = modelManager.createQuad("quad");
-    Model* wavefront = modelManager.loadWavefront("models/venus.obj");
+
+    //the scene renders while the model is still loading
+    ResourceHandle wavefrontHandle = modelManager.loadWavefront("models/venus.obj", loader);
+    Model* wavefront = nullptr;
 
     struct In_InstanceData {
         Matrix4 in_Rotation;
@@ -359,12 +369,18 @@ int main() {
     In_FrameData frameData;
     In_FrameData depthData;
 
-    ModelInstance* modelInstance = modelManager.createModelInstance(wavefront, NUMBER_SPHERES, sphere4Instances, BINDING_POINT_INSTANCE_DATA);
+    ModelInstance* modelInstance = nullptr;
+
+    device.setProgramCache("programs");
 
     Program depthShader = device.createProgram(commonSource, depth_shader_vert, depth_shader_frag, nullptr);
     Program subsurfaceShader = device.createProgram(commonSource, subsurface_shader_vert, subsurface_shader_frag, nullptr);
     Program drawTexture = device.createProgram(commonSource, draw_texture_vert, draw_texture_frag, nullptr);
 
+    const ProgramCacheStatistics& programCache = device.getProgramCacheStatistics();
+    printf("Programs: %d from cache in %.1f ms, %d compiled in %.1f ms\n",
+           programCache.hits, programCache.loadTime * 1000, programCache.misses, programCache.compileTime * 1000);
+
     device.setConstantBufferBindingPoint(depthShader, "in_FrameData", BINDING_POINT_FRAME_DATA);
     device.setConstantBufferBindingPoint(depthShader, "in_InstanceData", BINDING_POINT_INSTANCE_DATA);
 
@@ -411,6 +427,20 @@ int main() {
 
     RenderQueue renderQueue(device, heapAllocator);
 
+    const char* passNames[] = {"Depth", "Scene"};
+    Profiler profiler(device, heapAllocator);
+    active_profiler = &profiler;
+
+    CommandBuffer* passBegin[2];
+    CommandBuffer* passEnd = CommandBuffer::create(heapAllocator, 1);
+    ProfileEnd::create(passEnd);
+
+    for (int i = 0; i < 2; i++) {
+        passBegin[i] = CommandBuffer::create(heapAllocator, 1);
+        ProfileBegin::create(passBegin[i], passNames[i]);
+    }
+
+
     double current = glfwGetTime();
     double inc = 0;
     int fps = 0;
@@ -431,6 +461,15 @@ int main() {
             inc = 0;
         }
 
+        //2 ms a frame, the rest waits for the next one
+        loader.finalize(2);
+
+        if (wavefront == nullptr)
+            wavefront = modelManager.getModel(wavefrontHandle);
+
+        if (modelInstance == nullptr && wavefront != nullptr)
+            modelInstance = modelManager.createModelInstance(wavefront, NUMBER_SPHERES, sphere4Instances, BINDING_POINT_INSTANCE_DATA);
+
         angleLight += 0.3 * d;
         if (autoAngle) {
             angle += 0.3 * d;
@@ -485,8 +524,11 @@ int main() {
             BindProgram::create(depthPass, depthShader);
         }
 
+        renderQueue.submit(0, &passBegin[0], 1);
         renderQueue.submit(0, &depthPassCommon, 1);
-        ModelInstance::drawNoMaterial(modelInstance, 0, renderQueue, depthPass);
+        if (modelInstance != nullptr)
+            ModelInstance::drawNoMaterial(modelInstance, 0, renderQueue, depthPass);
+        renderQueue.submit(0, &passEnd, 1);
 
         if (scenePassCommon == nullptr) {
             scenePassCommon = CommandBuffer::create(heapAllocator, 100);
@@ -520,8 +562,11 @@ int main() {
             BindTexture::create(scenePass, depthTexture, {0}, 0);
         }
 
+        renderQueue.submit(0, &passBegin[1], 1);
         renderQueue.submit(0, &scenePassCommon, 1);
-        ModelInstance::drawNoMaterial(modelInstance, 0, renderQueue, scenePass);
+        if (modelInstance != nullptr)
+            ModelInstance::drawNoMaterial(modelInstance, 0, renderQueue, scenePass);
+        renderQueue.submit(0, &passEnd, 1);
 
         if (quadPass == nullptr) {
             quadPass = CommandBuffer::create(heapAllocator, 100);
@@ -561,16 +606,31 @@ int main() {
         const float color[3] = {1, 1, 1};
         textManager.printText(fontRegular, {0}, color, 10, 30, "Subsurface Scattering");
 
+        if (loader.getPendingCount() > 0)
+            textManager.printText(fontRegular, {0}, color, 10, 80, "Loading...");
+
+        if (printProfile) {
+            profiler.printSummary(stdout);
+            printProfile = false;
+        }
+
+        profiler.endFrame();
+        device.endFrame();
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    loader.finish();
+    wavefront = modelManager.getModel(wavefrontHandle);
+
+    if (modelInstance != nullptr)
+        modelManager.destroyModelInstance(modelInstance);
+
     modelManager.destroyModel(sphereModel);
     modelManager.destroyModel(quadModel);
     modelManager.destroyModel(wavefront);
 
-    modelManager.destroyModelInstance(modelInstance);
-
     device.destroyConstantBuffer(sphere4Instances);
     device.destroyConstantBuffer(frameConstantBuffer);
     device.destroyConstantBuffer(depthConstantBuffer);
@@ -588,4 +648,8 @@ int main() {
     heapAllocator.deallocate(scenePassCommon);
     heapAllocator.deallocate(scenePass);
     heapAllocator.deallocate(quadPass);
+
+    heapAllocator.deallocate(passEnd);
+    for (int i = 0; i < 2; i++)
+        heapAllocator.deallocate(passBegin[i]);
 }